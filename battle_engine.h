@@ -0,0 +1,354 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define BATTLE_ENGINE_AVX2 1
+#endif
+
+#include "name_table.h"
+#include "rng.h"
+
+// --------------------------------------------------
+// 大人数戦闘エンジン (パーティ対大群)
+// 戦闘員1人ずつのオブジェクトではなく、能力値ごとの配列 (SoA) で持ち、
+// 1回の斉射 (片方の陣営の全員の攻撃) をまとめて計算する
+//
+// ダメージのルールは roll_attack_damage と同じ:
+//   10% でクリティカル (攻撃力1.5倍、端数切り捨て)、ダメージは max(1, 攻撃力 - 防御力)
+// クリティカルの判定は RngStream::chance(1, 10) と同じ値で行う (next() の上位32ビットを比べる)
+// --------------------------------------------------
+
+// (next() >> 32) がこれ未満ならクリティカル (below(10) < 1 と同値)
+const uint32_t CRITICAL_ROLL_LIMIT = 429496730;
+
+// 斉射の計算に使う実装
+enum class CombatKernel {
+    Auto,     // AVX2 が使えれば AVX2、なければスカラー
+    Scalar,
+    Avx2,
+};
+
+inline bool combatAvx2Available() {
+#ifdef BATTLE_ENGINE_AVX2
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+// Auto を実際に使う実装に決める (AVX2 が使えない環境ではスカラーにする)
+inline CombatKernel resolveCombatKernel(CombatKernel kernel) {
+    if (kernel == CombatKernel::Scalar || !combatAvx2Available()) {
+        return CombatKernel::Scalar;
+    }
+    return CombatKernel::Avx2;
+}
+
+inline const char* combatKernelName(CombatKernel kernel) {
+    switch (kernel) {
+    case CombatKernel::Scalar: return "scalar";
+    case CombatKernel::Avx2: return "avx2";
+    default: return "auto";
+    }
+}
+
+// --- 斉射の計算 ---
+// 攻撃側 i が防御側 i を攻撃する (防御側は重ならないこと)
+// hp[i] -= max(1, attack[i] (+ クリティカルなら attack[i] / 2) - defense[i])、0 未満にはしない
+// 戻り値はクリティカルの数
+
+inline uint32_t strikeScalar(const int32_t* attack, const uint32_t* roll, const int32_t* defense,
+                             int32_t* hp, size_t count) {
+    uint32_t criticals = 0;
+    for (size_t i = 0; i < count; ++i) {
+        bool critical = roll[i] < CRITICAL_ROLL_LIMIT;
+        int32_t damage = std::max(1, attack[i] + (critical ? attack[i] >> 1 : 0) - defense[i]);
+        hp[i] = std::max(0, hp[i] - damage);
+        criticals += critical;
+    }
+    return criticals;
+}
+
+#ifdef BATTLE_ENGINE_AVX2
+// 8人ずつ計算する。攻撃力は0以上なので、/2 の代わりに算術シフトを使える
+__attribute__((target("avx2")))
+inline uint32_t strikeAvx2(const int32_t* attack, const uint32_t* roll, const int32_t* defense,
+                           int32_t* hp, size_t count) {
+    // 符号なしの比較は、両辺の最上位ビットを反転して符号付きで比べる
+    const __m256i sign = _mm256_set1_epi32(INT32_MIN);
+    const __m256i limit = _mm256_set1_epi32(static_cast<int32_t>(CRITICAL_ROLL_LIMIT ^ 0x80000000u));
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i zero = _mm256_setzero_si256();
+
+    uint32_t criticals = 0;
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(attack + i));
+        __m256i r = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(roll + i)), sign);
+        __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(defense + i));
+        __m256i h = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(hp + i));
+
+        __m256i critical = _mm256_cmpgt_epi32(limit, r);
+        __m256i bonus = _mm256_and_si256(critical, _mm256_srai_epi32(a, 1));
+        __m256i damage = _mm256_max_epi32(_mm256_sub_epi32(_mm256_add_epi32(a, bonus), d), one);
+        h = _mm256_max_epi32(_mm256_sub_epi32(h, damage), zero);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(hp + i), h);
+
+        criticals += static_cast<uint32_t>(__builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(critical))));
+    }
+    return criticals + strikeScalar(attack + i, roll + i, defense + i, hp + i, count - i);
+}
+#endif
+
+// --- クリティカル判定の乱数 ---
+// rolls[i] = (rng.next() >> 32) を count 個 (rng はその分だけ進む)
+// RngStream はカウンター型なので、i 番目の値は他と関係なく計算できる
+
+inline void fillRollsScalar(RngStream& rng, uint32_t* rolls, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        rolls[i] = static_cast<uint32_t>(rng.next() >> 32);
+    }
+}
+
+#ifdef BATTLE_ENGINE_AVX2
+// 64ビット同士の積の下位64ビット (AVX2 には64ビットの乗算がないので32ビットの積を組み合わせる)
+__attribute__((target("avx2")))
+inline __m256i multiplyLow64(__m256i a, uint64_t b) {
+    const __m256i b_low = _mm256_set1_epi64x(static_cast<int64_t>(b & 0xFFFFFFFFu));
+    const __m256i b_high = _mm256_set1_epi64x(static_cast<int64_t>(b >> 32));
+    __m256i low = _mm256_mul_epu32(a, b_low);
+    __m256i cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), b_low), _mm256_mul_epu32(a, b_high));
+    return _mm256_add_epi64(low, _mm256_slli_epi64(cross, 32));
+}
+
+// mixBits (SplitMix64) を4つずつ計算する
+__attribute__((target("avx2")))
+inline void fillRollsAvx2(RngStream& rng, uint32_t* rolls, size_t count) {
+    const uint64_t gamma = 0x9E3779B97F4A7C15ull;
+    const uint64_t key = rng.streamKey();
+    const uint64_t first = rng.position() + 1;
+    const __m256i step = _mm256_set1_epi64x(static_cast<int64_t>(4 * gamma));
+    const __m256i upper = _mm256_setr_epi32(1, 3, 5, 7, 0, 0, 0, 0);
+    __m256i z0 = _mm256_setr_epi64x(static_cast<int64_t>(key + first * gamma),
+                                    static_cast<int64_t>(key + (first + 1) * gamma),
+                                    static_cast<int64_t>(key + (first + 2) * gamma),
+                                    static_cast<int64_t>(key + (first + 3) * gamma));
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256i z = z0;
+        z = multiplyLow64(_mm256_xor_si256(z, _mm256_srli_epi64(z, 30)), 0xBF58476D1CE4E5B9ull);
+        z = multiplyLow64(_mm256_xor_si256(z, _mm256_srli_epi64(z, 27)), 0x94D049BB133111EBull);
+        z = _mm256_xor_si256(z, _mm256_srli_epi64(z, 31));
+        // 各64ビットの上位32ビットを下の128ビットに集める
+        __m128i high = _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(z, upper));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(rolls + i), high);
+        z0 = _mm256_add_epi64(z0, step);
+    }
+    rng = RngStream(key, first - 1 + i);
+    fillRollsScalar(rng, rolls + i, count - i);
+}
+#endif
+
+inline void fillRolls(CombatKernel kernel, RngStream& rng, uint32_t* rolls, size_t count) {
+#ifdef BATTLE_ENGINE_AVX2
+    if (kernel == CombatKernel::Avx2) {
+        fillRollsAvx2(rng, rolls, count);
+        return;
+    }
+#else
+    (void)kernel;
+#endif
+    fillRollsScalar(rng, rolls, count);
+}
+
+inline uint32_t strike(CombatKernel kernel, const int32_t* attack, const uint32_t* roll, const int32_t* defense,
+                       int32_t* hp, size_t count) {
+#ifdef BATTLE_ENGINE_AVX2
+    if (kernel == CombatKernel::Avx2) {
+        return strikeAvx2(attack, roll, defense, hp, count);
+    }
+#else
+    (void)kernel;
+#endif
+    return strikeScalar(attack, roll, defense, hp, count);
+}
+
+// --------------------------------------------------
+// 戦闘員の集まり (CombatUnits)
+// 1つの陣営の能力値を配列ごとに持つ。添字 (スロット) は compact() で詰め直すと変わる
+// 戦闘員ごとの通し番号 (id) は追加した順に増え、詰め直しても変わらない (スロットの順に増えたまま)
+// 名前は NameTable の番号で持ち、能力値と一緒に詰め直す
+// --------------------------------------------------
+class CombatUnits {
+public:
+    // 戦闘員を追加してスロットを返す (攻撃力は0未満にしない)
+    size_t add(NameId name, int hp, int attack, int defense) {
+        hpValues.push_back(hp);
+        maxHpValues.push_back(hp);
+        attackValues.push_back(std::max(0, attack));
+        defenseValues.push_back(defense);
+        names.push_back(name);
+        unitIds.push_back(nextUnitId++);
+        return hpValues.size() - 1;
+    }
+
+    void reserve(size_t count) {
+        hpValues.reserve(count);
+        maxHpValues.reserve(count);
+        attackValues.reserve(count);
+        defenseValues.reserve(count);
+        names.reserve(count);
+        unitIds.reserve(count);
+    }
+
+    size_t size() const { return hpValues.size(); }
+    bool empty() const { return hpValues.empty(); }
+
+    int32_t* hp() { return hpValues.data(); }
+    const int32_t* hp() const { return hpValues.data(); }
+    const int32_t* attack() const { return attackValues.data(); }
+    const int32_t* defense() const { return defenseValues.data(); }
+
+    int hp(size_t slot) const { return hpValues[slot]; }
+    int maxHp(size_t slot) const { return maxHpValues[slot]; }
+    int attack(size_t slot) const { return attackValues[slot]; }
+    int defense(size_t slot) const { return defenseValues[slot]; }
+    NameId name(size_t slot) const { return names[slot]; }
+    uint32_t id(size_t slot) const { return unitIds[slot]; }
+    void setHp(size_t slot, int value) { hpValues[slot] = value; }
+
+    // compact() した回数 (変わっていなければ、覚えておいたスロットはそのまま使える)
+    uint64_t compactions() const { return compactCount; }
+
+    // 通し番号が unit_id の戦闘員の今のスロット (取り除かれていたら size())
+    size_t find(uint32_t unit_id) const {
+        auto it = std::lower_bound(unitIds.begin(), unitIds.end(), unit_id);
+        return it != unitIds.end() && *it == unit_id ? static_cast<size_t>(it - unitIds.begin()) : unitIds.size();
+    }
+
+    // 残りHPの合計
+    int64_t totalHp() const {
+        int64_t total = 0;
+        for (int32_t value : hpValues) {
+            total += value;
+        }
+        return total;
+    }
+
+    // HP が 0 の戦闘員を取り除き、残りを前に詰める (順序は保つ)。取り除いた数を返す
+    size_t compact() {
+        const size_t count = hpValues.size();
+        size_t kept = 0;
+        for (size_t i = 0; i < count; ++i) {
+            // 書き込みは無条件に行い、生きていれば書き込み位置を進める (分岐を予測させない)
+            hpValues[kept] = hpValues[i];
+            maxHpValues[kept] = maxHpValues[i];
+            attackValues[kept] = attackValues[i];
+            defenseValues[kept] = defenseValues[i];
+            names[kept] = names[i];
+            unitIds[kept] = unitIds[i];
+            kept += hpValues[i] > 0;
+        }
+        hpValues.resize(kept);
+        maxHpValues.resize(kept);
+        attackValues.resize(kept);
+        defenseValues.resize(kept);
+        names.resize(kept);
+        unitIds.resize(kept);
+        ++compactCount;
+        return count - kept;
+    }
+
+private:
+    std::vector<int32_t> hpValues;
+    std::vector<int32_t> maxHpValues;
+    std::vector<int32_t> attackValues;
+    std::vector<int32_t> defenseValues;
+    std::vector<NameId> names;
+    std::vector<uint32_t> unitIds;
+    uint32_t nextUnitId = 0;
+    uint64_t compactCount = 0;
+};
+
+// --------------------------------------------------
+// パーティ対大群の戦闘 (MassBattle)
+// 1ラウンド = パーティの斉射 -> 倒れた敵を取り除く -> 大群の斉射 -> 倒れた味方を取り除く
+// 攻撃側 i は防御側 (i + ラウンド数) % 防御側の人数 を狙う
+// (人数が違えば同じ相手を複数人が狙い、ラウンドごとに狙う相手がずれる)
+// 同じ斉射の中では、先に倒れた相手への攻撃もそのまま当たる (無駄打ちになる)
+// --------------------------------------------------
+struct MassBattleStats {
+    uint64_t rounds = 0;
+    uint64_t attacks = 0;
+    uint64_t criticals = 0;
+    uint64_t party_losses = 0;
+    uint64_t horde_losses = 0;
+};
+
+class MassBattle {
+public:
+    MassBattle(CombatUnits& party_units, CombatUnits& horde_units, const RngStream& party_rng,
+               const RngStream& horde_rng, CombatKernel kernel = CombatKernel::Auto)
+        : party(party_units), horde(horde_units), partyRng(party_rng), hordeRng(horde_rng),
+          kernelUsed(resolveCombatKernel(kernel)) {}
+
+    bool finished() const { return party.empty() || horde.empty(); }
+    bool partyWon() const { return !party.empty() && horde.empty(); }
+    CombatKernel kernel() const { return kernelUsed; }
+    const MassBattleStats& stats() const { return totals; }
+
+    void round() {
+        if (finished()) {
+            return;
+        }
+        volley(party, horde, partyRng);
+        totals.horde_losses += horde.compact();
+        if (!horde.empty()) {
+            volley(horde, party, hordeRng);
+            totals.party_losses += party.compact();
+        }
+        ++totals.rounds;
+    }
+
+    // 決着まで (または max_rounds まで) 戦う
+    void run(uint64_t max_rounds = UINT64_MAX) {
+        while (!finished() && totals.rounds < max_rounds) {
+            round();
+        }
+    }
+
+private:
+    CombatUnits& party;
+    CombatUnits& horde;
+    RngStream partyRng;
+    RngStream hordeRng;
+    CombatKernel kernelUsed;
+    MassBattleStats totals;
+    std::vector<uint32_t> rolls;
+
+    void volley(const CombatUnits& attackers, CombatUnits& defenders, RngStream& rng) {
+        const size_t count = attackers.size();
+        const size_t targets = defenders.size();
+
+        // クリティカル判定の乱数は攻撃側の順に1つずつ (chance(1, 10) と同じ列)
+        rolls.resize(count);
+        fillRolls(kernelUsed, rng, rolls.data(), count);
+
+        // 狙う相手が連続する区間ごとに斉射の計算を呼ぶ (区間の中では相手が重ならない)
+        size_t target = static_cast<size_t>(totals.rounds % targets);
+        size_t i = 0;
+        while (i < count) {
+            size_t length = std::min(count - i, targets - target);
+            totals.criticals += strike(kernelUsed, attackers.attack() + i, rolls.data() + i,
+                                       defenders.defense() + target, defenders.hp() + target, length);
+            i += length;
+            target = 0;
+        }
+        totals.attacks += count;
+    }
+};
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <vector>
+
+// --------------------------------------------------
+// 迷路ゲームの戦闘の勝率 (厳密計算)
+// 戦闘のルール (MazeGame::advanceBattle):
+//   1ラウンド = プレイヤーが [1, 攻撃力] の一様なダメージ -> 敵のHPが0以下なら勝ち
+//               -> 敵が [1, 敵の攻撃力] の一様なダメージ -> プレイヤーのHPが0以下なら負け
+// 状態 (プレイヤーのHP p, 敵のHP m) の動的計画法で、ラウンドの始めの状態から
+//   W(p, m) = 勝つ確率
+//   F(p, m) = 戦闘後のプレイヤーのHPの期待値 (負けたら0)
+// を求める。ダメージの範囲にわたる和は窓の和と累積和の差で求まるので、表全体で O(P * M)
+// 乱数で試す代わりに正確な値が表を引くだけで得られる
+// --------------------------------------------------
+
+struct BattleOdds {
+    double win;                 // 勝つ確率
+    double expected_hp_loss;    // 失うHPの期待値 (負けたときは残りHPを全て失う)
+};
+
+// 攻撃力の組 (プレイヤー, 敵) ごとの表。HP は 1..maxPlayerHp, 1..maxMonsterHp の全状態を持つ
+class BattleOddsTable {
+public:
+    BattleOddsTable(int player_attack, int monster_attack, int max_player_hp, int max_monster_hp)
+        : playerAttack(std::max(1, player_attack)), monsterAttack(std::max(1, monster_attack)),
+          playerRows(std::max(1, max_player_hp)), monsterColumns(std::max(1, max_monster_hp)) {
+        build();
+    }
+
+    int maxPlayerHp() const { return playerRows; }
+    int maxMonsterHp() const { return monsterColumns; }
+
+    // HP が表の範囲にあること (0 以下はすでに決着しているとみなす)
+    BattleOdds lookup(int player_hp, int monster_hp) const {
+        if (monster_hp <= 0) {
+            return { 1.0, 0.0 };
+        }
+        if (player_hp <= 0) {
+            return { 0.0, 0.0 };
+        }
+        size_t i = index(player_hp, monster_hp);
+        return { win[i], player_hp - hpLeft[i] };
+    }
+
+private:
+    int playerAttack, monsterAttack;
+    int playerRows, monsterColumns;
+    std::vector<double> win;        // W(p, m)
+    std::vector<double> hpLeft;     // F(p, m)
+
+    size_t index(int p, int m) const {
+        return static_cast<size_t>(p) * (monsterColumns + 1) + m;
+    }
+
+    void build() {
+        const size_t columns = static_cast<size_t>(monsterColumns) + 1;
+        const size_t cells = (static_cast<size_t>(playerRows) + 1) * columns;
+        win.assign(cells, 0.0);
+        hpLeft.assign(cells, 0.0);
+
+        // 敵の攻撃の後 (プレイヤーのHP p, 敵のHP m) から続く値の和: 敵のダメージ e (1..monsterAttack) で
+        // p - e > 0 なら続くので、列 m の W(p', m) を p' = [max(1, p - monsterAttack), p - 1] で足したもの
+        // 行が1つ進むごとに窓を1つずらす
+        std::vector<double> window_win(columns, 0.0), window_hp(columns, 0.0);
+        // 行の中の m 方向の累積和 (敵の番の値 V(p, m), G(p, m))
+        std::vector<double> after_win(columns, 0.0), after_hp(columns, 0.0);
+
+        const double player_share = 1.0 / playerAttack;
+        const double monster_share = 1.0 / monsterAttack;
+
+        for (int p = 1; p <= playerRows; ++p) {
+            int leaving = p - monsterAttack - 1;
+            for (int m = 1; m <= monsterColumns; ++m) {
+                window_win[m] += win[index(p - 1, m)];
+                window_hp[m] += hpLeft[index(p - 1, m)];
+                if (leaving >= 1) {
+                    window_win[m] -= win[index(leaving, m)];
+                    window_hp[m] -= hpLeft[index(leaving, m)];
+                }
+                after_win[m] = after_win[m - 1] + window_win[m] * monster_share;
+                after_hp[m] = after_hp[m - 1] + window_hp[m] * monster_share;
+            }
+
+            // プレイヤーの攻撃 d (1..playerAttack): d >= m なら勝ち、でなければ敵の HP m - d で敵の番
+            for (int m = 1; m <= monsterColumns; ++m) {
+                int finishing = std::max(0, playerAttack - m + 1);
+                int from = std::max(0, m - playerAttack - 1);
+                size_t i = index(p, m);
+                win[i] = (finishing + after_win[m - 1] - after_win[from]) * player_share;
+                hpLeft[i] = (finishing * static_cast<double>(p) + after_hp[m - 1] - after_hp[from]) * player_share;
+            }
+        }
+    }
+};
+
+// 表のキャッシュ (攻撃力の組ごとに1つ)
+// HP が表の範囲を超えたら、範囲を倍に広げて作り直す。表が limit 個を超えそうなら全て捨てる
+// スレッドセーフではない (ゲームのスレッドだけで使う)
+class BattleOddsCache {
+public:
+    // player_hp_hint: プレイヤーのHPの上限の見込み (最初からその行まで作る)
+    explicit BattleOddsCache(int player_hp_hint = 1, size_t table_limit = 256)
+        : playerHpHint(player_hp_hint), limit(table_limit), builds(0) {}
+
+    BattleOdds odds(int player_attack, int monster_attack, int player_hp, int monster_hp) {
+        if (player_hp <= 0 || monster_hp <= 0) {
+            return { monster_hp <= 0 ? 1.0 : 0.0, 0.0 };
+        }
+        uint64_t key = static_cast<uint64_t>(static_cast<uint32_t>(player_attack)) << 32
+            | static_cast<uint32_t>(monster_attack);
+        auto found = tables.find(key);
+        if (found == tables.end()) {
+            if (tables.size() >= limit) {
+                tables.clear();
+            }
+            found = tables.emplace(key, nullptr).first;
+        }
+
+        std::unique_ptr<BattleOddsTable>& table = found->second;
+        if (!table || player_hp > table->maxPlayerHp() || monster_hp > table->maxMonsterHp()) {
+            int rows = std::max(playerHpHint, player_hp);
+            int columns = monster_hp;
+            if (table) {
+                // 足りない方だけを倍にする
+                rows = std::max(rows, table->maxPlayerHp() * (player_hp > table->maxPlayerHp() ? 2 : 1));
+                columns = std::max(columns, table->maxMonsterHp() * (monster_hp > table->maxMonsterHp() ? 2 : 1));
+            }
+            table.reset(new BattleOddsTable(player_attack, monster_attack, rows, columns));
+            ++builds;
+        }
+        return table->lookup(player_hp, monster_hp);
+    }
+
+    size_t tableCount() const { return tables.size(); }
+    uint64_t tablesBuilt() const { return builds; }
+
+private:
+    int playerHpHint;
+    size_t limit;
+    uint64_t builds;
+    std::map<uint64_t, std::unique_ptr<BattleOddsTable>> tables;
+};
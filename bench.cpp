@@ -0,0 +1,689 @@
+// --------------------------------------------------
+// ベンチマーク (bench)
+// 両方のゲームのソースをそれぞれ名前空間に取り込み、主要な処理を直接呼んで測る
+// 迷路の大きさとモンスター数を変えながら測定し、表と JSON を出力する
+//
+//   bench [--min-time 秒] [--filter 名前] [--quick] [--json ファイル (- なら標準出力)]
+//
+// JSON は commit ごとに保存して比較できるよう、ケースの並びと項目を固定している
+// --------------------------------------------------
+
+// 取り込むソースが使う標準ヘッダーと共通ヘッダーを先に読み込んでおく
+// (名前空間の中での #include はインクルードガードで空になる)
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <future>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <new>
+#include <random>
+#include <set>
+#include <stack>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+
+#include "battle_engine.h"
+#include "battle_odds.h"
+#include "distance_field.h"
+#include "field_of_view.h"
+#include "free_cell_set.h"
+#include "game_events.h"
+#include "maze_grid.h"
+#include "maze_stream.h"
+#include "message_catalog.h"
+#include "name_table.h"
+#include "net_socket.h"
+#include "replay.h"
+#include "rng.h"
+#include "save_file.h"
+#include "term_input.h"
+#include "term_renderer.h"
+#include "thread_pool.h"
+#include "work_stealing_pool.h"
+
+// 両方のゲームが Character などの同じ名前を使うので、別々の名前空間に入れる
+#define MAZE002_NO_MAIN
+#define RPG001_NO_MAIN
+namespace maze {
+#include "maze002.cpp"
+}
+namespace rpg {
+#include "rpg001.cpp"
+}
+
+// 計算結果を最適化で消されないようにする
+template <class T>
+inline void keepValue(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile const T* sink;
+    sink = &value;
+#endif
+}
+
+// 1つの測定結果
+struct BenchResult {
+    std::string name;
+    int width, height;
+    int monsters;
+    uint64_t iterations;
+    double seconds;
+};
+
+// 反復回数を増やしながら、合計が min_seconds を超えるまで body(回数) を繰り返す
+template <class Fn>
+BenchResult measure(const char* name, int width, int height, int monsters, double min_seconds, Fn body) {
+    uint64_t iterations = 1;
+    while (true) {
+        auto start = std::chrono::steady_clock::now();
+        body(iterations);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (seconds >= min_seconds || iterations >= (uint64_t(1) << 40)) {
+            return BenchResult{ name, width, height, monsters, iterations, seconds };
+        }
+        // 短すぎる間は大きく増やし、目標に近づいたら見積もりで合わせる
+        double scale = seconds > 0 ? min_seconds / seconds * 1.2 : 100.0;
+        iterations = static_cast<uint64_t>(iterations * std::min(100.0, std::max(2.0, scale)));
+    }
+}
+
+const uint64_t BENCH_SEED = 20240601;
+
+// メモリの確保の回数 (ターンの処理が確保をしていないかを確かめる)
+std::atomic<uint64_t> allocationCount{ 0 };
+
+// 呼び出し側に展開されると malloc と delete の組み合わせとして警告されるので、どれも展開させない
+#if defined(__GNUC__) || defined(__clang__)
+#define BENCH_NOINLINE __attribute__((noinline))
+#else
+#define BENCH_NOINLINE
+#endif
+
+BENCH_NOINLINE void* operator new(size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+BENCH_NOINLINE void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+BENCH_NOINLINE void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+namespace maze {
+
+// MazeGame の内部の処理を呼ぶためのフレンド
+struct MazeGameBench {
+    // 指定の大きさのゲームを用意して1階を生成する (Game が固定サイズなら size はその大きさにする)
+    template <class Game = MazeGame>
+    static std::unique_ptr<Game> makeGame(int size, int monsters) {
+        std::unique_ptr<Game> game(new Game(size, size, NUM_FLOORS, BENCH_SEED, 0, monsters, CHASE_RADIUS));
+        game->setEventSink(nullptr);
+        game->enterFloor(1);
+        return game;
+    }
+
+    // (1, 1) の隣の通路 (プレイヤーを往復させる先)
+    template <class Game>
+    static void openNeighbor(const Game& game, int& x, int& y) {
+        const auto& floor = game.currentFloorData();
+        x = 1;
+        y = 1;
+        if (!floor.walls().test(2, 1)) {
+            x = 2;
+        }
+        else {
+            y = 2;
+        }
+    }
+
+    static BenchResult generateMazeFloor(int size, int monsters, double min_seconds) {
+        std::unique_ptr<MazeGame> game = makeGame(size, monsters);
+        return measure("generateMazeFloor", size, size, monsters, min_seconds, [&](uint64_t n) {
+            for (uint64_t i = 0; i < n; ++i) {
+                MazeFloor floor = game->generateMazeFloor(static_cast<int>(i % NUM_FLOORS) + 1);
+                keepValue(floor.grid().data()[size + 1]);
+            }
+        });
+    }
+
+    static BenchResult dfs(int size, double min_seconds) {
+        std::unique_ptr<MazeGame> game = makeGame(size, 0);
+        MazeGrid grid;
+        RngStream rng(BENCH_SEED);
+        return measure("dfs", size, size, 0, min_seconds, [&](uint64_t n) {
+            for (uint64_t i = 0; i < n; ++i) {
+                grid.assign(size, size, '#');
+                game->dfs(grid, 1, 1, rng);
+                keepValue(grid.data()[size + 1]);
+            }
+        });
+    }
+
+    // Eller 法で dfs と同じ大きさのグリッドを埋める (1回 = 1迷路。セル/秒は width * height * 回/秒)
+    static BenchResult eller(int size, double min_seconds) {
+        MazeGrid grid(size, size, '#');
+        RngStream rng(BENCH_SEED);
+        return measure("eller", size, size, 0, min_seconds, [&](uint64_t n) {
+            for (uint64_t i = 0; i < n; ++i) {
+                EllerMaze maze(size, static_cast<uint64_t>(size), rng.split(i));
+                for (int y = 0; y < size; ++y) {
+                    maze.next(grid.row(y));
+                }
+                keepValue(grid.data()[size + 1]);
+            }
+        });
+    }
+
+    // 戦闘の見込みの表を作る (1回 = 1つの表。モンスターのHPは size まで)
+    static BenchResult battleOddsTable(int size, double min_seconds) {
+        return measure("BattleOddsTable", MAX_HP, size, 0, min_seconds, [&](uint64_t n) {
+            for (uint64_t i = 0; i < n; ++i) {
+                BattleOddsTable table(PLAYER_BASE_ATTACK + 15, 15 + static_cast<int>(i % 10), MAX_HP, size);
+                keepValue(table.lookup(MAX_HP, size).win);
+            }
+        });
+    }
+
+    // 作ってある表を引く (1回 = 1回の問い合わせ)
+    static BenchResult battleOddsLookup(double min_seconds) {
+        BattleOddsCache cache(MAX_HP);
+        return measure("BattleOddsCache::odds", MAX_HP, 69, 0, min_seconds, [&](uint64_t n) {
+            double total = 0;
+            for (uint64_t i = 0; i < n; ++i) {
+                total += cache.odds(PLAYER_BASE_ATTACK + 15, 10 + static_cast<int>(i % 10), 1 + static_cast<int>(i % MAX_HP),
+                                    40 + static_cast<int>(i % 30)).win;
+            }
+            keepValue(total);
+        });
+    }
+
+    // 1戦闘分のメッセージ (出現・見込み・攻撃の応酬・撃破・ドロップ) を組み立てる (1回 = 8イベント)
+    static BenchResult formatMazeEvent(double min_seconds) {
+        const GameEvent events[] = {
+            makeEvent(GameEventType::BattleStart, 0, 55, 14),
+            makeEvent(GameEventType::BattleForecast, 0, 917, 23),
+            makeEvent(GameEventType::Damage, EVENT_FROM_PLAYER, 9, 46, NAME_PLAYER, NAME_MONSTER),
+            makeEvent(GameEventType::Damage, 0, 12, 88, NAME_MONSTER, NAME_PLAYER),
+            makeEvent(GameEventType::Damage, EVENT_FROM_PLAYER, 47, -1, NAME_PLAYER, NAME_MONSTER),
+            makeEvent(GameEventType::Kill, EVENT_FROM_PLAYER, 0, 0, NAME_PLAYER, NAME_MONSTER),
+            makeEvent(GameEventType::Drop, EVENT_FROM_PLAYER, 15, 0, NO_NAME, NO_NAME, defaultWeapons()[2].name),
+            makeEvent(GameEventType::Equip, EVENT_FROM_PLAYER, 15, 0, NO_NAME, NO_NAME, defaultWeapons()[2].name),
+        };
+        std::string out;
+        out.reserve(4096);
+        return measure("formatMazeEvent", 0, 0, 0, min_seconds, [&](uint64_t n) {
+            for (uint64_t i = 0; i < n; ++i) {
+                out.clear();
+                for (const GameEvent& event : events) {
+                    maze::formatMazeEvent(out, event);
+                }
+                keepValue(out.data());
+            }
+        });
+    }
+
+    // プレイヤーを隣のセルと往復させながらモンスターを動かす (距離場の更新を含む)
+    static BenchResult moveMonsters(int size, int monsters, double min_seconds) {
+        std::unique_ptr<MazeGame> game = makeGame(size, monsters);
+        int other_x, other_y;
+        openNeighbor(*game, other_x, other_y);
+        return measure("moveMonsters", size, size, monsters, min_seconds, [&](uint64_t n) {
+            for (uint64_t i = 0; i < n; ++i) {
+                bool away = (i & 1) != 0;
+                game->playerX = away ? other_x : 1;
+                game->playerY = away ? other_y : 1;
+                game->moveMonsters();
+            }
+            keepValue(game->currentFloorData().monsters.data());
+        });
+    }
+
+    // プレイヤーを隣のセルと往復させて1ターンずつ進める (移動・戦闘・モンスターの移動・メッセージの回収)
+    // Game を実行時サイズの MazeGame と固定サイズの DefaultMazeGame にして比べる
+    // 戦闘は最初のラウンドで決着するよう攻撃力を上げ、倒したモンスターは空きセルの索引から選んだ位置に戻して数を保つ
+    // ターンの途中でメモリを確保したら知らせる
+    template <class Game>
+    static BenchResult turn(const char* name, int monsters, double min_seconds) {
+        std::unique_ptr<Game> game = makeGame<Game>(MAZE_WIDTH, monsters);
+        int other_x, other_y;
+        openNeighbor(*game, other_x, other_y);
+        const char forward = other_x == 2 ? 'd' : 's';
+        const char back = other_x == 2 ? 'a' : 'w';
+        game->player.base_attack = 1000;
+        auto& floor = game->currentFloorData();
+        const std::vector<MonsterEntity> spawns = floor.monsters;
+        size_t next_spawn = 0;
+        RngStream respawn(BENCH_SEED, 3);
+        // 最初の2往復で距離場などの配列と地形の上の印の配列ができるので、測る前に済ませておく
+        for (int warmup = 0; warmup < 2; ++warmup) {
+            game->stepKey(forward);
+            game->stepKey(back);
+        }
+        uint64_t allocations = 0;
+        uint64_t turns = 0;
+        BenchResult result = measure(name, MAZE_WIDTH, MAZE_HEIGHT, monsters, min_seconds, [&](uint64_t n) {
+            uint64_t before = allocationCount.load(std::memory_order_relaxed);
+            for (uint64_t i = 0; i < n; ++i) {
+                game->player.hp = MAX_HP;
+                game->stepKey((i & 1) ? back : forward);
+                if (floor.monsters.size() < spawns.size()) {
+                    MonsterEntity monster = spawns[next_spawn++ % spawns.size()];
+                    if (floor.free_cells.pick(respawn, monster.x, monster.y)
+                        && (monster.x != game->playerX || monster.y != game->playerY)) {
+                        floor.monsters.push_back(monster);
+                        floor.occupy(monster.x, monster.y);
+                    }
+                }
+            }
+            allocations += allocationCount.load(std::memory_order_relaxed) - before;
+            turns += n;
+            keepValue(floor.monsters.data());
+        });
+        if (allocations > 0) {
+            std::fprintf(stderr, "%s: ターンの処理でメモリを %llu 回確保しました (%llu ターン)\n", name,
+                         static_cast<unsigned long long>(allocations), static_cast<unsigned long long>(turns));
+        }
+        return result;
+    }
+
+    // 生成したフロアの通路をすべてモンスターで埋める (1回 = 索引の作り直しと、空きセルの数だけの配置)
+    static BenchResult fillFloor(int size, double min_seconds) {
+        std::unique_ptr<MazeGame> game = makeGame(size, 0);
+        MazeFloor& floor = game->currentFloorData();
+        const int count = static_cast<int>(floor.free_cells.size());
+        RngStream rng(BENCH_SEED);
+        return measure("placeMonsters", size, size, count, min_seconds, [&](uint64_t n) {
+            for (uint64_t i = 0; i < n; ++i) {
+                floor.monsters.clear();
+                floor.rebuildOccupancy();
+                game->placeMonsters(floor, 1, rng, count, floor.free_cells);
+            }
+            keepValue(floor.monsters.data());
+        });
+    }
+
+    // 隣に置いたモンスターとの戦闘を決着まで進める (1回 = 1戦闘)
+    static BenchResult startBattle(double min_seconds) {
+        std::unique_ptr<MazeGame> game = makeGame(21, 0);
+        int target_x, target_y;
+        openNeighbor(*game, target_x, target_y);
+        MazeFloor& floor = game->currentFloorData();
+        RngStream stats(BENCH_SEED);
+        return measure("startBattle", 0, 0, 1, min_seconds, [&](uint64_t n) {
+            for (uint64_t i = 0; i < n; ++i) {
+                game->playerX = 1;
+                game->playerY = 1;
+                game->player.hp = MAX_HP;
+                game->player.equipped_weapon = { NAME_BARE_HANDS, 0 };
+
+                MonsterEntity monster = { target_x, target_y, stats.range(40, 69),
+                                          static_cast<int16_t>(stats.range(10, 19)), MonsterState::Wandering };
+                floor.monsters.push_back(monster);
+                floor.occupy(target_x, target_y);
+
+                game->startBattle(static_cast<int>(floor.monsters.size()) - 1, target_x, target_y);
+                while (game->battle.active) {
+                    game->advanceBattle();
+                }
+                // 負けた場合はモンスターが残っている
+                if (!floor.monsters.empty()) {
+                    floor.removeMonster(static_cast<int>(floor.monsters.size()) - 1);
+                }
+            }
+            keepValue(game->player.hp);
+        });
+    }
+
+    // チャンク分割したフロアのウィンドウを1チャンクずつ往復させる (1回 = 5チャンクの生成と20チャンクの写し)
+    static BenchResult placeWindow(int monsters, double min_seconds) {
+        std::unique_ptr<MazeGame> game(new MazeGame(CHUNKED_DEFAULT_SIZE, CHUNKED_DEFAULT_SIZE, NUM_FLOORS, BENCH_SEED,
+                                                    0, monsters, CHASE_RADIUS));
+        game->setChunkedFloors(true);
+        game->setEventSink(nullptr);
+        game->enterFloor(1);
+        MazeFloor& floor = game->currentFloorData();
+        const int window_size = CHUNK_SIZE * CHUNK_WINDOW;
+        return measure("placeWindow", window_size, window_size, monsters, min_seconds, [&](uint64_t n) {
+            for (uint64_t i = 0; i < n; ++i) {
+                int center = (10 + static_cast<int>(i & 1)) * CHUNK_SIZE + 1;
+                game->placeWindow(floor, 1, center, center);
+            }
+            keepValue(floor.grid().data()[window_size + 1]);
+        });
+    }
+
+    // 160x50 の画面を想定し、プレイヤーを往復させながら差分描画する (書き出しはしない)
+    static BenchResult displayMaze(int size, int monsters, double min_seconds) {
+        std::unique_ptr<MazeGame> game = makeGame(size, monsters);
+        game->renderer.setScreenSize(160, 50);
+        game->renderer.setOutputEnabled(false);
+        int other_x, other_y;
+        openNeighbor(*game, other_x, other_y);
+        size_t bytes = 0;
+        return measure("displayMaze", size, size, monsters, min_seconds, [&](uint64_t n) {
+            MazeFloor& floor = game->currentFloorData();
+            for (uint64_t i = 0; i < n; ++i) {
+                bool away = (i & 1) != 0;
+                game->resetPlayerPosition(floor);
+                game->playerX = away ? other_x : 1;
+                game->playerY = away ? other_y : 1;
+                game->markPlayer();
+                game->displayMaze();
+                bytes += game->renderer.lastFrameBytes();
+            }
+            keepValue(bytes);
+        });
+    }
+
+    // プレイヤーが迷路をランダムに歩いたときの視界の更新 (1回 = 1歩。壁にぶつかった手は道から外してある)
+    static BenchResult fieldOfView(int size, int radius, double min_seconds) {
+        std::unique_ptr<MazeGame> game = makeGame(size, 0);
+        const WallBitmap& walls = game->currentFloorData().walls();
+        std::vector<FieldOfView::Cell> path;
+        RngStream rng(BENCH_SEED);
+        int x = 1, y = 1;
+        while (path.size() < 4096) {
+            int direction = static_cast<int>(rng.next() % 4);
+            int next_x = x + STEP_DX[direction], next_y = y + STEP_DY[direction];
+            if (!walls.test(next_x, next_y)) {
+                x = next_x;
+                y = next_y;
+                path.push_back({ x, y });
+            }
+        }
+        FieldOfView view;
+        size_t visible = 0;
+        std::string name = "FieldOfView::update/r" + std::to_string(radius);
+        return measure(name.c_str(), size, size, 0, min_seconds, [&](uint64_t n) {
+            for (uint64_t i = 0; i < n; ++i) {
+                const FieldOfView::Cell& cell = path[i % path.size()];
+                view.update(walls, cell.x, cell.y, radius);
+                visible += view.revealed().size();
+            }
+            keepValue(visible);
+        });
+    }
+
+    // スナップショットに戻して1キー進め、進んだ局面のスナップショットを取る (自動プレイの探索の1手分)
+    // 毎回同じ局面から同じ1歩を進めるので、書き換えるのはフロアのプレイヤーの周りだけ
+    static BenchResult snapshotStep(int size, int monsters, double min_seconds) {
+        std::unique_ptr<MazeGame> game = makeGame(size, monsters);
+        int other_x, other_y;
+        openNeighbor(*game, other_x, other_y);
+        const char forward = other_x == 2 ? 'd' : 's';
+        const MazeGame::Snapshot root = game->snapshot();
+        std::string error;
+        return measure("snapshotStep", size, size, monsters, min_seconds, [&](uint64_t n) {
+            for (uint64_t i = 0; i < n; ++i) {
+                game->restoreSnapshot(root, error);
+                game->stepKey(forward);
+                MazeGame::Snapshot child = game->snapshot();
+                keepValue(child.tick_count);
+            }
+        });
+    }
+
+    // floors 階をすべて読み込んだワールドティック (1回 = 全フロアのモンスターが1歩ずつ動き、階段を使った分を届ける)
+    // threads はワールドティックのスレッド数 (0 なら呼び出し元だけ)。フロアの数はプレイヤーのいる1階を含む
+    static BenchResult worldTick(int floors, int monsters, unsigned threads, double min_seconds) {
+        const int size = 101;
+        MazeGame game(size, size, floors, BENCH_SEED, threads, monsters, CHASE_RADIUS);
+        game.setEventSink(nullptr);
+        game.setWorldTick(floors);
+        game.enterFloor(1);
+        std::string name = "worldTick/f" + std::to_string(floors) + "/t" + std::to_string(threads);
+        return measure(name.c_str(), size, size, floors * monsters, min_seconds, [&](uint64_t n) {
+            for (uint64_t i = 0; i < n; ++i) {
+                game.tickWorld();
+            }
+            keepValue(game.floors.size());
+        });
+    }
+};
+
+}
+
+namespace rpg {
+
+// プレイヤーが N 体のモンスターに順に攻撃する (イベントは NullEventSink に捨てる)
+BenchResult benchAttack(int monsters, double min_seconds) {
+    Player player("勇者", 100, 15, 5, 30);
+    player.set_rng(RngStream(BENCH_SEED));
+    std::vector<Monster> targets;
+    for (int i = 0; i < monsters; ++i) {
+        targets.emplace_back("スライム", 1 << 30, 8, i % 4);
+    }
+    NullEventSink sink;
+    return measure("Character::attack", 0, 0, monsters, min_seconds, [&](uint64_t n) {
+        size_t index = 0;
+        for (uint64_t i = 0; i < n; ++i) {
+            player.attack(&targets[index], sink);
+            if (++index == targets.size()) {
+                index = 0;
+            }
+        }
+        keepValue(targets[0].get_hp());
+    });
+}
+
+}
+
+namespace rpg {
+
+// 同じ人数のパーティと大群の1ラウンド (両陣営の斉射と compact) を繰り返す
+// HP を十分に大きくして誰も倒れないようにし、斉射の計算そのものを測る
+BenchResult benchMassBattle(int units, CombatKernel kernel, double min_seconds) {
+    CombatUnits party, horde;
+    RngStream stats(BENCH_SEED);
+    for (int i = 0; i < units; ++i) {
+        party.add(NAME_HERO, 1 << 30, stats.range(20, 60), stats.range(5, 15));
+        horde.add(NAME_GOBLIN, 1 << 30, stats.range(15, 30), stats.range(0, 10));
+    }
+    MassBattle battle(party, horde, RngStream(BENCH_SEED, 1), RngStream(BENCH_SEED, 2), kernel);
+    std::string name = std::string("MassBattle::round/") + combatKernelName(battle.kernel());
+    return measure(name.c_str(), 0, 0, units, min_seconds, [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; ++i) {
+            battle.round();
+        }
+        keepValue(party.hp()[0]);
+    });
+}
+
+}
+
+// 結果を JSON で書き出す
+void writeJson(FILE* out, const std::vector<BenchResult>& results, double min_seconds) {
+    std::fprintf(out, "{\n");
+    std::fprintf(out, "  \"seed\": %llu,\n", static_cast<unsigned long long>(BENCH_SEED));
+    std::fprintf(out, "  \"min_time\": %.3f,\n", min_seconds);
+#ifdef __VERSION__
+    std::fprintf(out, "  \"compiler\": \"%s\",\n", __VERSION__);
+#endif
+    std::fprintf(out, "  \"results\": [\n");
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult& r = results[i];
+        double ns = r.seconds * 1e9 / r.iterations;
+        std::fprintf(out,
+                     "    {\"name\": \"%s\", \"width\": %d, \"height\": %d, \"monsters\": %d, "
+                     "\"iterations\": %llu, \"ns_per_op\": %.2f, \"ops_per_sec\": %.1f}%s\n",
+                     r.name.c_str(), r.width, r.height, r.monsters, static_cast<unsigned long long>(r.iterations),
+                     ns, ns > 0 ? 1e9 / ns : 0.0, i + 1 < results.size() ? "," : "");
+    }
+    std::fprintf(out, "  ]\n}\n");
+}
+
+int main(int argc, char* argv[]) {
+    double min_seconds = 0.2;
+    std::string filter;
+    const char* json_path = nullptr;
+    bool quick = false;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--min-time" && i + 1 < argc) {
+            min_seconds = std::atof(argv[++i]);
+        }
+        else if (arg == "--filter" && i + 1 < argc) {
+            filter = argv[++i];
+        }
+        else if (arg == "--json" && i + 1 < argc) {
+            json_path = argv[++i];
+        }
+        else if (arg == "--quick") {
+            quick = true;
+        }
+    }
+
+    // 迷路の一辺とモンスター数の組み合わせ (通路のセル数に対して多すぎる組み合わせは除く)
+    std::vector<int> sizes = quick ? std::vector<int>{ 21, 101 } : std::vector<int>{ 21, 101, 501, 1001 };
+    std::vector<int> monster_counts = quick ? std::vector<int>{ 5, 50 } : std::vector<int>{ 5, 50, 500, 5000 };
+    auto fits = [](int size, int monsters) { return monsters <= size * size / 8; };
+    auto selected = [&filter](const char* name) { return filter.empty() || std::strstr(name, filter.c_str()); };
+
+    std::vector<BenchResult> results;
+    auto report = [&results](const BenchResult& r) {
+        double ns = r.seconds * 1e9 / r.iterations;
+        std::fprintf(stderr, "%-20s %5dx%-5d モンスター %5d  %14.1f ns/回  %14.1f 回/秒\n", r.name.c_str(), r.width,
+                     r.height, r.monsters, ns, 1e9 / ns);
+        results.push_back(r);
+    };
+
+    if (selected("generateMazeFloor")) {
+        for (int size : sizes) {
+            for (int monsters : monster_counts) {
+                if (fits(size, monsters)) {
+                    report(maze::MazeGameBench::generateMazeFloor(size, monsters, min_seconds));
+                }
+            }
+        }
+    }
+    if (selected("dfs")) {
+        for (int size : sizes) {
+            report(maze::MazeGameBench::dfs(size, min_seconds));
+        }
+    }
+    if (selected("eller")) {
+        for (int size : sizes) {
+            report(maze::MazeGameBench::eller(size, min_seconds));
+        }
+    }
+    if (selected("BattleOdds")) {
+        for (int size : sizes) {
+            report(maze::MazeGameBench::battleOddsTable(size, min_seconds));
+        }
+        report(maze::MazeGameBench::battleOddsLookup(min_seconds));
+    }
+    if (selected("formatMazeEvent")) {
+        report(maze::MazeGameBench::formatMazeEvent(min_seconds));
+    }
+    if (selected("moveMonsters")) {
+        for (int size : sizes) {
+            for (int monsters : monster_counts) {
+                if (fits(size, monsters)) {
+                    report(maze::MazeGameBench::moveMonsters(size, monsters, min_seconds));
+                }
+            }
+        }
+    }
+    if (selected("turn")) {
+        for (int monsters : monster_counts) {
+            if (fits(maze::MAZE_WIDTH, monsters)) {
+                report(maze::MazeGameBench::turn<maze::MazeGame>("turn", monsters, min_seconds));
+                report(maze::MazeGameBench::turn<maze::DefaultMazeGame>("turnFixed", monsters, min_seconds));
+            }
+        }
+    }
+    if (selected("placeMonsters")) {
+        for (int size : sizes) {
+            report(maze::MazeGameBench::fillFloor(size, min_seconds));
+        }
+    }
+    if (selected("startBattle")) {
+        report(maze::MazeGameBench::startBattle(min_seconds));
+    }
+    if (selected("placeWindow")) {
+        for (int monsters : monster_counts) {
+            if (fits(maze::CHUNK_SIZE, monsters)) {
+                report(maze::MazeGameBench::placeWindow(monsters, min_seconds));
+            }
+        }
+    }
+    if (selected("displayMaze")) {
+        for (int size : sizes) {
+            for (int monsters : monster_counts) {
+                if (fits(size, monsters)) {
+                    report(maze::MazeGameBench::displayMaze(size, monsters, min_seconds));
+                }
+            }
+        }
+    }
+    if (selected("FieldOfView")) {
+        for (int size : sizes) {
+            for (int radius : { 8, 16 }) {
+                report(maze::MazeGameBench::fieldOfView(size, radius, min_seconds));
+            }
+        }
+    }
+    if (selected("snapshotStep")) {
+        for (int size : sizes) {
+            report(maze::MazeGameBench::snapshotStep(size, 5, min_seconds));
+        }
+    }
+    if (selected("worldTick")) {
+        // スレッド数ごとの1ティックの時間 (t0 は呼び出し元だけで順に進める)
+        unsigned hardware = std::max(1u, std::thread::hardware_concurrency());
+        for (int floors : quick ? std::vector<int>{ 128 } : std::vector<int>{ 16, 128 }) {
+            for (unsigned threads = 0; threads < hardware; threads = threads ? threads * 2 : 1) {
+                report(maze::MazeGameBench::worldTick(floors, 50, threads, min_seconds));
+            }
+        }
+    }
+    if (selected("Character::attack")) {
+        for (int monsters : monster_counts) {
+            report(rpg::benchAttack(monsters, min_seconds));
+        }
+    }
+    if (selected("MassBattle")) {
+        for (int units : monster_counts) {
+            report(rpg::benchMassBattle(units, CombatKernel::Scalar, min_seconds));
+            if (combatAvx2Available()) {
+                report(rpg::benchMassBattle(units, CombatKernel::Avx2, min_seconds));
+            }
+        }
+    }
+
+    if (json_path) {
+        bool to_stdout = std::strcmp(json_path, "-") == 0;
+        FILE* out = to_stdout ? stdout : std::fopen(json_path, "w");
+        if (!out) {
+            std::fprintf(stderr, "JSON ファイルを開けません: %s\n", json_path);
+            return 1;
+        }
+        writeJson(out, results, min_seconds);
+        if (!to_stdout) {
+            std::fclose(out);
+        }
+    }
+    return 0;
+}
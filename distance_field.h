@@ -0,0 +1,246 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#include "maze_grid.h"
+#include "paged_array.h"
+
+// --------------------------------------------------
+// 距離場 (DistanceField)
+// 1つの起点 (プレイヤー) から各セルまでの最短歩数を、グリッドと同じ並びの
+// 平らな配列で持つ。モンスターは隣のセルの値を比べるだけで追跡できる
+//
+// 上限距離 (limit) を指定した場合は、起点から limit 歩以内だけを幅優先探索する
+// 各セルに世代番号を一緒に格納するので、作り直しのたびに配列を消去する必要はない
+//
+// 上限なし (limit == 0) の場合は全体を持ち、起点が隣のセルへ1歩動いたときは
+// 作り直さずに差分だけ更新する:
+//   4近傍のグリッドは二部グラフなので、全セルの距離はちょうど ±1 変わる
+//   近づいたセル (-1) は「新しい起点から旧距離が1ずつ増える」経路で
+//   たどれる集合だけなので、そこだけを書き換え、残り (+1) は全体のオフセットで表す
+//
+// 壁 (walls) は固定サイズ・実行時サイズのどちらの壁ビットマップでも受け取る
+// 距離の配列はページ単位の copy-on-write (PagedArray) なので、フロアごと複製しても
+// 配列は写さず、その後の更新で書き換えたページだけが複製される
+// --------------------------------------------------
+class DistanceField {
+public:
+    static constexpr uint32_t kUnreachable = UINT32_MAX;
+
+    DistanceField()
+        : fieldWidth(0), fieldHeight(0), limit(0), offset(0), generation(0), sourceX(-1), sourceY(-1) {}
+
+    bool valid() const { return sourceX >= 0; }
+    int originX() const { return sourceX; }
+    int originY() const { return sourceY; }
+
+    // (x, y) から起点までの歩数 (壁・到達できないセル・上限より遠いセルは kUnreachable)
+    uint32_t distance(int x, int y) const {
+        size_t i = index(x, y);
+        if (limit > 0) {
+            uint32_t packed = stamped[i];
+            return (packed >> 16) == generation ? (packed & 0xFFFF) : kUnreachable;
+        }
+        int32_t stored = cells[i];
+        return stored == kWall ? kUnreachable : static_cast<uint32_t>(stored + offset);
+    }
+
+    // 起点を (x, y) に合わせる (max_distance == 0 なら上限なし)
+    // 起点・壁・上限が前回と同じなら何もしない
+    template <class Walls>
+    void track(const Walls& walls, int x, int y, int max_distance = 0) {
+        if (max_distance > 0xFFFE) {
+            max_distance = 0xFFFE;
+        }
+        bool same_shape = valid() && walls.width() == fieldWidth && walls.height() == fieldHeight
+            && max_distance == limit;
+        if (same_shape && x == sourceX && y == sourceY) {
+            return;
+        }
+
+        if (max_distance > 0) {
+            rebuildLimited(walls, x, y, max_distance);
+        }
+        else if (same_shape && std::abs(x - sourceX) + std::abs(y - sourceY) == 1 && offset < kMaxOffset) {
+            shiftSource(walls, x, y);
+        }
+        else {
+            rebuild(walls, x, y);
+        }
+    }
+
+    // 上限なしで全体を作り直す (O(セル数))
+    template <class Walls>
+    void rebuild(const Walls& walls, int x, int y) {
+        resize(walls);
+        limit = 0;
+        offset = 0;
+        sourceX = x;
+        sourceY = y;
+
+        cells.assign(static_cast<size_t>(fieldWidth) * fieldHeight, kWall);
+        queue.clear();
+
+        cells.write(index(x, y)) = 0;
+        queue.push_back(static_cast<uint32_t>(index(x, y)));
+
+        for (size_t head = 0; head < queue.size(); ++head) {
+            uint32_t cell = queue[head];
+            int cx = static_cast<int>(cell % fieldWidth);
+            int cy = static_cast<int>(cell / fieldWidth);
+            int32_t next = cells[cell] + 1;
+
+            for (int dir = 0; dir < 4; ++dir) {
+                int nx = cx + kStepX[dir];
+                int ny = cy + kStepY[dir];
+                if (!inside(nx, ny) || walls.test(nx, ny)) {
+                    continue;
+                }
+                size_t n = index(nx, ny);
+                if (cells[n] == kWall) {
+                    cells.write(n) = next;
+                    queue.push_back(static_cast<uint32_t>(n));
+                }
+            }
+        }
+        queue.clear();
+    }
+
+    // 使用メモリ (バイト)
+    size_t memoryBytes() const {
+        return cells.memoryBytes() + stamped.memoryBytes() + queue.capacity() * sizeof(uint32_t);
+    }
+
+private:
+    // 上限なしのとき、未到達・壁を表す格納値 (到達済みのセルには現れない)
+    static constexpr int32_t kWall = INT32_MIN;
+    // オフセットがこれを超えたら作り直して値を正規化する
+    static constexpr int32_t kMaxOffset = 1 << 30;
+
+    static constexpr int kStepX[4] = { 0, 0, -1, 1 };
+    static constexpr int kStepY[4] = { -1, 1, 0, 0 };
+
+    int fieldWidth, fieldHeight;
+    int limit;
+    // 上限なし: 実際の距離 = cells[i] + offset
+    PagedArray<int32_t> cells;
+    int32_t offset;
+    // 上限あり: 上位16ビットが世代番号、下位16ビットが距離
+    PagedArray<uint32_t> stamped;
+    uint32_t generation;
+    int sourceX, sourceY;
+    // 幅優先探索の作業領域 (探索の後は空にしておき、複製に中身を持ち込まない)
+    std::vector<uint32_t> queue;
+
+    size_t index(int x, int y) const {
+        return static_cast<size_t>(y) * fieldWidth + x;
+    }
+
+    bool inside(int x, int y) const {
+        return x >= 0 && x < fieldWidth && y >= 0 && y < fieldHeight;
+    }
+
+    // サイズが変わったら両方の配列を捨てる
+    template <class Walls>
+    void resize(const Walls& walls) {
+        if (walls.width() != fieldWidth || walls.height() != fieldHeight) {
+            fieldWidth = walls.width();
+            fieldHeight = walls.height();
+            cells.clear();
+            stamped.clear();
+        }
+    }
+
+    // 起点から max_distance 歩以内だけを幅優先探索する (O(範囲内のセル数))
+    template <class Walls>
+    void rebuildLimited(const Walls& walls, int x, int y, int max_distance) {
+        resize(walls);
+        if (limit == 0) {
+            cells.clear();
+        }
+        limit = max_distance;
+        sourceX = x;
+        sourceY = y;
+
+        size_t count = static_cast<size_t>(fieldWidth) * fieldHeight;
+        generation = (generation + 1) & 0xFFFF;
+        if (stamped.size() != count || generation == 0) {
+            // 世代番号が一周したら古い値と区別できないので消去する
+            stamped.assign(count, 0);
+            generation = 1;
+        }
+        const uint32_t tag = generation << 16;
+
+        queue.clear();
+        stamped.write(index(x, y)) = tag;
+        queue.push_back(static_cast<uint32_t>(index(x, y)));
+
+        for (size_t head = 0; head < queue.size(); ++head) {
+            uint32_t cell = queue[head];
+            uint32_t next = (stamped[cell] & 0xFFFF) + 1;
+            if (next > static_cast<uint32_t>(limit)) {
+                continue;
+            }
+            int cx = static_cast<int>(cell % fieldWidth);
+            int cy = static_cast<int>(cell / fieldWidth);
+
+            for (int dir = 0; dir < 4; ++dir) {
+                int nx = cx + kStepX[dir];
+                int ny = cy + kStepY[dir];
+                if (!inside(nx, ny) || walls.test(nx, ny)) {
+                    continue;
+                }
+                size_t n = index(nx, ny);
+                if ((stamped[n] >> 16) != generation) {
+                    stamped.write(n) = tag | next;
+                    queue.push_back(static_cast<uint32_t>(n));
+                }
+            }
+        }
+        queue.clear();
+    }
+
+    // 起点を隣のセル (x, y) へ移す差分更新 (O(近づいたセル数))
+    template <class Walls>
+    void shiftSource(const Walls& walls, int x, int y) {
+        if (cells[index(x, y)] == kWall) {
+            rebuild(walls, x, y);
+            return;
+        }
+
+        // 全セルをまとめて +1 したことにする
+        ++offset;
+        sourceX = x;
+        sourceY = y;
+
+        // 新しい起点から、旧距離が1ずつ増える方向へたどったセルだけが -1 になる
+        // (オフセットの +1 と合わせて格納値は -2)。書き換えたセルは旧値の条件を
+        // 満たさなくなるので、訪問済みの印は要らない
+        queue.clear();
+        queue.push_back(static_cast<uint32_t>(index(x, y)));
+        cells.write(index(x, y)) -= 2;
+
+        for (size_t head = 0; head < queue.size(); ++head) {
+            uint32_t cell = queue[head];
+            int cx = static_cast<int>(cell % fieldWidth);
+            int cy = static_cast<int>(cell / fieldWidth);
+            int32_t old_next = cells[cell] + 2 + 1;
+
+            for (int dir = 0; dir < 4; ++dir) {
+                int nx = cx + kStepX[dir];
+                int ny = cy + kStepY[dir];
+                if (!inside(nx, ny)) {
+                    continue;
+                }
+                size_t n = index(nx, ny);
+                if (cells[n] == old_next) {
+                    cells.write(n) -= 2;
+                    queue.push_back(static_cast<uint32_t>(n));
+                }
+            }
+        }
+        queue.clear();
+    }
+};
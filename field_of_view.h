@@ -0,0 +1,326 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#include "maze_grid.h"
+
+// --------------------------------------------------
+// 視界 (FieldOfView)
+// 起点 (プレイヤー) から半径 radius 以内で視線の通るセルを再帰的シャドウキャスティングで求め、
+// 一度でも見たセル (explored) をフロアと同じ大きさのビットマップで覚えておく
+//
+// 見えるセルはすべて起点の周り (2 * radius + 1) 四方の窓に収まるので、壁も「今見えている」印も
+// その窓に1行 = 64 ビット語1つで写して扱い、フロア全体には触らない (1回の更新は O(radius^2))
+// 8つの八分円を中心から外へ1行ずつ走査し、壁に遮られた傾きの範囲を再帰で外していく
+//
+// 起点・半径が前回と同じなら計算し直さない (フロアの壁は生成した後は変わらず、チャンクのウィンドウが動いたときは shift で作り直す)
+// 更新ごとに前回の窓と行ごとに比べて「新しく見えたセル」と「見えなくなったセル」の差分を返すので、
+// 表示する側は変わったセルだけを扱えばよい。差分が続いているかは lineage() と version() で確かめる
+// 探索済みの記憶は copy-on-write のビットマップなので、視界ごと複製しても書き換えたページだけが複製される
+// --------------------------------------------------
+class FieldOfView {
+public:
+    // 窓の1行を 64 ビット語1つに詰めるので、半径はここまで
+    static constexpr int kMaxRadius = 31;
+
+    // セルの座標 (差分に使う)
+    struct Cell {
+        int x, y;
+    };
+
+    FieldOfView() : stale(true), viewLineage(nextLineage()), viewVersion(0) {}
+
+    bool valid() const { return current.valid; }
+    int radius() const { return current.radius; }
+
+    // (x, y) が今見えているか / 一度でも見えたか (範囲の外は false)
+    bool visible(int x, int y) const {
+        int lx = x - current.left;
+        return current.valid && lx >= 0 && lx < current.span() && ((current.row(y) >> lx) & 1) != 0;
+    }
+
+    bool explored(int x, int y) const {
+        return inside(x, y) && exploredCells.test(x, y);
+    }
+
+    // 差分の系列の番号と、その中で計算し直した回数
+    // 探索済みの記憶や座標系を差分なしに入れ替えたら lineage が変わる。同じ lineage で version が1つ進んだなら、
+    // その間の変化は revealed() と hidden() ですべてわかる (複製した視界は同じ系列を引き継ぐ)
+    uint64_t lineage() const { return viewLineage; }
+    uint64_t version() const { return viewVersion; }
+
+    // 起点を (x, y) に合わせて見えるセルを求め直す (計算し直したら true)
+    // 半径は kMaxRadius までに切り詰める
+    // 壁のビットマップの大きさが変わっていたら、探索済みの記憶ごと作り直す
+    template <class Walls>
+    bool update(const Walls& walls, int x, int y, int max_distance) {
+        if (walls.width() != exploredCells.width() || walls.height() != exploredCells.height()) {
+            exploredCells.reset(walls.width(), walls.height());
+            current.valid = false;
+            stale = true;
+            viewLineage = nextLineage();
+        }
+        max_distance = std::max(0, std::min(max_distance, kMaxRadius));
+        if (!stale && current.valid && x == current.left + current.radius && y == current.top + current.radius
+            && max_distance == current.radius) {
+            return false;
+        }
+        revealedCells.clear();
+        hiddenCells.clear();
+        ++viewVersion;
+
+        std::swap(previous, current);
+        current.place(x, y, max_distance);
+        stale = false;
+        loadWalls(walls);
+        current.rows[current.radius] |= uint64_t(1) << current.radius;
+        for (int octant = 0; octant < 8; ++octant) {
+            castLight(1, 1.0f, 0.0f, octant);
+        }
+
+        // フロアの外に付いた印を落とし、印のある行の範囲を求める
+        current.first_row = current.span();
+        current.last_row = -1;
+        for (int ly = 0; ly < current.span(); ++ly) {
+            int world_y = current.top + ly;
+            current.rows[ly] &= world_y >= 0 && world_y < walls.height() ? floorColumns : 0;
+            if (current.rows[ly] != 0) {
+                current.first_row = std::min(current.first_row, ly);
+                current.last_row = ly;
+            }
+        }
+        // 前回の窓と印のある行どうしを比べる (どちらかにしかないセルが差分)
+        for (int ly = current.first_row; ly <= current.last_row; ++ly) {
+            int world_y = current.top + ly;
+            uint64_t added = current.rows[ly] & ~previous.rowAt(world_y, current.left, current.span());
+            for (; added != 0; added &= added - 1) {
+                Cell cell = { current.left + lowestBit(added), world_y };
+                exploredCells.set(cell.x, cell.y);
+                revealedCells.push_back(cell);
+            }
+        }
+        if (previous.valid) {
+            for (int ly = previous.first_row; ly <= previous.last_row; ++ly) {
+                int world_y = previous.top + ly;
+                uint64_t removed = previous.rows[ly] & ~current.rowAt(world_y, previous.left, previous.span());
+                for (; removed != 0; removed &= removed - 1) {
+                    hiddenCells.push_back({ previous.left + lowestBit(removed), world_y });
+                }
+            }
+        }
+        return true;
+    }
+
+    // 座標系を (shift_x, shift_y) だけずらす (チャンク分割したフロアのウィンドウが動いたとき)
+    // 新しい座標 = 古い座標 - shift。重なる範囲の探索済みの記憶だけを残し、見えているセルは次の update で求める
+    void shift(int shift_x, int shift_y) {
+        PagedCellBitmap moved;
+        moved.reset(exploredCells.width(), exploredCells.height());
+        for (int y = 0; y < moved.height(); ++y) {
+            int old_y = y + shift_y;
+            if (old_y < 0 || old_y >= moved.height()) {
+                continue;
+            }
+            for (int x = 0; x < moved.width(); ++x) {
+                int old_x = x + shift_x;
+                if (old_x >= 0 && old_x < moved.width() && exploredCells.test(old_x, old_y)) {
+                    moved.set(x, y);
+                }
+            }
+        }
+        exploredCells = std::move(moved);
+        current.valid = false;
+        stale = true;
+        viewLineage = nextLineage();
+    }
+
+    // 直前に計算し直した update で新しく見えたセル / 見えなくなったセル
+    const std::vector<Cell>& revealed() const { return revealedCells; }
+    const std::vector<Cell>& hidden() const { return hiddenCells; }
+
+    // 探索済みの記憶 (フロアを追い出すときに残し、作り直したときに戻す)
+    std::vector<uint64_t> exploredWords() const {
+        std::vector<uint64_t> words(exploredCells.wordCount());
+        for (size_t i = 0; i < words.size(); ++i) {
+            words[i] = exploredCells.word(i);
+        }
+        return words;
+    }
+
+    void restoreExplored(int width, int height, const std::vector<uint64_t>& words) {
+        if (words.size() != (static_cast<size_t>(width) * height + 63) / 64) {
+            return;
+        }
+        exploredCells.assignWords(width, height, words.data());
+        current.valid = false;
+        stale = true;
+        viewLineage = nextLineage();
+    }
+
+    // 使用メモリ (バイト)
+    size_t memoryBytes() const {
+        return exploredCells.memoryBytes()
+            + (current.rows.capacity() + previous.rows.capacity() + wallRows.capacity()) * sizeof(uint64_t)
+            + (revealedCells.capacity() + hiddenCells.capacity()) * sizeof(Cell);
+    }
+
+private:
+    // 起点の周り span 四方の窓と、そこで見えているセルの印 (行ごとのビット列。ビット i は列 left + i)
+    struct Window {
+        bool valid = false;
+        int radius = 0;
+        int left = 0, top = 0;
+        int first_row = 0, last_row = -1;  // 印のある行の範囲
+        std::vector<uint64_t> rows;
+
+        int span() const { return 2 * radius + 1; }
+
+        void place(int x, int y, int view_radius) {
+            valid = true;
+            radius = view_radius;
+            left = x - radius;
+            top = y - radius;
+            rows.assign(static_cast<size_t>(span()), 0);
+        }
+
+        // フロアの行 y の印 (窓の外は0)
+        uint64_t row(int y) const {
+            int ly = y - top;
+            return ly >= 0 && ly < span() ? rows[ly] : 0;
+        }
+
+        // フロアの行 y の列 x0 から width 個分の印を、ビット0 が x0 になるように並べ直す
+        uint64_t rowAt(int y, int x0, int width) const {
+            if (!valid) {
+                return 0;
+            }
+            uint64_t bits = row(y);
+            int offset = x0 - left;
+            if (offset >= 64 || offset <= -64) {
+                return 0;
+            }
+            bits = offset >= 0 ? bits >> offset : bits << -offset;
+            return bits & ((uint64_t(1) << width) - 1);
+        }
+    };
+
+    // 八分円ごとの変換 (走査の座標 (col, row) -> 起点からのずれ (col * xx + row * xy, col * yx + row * yy))
+    static constexpr int kOctants[8][4] = {
+        { 1, 0, 0, 1 }, { 0, 1, 1, 0 }, { 0, -1, 1, 0 }, { -1, 0, 0, 1 },
+        { -1, 0, 0, -1 }, { 0, -1, -1, 0 }, { 0, 1, -1, 0 }, { 1, 0, 0, -1 },
+    };
+
+    bool stale;
+    uint64_t viewLineage;
+    uint64_t viewVersion;
+    PagedCellBitmap exploredCells;
+    Window current;
+    Window previous;
+    std::vector<uint64_t> wallRows;  // current と同じ窓の壁 (フロアの外も壁)
+    uint64_t floorColumns = 0;       // 窓の列のうちフロアの中にあるもの
+    std::vector<Cell> revealedCells;
+    std::vector<Cell> hiddenCells;
+
+    bool inside(int x, int y) const {
+        return x >= 0 && x < exploredCells.width() && y >= 0 && y < exploredCells.height();
+    }
+
+    // プロセスの中で重ならない系列の番号 (別々のフロアの視界を取り違えないように)
+    static uint64_t nextLineage() {
+        static std::atomic<uint64_t> counter(0);
+        return counter.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+    static int lowestBit(uint64_t bits) {
+        return __builtin_ctzll(bits);
+    }
+
+    // 壁のビットマップから current の窓を写す (フロアの行は 64 ビット語から直接切り出す)
+    template <class Walls>
+    void loadWalls(const Walls& walls) {
+        const int span = current.span();
+        const uint64_t full = (uint64_t(1) << span) - 1;
+        const int x0 = std::max(current.left, 0);
+        const int x1 = std::min(current.left + span, walls.width());
+        const uint64_t* words = walls.words();
+        const size_t word_count = walls.wordCount();
+        wallRows.resize(static_cast<size_t>(span));
+        floorColumns = x0 < x1 ? ((uint64_t(1) << (x1 - x0)) - 1) << (x0 - current.left) : 0;
+        for (int ly = 0; ly < span; ++ly) {
+            int y = current.top + ly;
+            if (y < 0 || y >= walls.height() || x0 >= x1) {
+                wallRows[ly] = full;
+                continue;
+            }
+            size_t bit = static_cast<size_t>(y) * walls.width() + x0;
+            size_t word = bit >> 6;
+            int offset = static_cast<int>(bit & 63);
+            uint64_t bits = words[word] >> offset;
+            if (offset != 0 && word + 1 < word_count) {
+                bits |= words[word + 1] << (64 - offset);
+            }
+            wallRows[ly] = (full & ~floorColumns) | ((bits << (x0 - current.left)) & floorColumns);
+        }
+    }
+
+    // 八分円 octant の row 行目から外へ、傾き start から end までの範囲を照らす
+    // (傾きは行に対する列のずれ。壁に当たったら、その手前までの範囲を再帰で先に照らす)
+    // セルの傾きの比較は割り算をせず、分母 (行 ± 0.5) を掛けて行う。傾きそのものは壁の境目でだけ求める
+    void castLight(int row, float start, float end, int octant) {
+        if (start < end) {
+            return;
+        }
+        const int radius = current.radius;
+        const int xx = kOctants[octant][0], xy = kOctants[octant][1];
+        const int yx = kOctants[octant][2], yy = kOctants[octant][3];
+        const int radius_squared = radius * radius + radius;
+        float next_start = start;
+
+        for (int distance = row; distance <= radius; ++distance) {
+            const float near_edge = distance - 0.5f;
+            const float far_edge = distance + 0.5f;
+            // 右端の傾き (col - 0.5) / far_edge が start 以下になる最大の列から始める
+            int col = std::min(distance, static_cast<int>(start * far_edge + 0.5f));
+            bool blocked = false;
+            for (; col >= 0; --col) {
+                if (col - 0.5f > start * far_edge) {
+                    continue;
+                }
+                // 左端の傾き (col + 0.5) / near_edge が end より小さければ、この行の残りは範囲の外
+                if (col + 0.5f < end * near_edge) {
+                    break;
+                }
+
+                int lx = radius + col * xx + distance * xy;
+                int ly = radius + col * yx + distance * yy;
+                if (col * col + distance * distance <= radius_squared) {
+                    current.rows[ly] |= uint64_t(1) << lx;
+                }
+
+                bool wall = ((wallRows[ly] >> lx) & 1) != 0;
+                if (blocked) {
+                    if (wall) {
+                        next_start = (col - 0.5f) / far_edge;
+                    }
+                    else {
+                        blocked = false;
+                        start = next_start;
+                    }
+                }
+                else if (wall && distance < radius) {
+                    blocked = true;
+                    castLight(distance + 1, start, (col + 0.5f) / near_edge, octant);
+                    next_start = (col - 0.5f) / far_edge;
+                }
+            }
+            if (blocked) {
+                break;
+            }
+        }
+    }
+};
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+#include "paged_array.h"
+#include "rng.h"
+
+// --------------------------------------------------
+// 空きセルの集合 (FreeCellSet)
+// 矩形 [left, left + width) x [top, top + height) の中のセルの集合を、セルの並び (cells) と
+// 各セルの並びの中の位置 (slots) の2つの配列で持つ (疎集合)
+// ランダムに1つ選ぶ・取り除く・入れ直すのがどれも O(1) で、取り除くときは末尾と入れ替えて詰める
+//
+// フロアの「モンスターを置ける通路」の索引に使い、階段やモンスターの配置を
+// 当たるまで引き直すのではなく、この集合から直接選ぶ
+// 並びは作り直したときは行優先の順で、その後は入れたり出したりした順で変わる
+// (同じ操作の列からは同じ並びになるので、同じ乱数からは同じセルを選ぶ)
+// 2つの配列はページ単位の copy-on-write (PagedArray) で、複製しても出し入れしたページだけが複製される
+// --------------------------------------------------
+class FreeCellSet {
+public:
+    FreeCellSet() : setLeft(0), setTop(0), setWidth(0), setHeight(0) {}
+
+    // 矩形を (left, top) から width x height にして空にする
+    void reset(int left, int top, int width, int height) {
+        setLeft = left;
+        setTop = top;
+        setWidth = width;
+        setHeight = height;
+        cells.clear();
+        slots.assign(static_cast<size_t>(width) * height, kAbsent);
+    }
+
+    // [x0, x1] x [y0, y1] のうち accept(x, y) が true のセルを行優先の順に入れて作り直す
+    template <class Accept>
+    void build(int x0, int y0, int x1, int y1, Accept accept) {
+        reset(x0, y0, std::max(0, x1 - x0 + 1), std::max(0, y1 - y0 + 1));
+        for (int y = y0; y <= y1; ++y) {
+            for (int x = x0; x <= x1; ++x) {
+                if (accept(x, y)) {
+                    slots.write(slot(x, y)) = static_cast<uint32_t>(cells.size());
+                    cells.push_back(static_cast<uint32_t>(slot(x, y)));
+                }
+            }
+        }
+    }
+
+    bool empty() const { return cells.empty(); }
+    size_t size() const { return cells.size(); }
+
+    // (x, y) が集合に入っているか (矩形の外は false)
+    bool contains(int x, int y) const {
+        return inside(x, y) && slots[slot(x, y)] != kAbsent;
+    }
+
+    // (x, y) を入れる (入っていれば・矩形の外なら何もしない)
+    void insert(int x, int y) {
+        if (!inside(x, y)) {
+            return;
+        }
+        size_t cell = slot(x, y);
+        if (slots[cell] == kAbsent) {
+            slots.write(cell) = static_cast<uint32_t>(cells.size());
+            cells.push_back(static_cast<uint32_t>(cell));
+        }
+    }
+
+    // (x, y) を取り除く (入っていなければ何もしない)
+    void erase(int x, int y) {
+        if (!inside(x, y)) {
+            return;
+        }
+        size_t cell = slot(x, y);
+        uint32_t position = slots[cell];
+        if (position == kAbsent) {
+            return;
+        }
+        uint32_t last = cells.back();
+        cells.write(position) = last;
+        slots.write(last) = position;
+        cells.pop_back();
+        slots.write(cell) = kAbsent;
+    }
+
+    // ランダムに1つ選ぶ (取り除かない。空なら false)
+    bool pick(RngStream& rng, int& x, int& y) const {
+        if (cells.empty()) {
+            return false;
+        }
+        uint32_t cell = cells[rng.below(static_cast<uint32_t>(cells.size()))];
+        x = setLeft + static_cast<int>(cell % setWidth);
+        y = setTop + static_cast<int>(cell / setWidth);
+        return true;
+    }
+
+    // ランダムに1つ選ぶが、(skip_x, skip_y) に当たったら並びの次のセルにする (取り除かない。ほかになければ false)
+    // 乱数は pick と同じく1回だけ使う
+    bool pickExcept(RngStream& rng, int skip_x, int skip_y, int& x, int& y) const {
+        if (cells.empty()) {
+            return false;
+        }
+        uint32_t count = static_cast<uint32_t>(cells.size());
+        uint32_t position = rng.below(count);
+        if (contains(skip_x, skip_y) && cells[position] == slot(skip_x, skip_y)) {
+            if (count == 1) {
+                return false;
+            }
+            position = (position + 1) % count;
+        }
+        uint32_t cell = cells[position];
+        x = setLeft + static_cast<int>(cell % setWidth);
+        y = setTop + static_cast<int>(cell / setWidth);
+        return true;
+    }
+
+    // ランダムに1つ選んで取り除く (空なら false)
+    bool take(RngStream& rng, int& x, int& y) {
+        if (!pick(rng, x, y)) {
+            return false;
+        }
+        erase(x, y);
+        return true;
+    }
+
+    // 使用メモリ (バイト)
+    size_t memoryBytes() const {
+        return cells.memoryBytes() + slots.memoryBytes();
+    }
+
+private:
+    static constexpr uint32_t kAbsent = UINT32_MAX;
+
+    int setLeft, setTop;
+    int setWidth, setHeight;
+    PagedArray<uint32_t> cells;  // 集合のセル (矩形の中の行優先の番号)
+    PagedArray<uint32_t> slots;  // セルの番号 -> cells の中の位置 (入っていなければ kAbsent)
+
+    bool inside(int x, int y) const {
+        return x >= setLeft && x < setLeft + setWidth && y >= setTop && y < setTop + setHeight;
+    }
+
+    size_t slot(int x, int y) const {
+        return static_cast<size_t>(y - setTop) * setWidth + (x - setLeft);
+    }
+};
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "name_table.h"
+
+// --------------------------------------------------
+// ゲームイベント
+// 戦闘や移動のロジックは std::cout に直接書かず、型付きのイベントを
+// EventSink に送る。表示するか、別スレッドに渡すか、捨てるかはシンク次第
+// --------------------------------------------------
+
+enum class GameEventType : uint8_t {
+    BattleStart,    // 戦闘開始 (value = 敵のHP, extra = 敵の攻撃力)
+    Attack,         // 物理攻撃の宣言 (actor)
+    Critical,       // クリティカルヒット (actor)
+    Spell,          // 魔法の詠唱 (actor)
+    SpellFailed,    // MP不足で魔法が使えない (actor)
+    Damage,         // ダメージ (actor = 攻撃側, target = 受けた側, value = ダメージ, extra = 残りHP)
+    Kill,           // 撃破 (actor = 倒した側, target = 倒された側)
+    Drop,           // 武器ドロップ (item = 武器名, value = 攻撃力ボーナス)
+    Equip,          // 装備の変更 (item = 新しい武器名)
+    KeepEquipment,  // 今の装備の方が強い (item = 現在の武器名)
+    FloorChange,    // 階の移動 (value = 移動前の階, extra = 移動後の階)
+    BattleForecast, // 戦闘の見込み (value = 勝率 (0.1% 単位), extra = 失うHPの期待値, flags = 自動で決着させる)
+};
+
+// イベントの付加フラグ
+const uint8_t EVENT_FROM_PLAYER = 1; // プレイヤーが起こしたイベント
+const uint8_t EVENT_AUTO_RESOLVED = 2; // ラウンドを待たずにその場で決着させた戦闘
+
+// イベント本体 (コピーだけで受け渡せるよう、名前は NameTable の番号で持つ)
+// 表の文字列は消えないので、シンクがいつ消費してもよい
+struct GameEvent {
+    GameEventType type;
+    uint8_t flags;
+    int value;
+    int extra;
+    NameId actor;
+    NameId target;
+    NameId item;
+};
+
+inline GameEvent makeEvent(GameEventType type, uint8_t flags = 0, int value = 0, int extra = 0,
+                           NameId actor = NO_NAME, NameId target = NO_NAME, NameId item = NO_NAME) {
+    return GameEvent{ type, flags, value, extra, actor, target, item };
+}
+
+// --------------------------------------------------
+// イベントシンク (EventSink)
+// --------------------------------------------------
+class EventSink {
+public:
+    virtual ~EventSink() = default;
+    virtual void emit(const GameEvent& event) = 0;
+    // 溜めている出力があれば書き出す
+    virtual void flush() {}
+};
+
+// 何もしないシンク
+// final なので、具体的な型で受け取るテンプレートのコードでは呼び出しごと消える
+class NullEventSink final : public EventSink {
+public:
+    void emit(const GameEvent&) override {}
+    void flush() override {}
+};
+
+// テキスト表示シンク
+// ゲームごとの書式関数でメッセージを組み立ててバッファに溜め、flush() でまとめて書き出す
+class TextEventSink final : public EventSink {
+public:
+    using Formatter = void (*)(std::string& out, const GameEvent& event);
+
+    explicit TextEventSink(Formatter formatter, std::ostream& os = std::cout)
+        : format(formatter), stream(&os) {
+        buffer.reserve(4096);
+    }
+
+    ~TextEventSink() override { flush(); }
+
+    void emit(const GameEvent& event) override {
+        format(buffer, event);
+    }
+
+    void flush() override {
+        if (!buffer.empty()) {
+            stream->write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+            stream->flush();
+            buffer.clear();
+        }
+    }
+
+    // 書き出さずにバッファの内容を取り出す (画面の一部に表示する場合など)
+    std::string take() {
+        std::string text;
+        text.swap(buffer);
+        buffer.reserve(4096);
+        return text;
+    }
+
+private:
+    Formatter format;
+    std::ostream* stream;
+    std::string buffer;
+};
+
+// リングバッファシンク
+// 単一の生産者 (ゲームロジック) と単一の消費者 (別スレッド) の間をロックなしでつなぐ
+// 満杯のときはロジックを止めずにイベントを捨て、捨てた数を数える
+class RingBufferEventSink final : public EventSink {
+public:
+    // capacity は2のべき乗に切り上げる
+    explicit RingBufferEventSink(size_t capacity = 4096) {
+        size_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        slots.resize(size);
+        mask = size - 1;
+    }
+
+    void emit(const GameEvent& event) override {
+        size_t tail = writeIndex.load(std::memory_order_relaxed);
+        if (tail - readIndex.load(std::memory_order_acquire) > mask) {
+            droppedCount.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        slots[tail & mask] = event;
+        writeIndex.store(tail + 1, std::memory_order_release);
+    }
+
+    // 消費者側: イベントを1つ取り出す (空なら false)
+    bool pop(GameEvent& event) {
+        size_t head = readIndex.load(std::memory_order_relaxed);
+        if (head == writeIndex.load(std::memory_order_acquire)) {
+            return false;
+        }
+        event = slots[head & mask];
+        readIndex.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    uint64_t dropped() const { return droppedCount.load(std::memory_order_relaxed); }
+
+private:
+    std::vector<GameEvent> slots;
+    size_t mask;
+    // 生産者と消費者が別のキャッシュラインを書くように離して置く
+    alignas(64) std::atomic<size_t> writeIndex{ 0 };
+    alignas(64) std::atomic<size_t> readIndex{ 0 };
+    alignas(64) std::atomic<uint64_t> droppedCount{ 0 };
+};
@@ -3,430 +3,2404 @@
 #include <vector>
 #include <stack>
 #include <cstdlib>
-#include <ctime>
 #include <algorithm>
 #include <random>
 #include <string>
 #include <memory>
 #include <map>
-
-// OSごとのキー入力ライブラリのインクルードと定義
-#ifdef _WIN32
-#include <conio.h>
-#include <windows.h>
-// Windows: 矢印キーのスキャンコード
-#define KEY_UP 72
-#define KEY_DOWN 80
-#define KEY_LEFT 75
-#define KEY_RIGHT 77
-#else
-#include <termios.h>
-#include <unistd.h>
-// POSIX: 矢印キーのエスケープシーケンス
-#define ARROW_UP 'A'
-#define ARROW_DOWN 'B'
-#define ARROW_LEFT 'D'
-#define ARROW_RIGHT 'C'
+#include <set>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <future>
+#include <thread>
+#include <atomic>
+#include <csignal>
+#include <unordered_set>
+
+#ifdef __linux__
+#include <sys/epoll.h>
 #endif
 
-// 迷路のサイズ
+#include "battle_odds.h"
+#include "distance_field.h"
+#include "field_of_view.h"
+#include "free_cell_set.h"
+#include "game_events.h"
+#include "maze_grid.h"
+#include "maze_stream.h"
+#include "message_catalog.h"
+#include "name_table.h"
+#include "net_socket.h"
+#include "replay.h"
+#include "rng.h"
+#include "save_file.h"
+#include "term_input.h"
+#include "term_renderer.h"
+#include "thread_pool.h"
+#include "work_stealing_pool.h"
+
+// 迷路のサイズと階数 (既定値。実行時に --width / --height / --floors で変更可能。階数 0 は無限)
 const int MAZE_WIDTH = 21;
 const int MAZE_HEIGHT = 21;
 const int NUM_FLOORS = 5;
-const int MONSTER_COUNT = 5;
+const size_t FLOOR_CACHE_LIMIT = 4; // メモリに置いておくフロアの最大数 (超えたら最も長く使っていないものを追い出す)
+const int MONSTER_COUNT = 5; // 1フロアあたりのモンスター数 (既定値。--monsters で変更可能)
 const int MAX_HP = 100;
+const int PLAYER_BASE_ATTACK = 10;
 const int HP_RECOVERY_PER_STEP = 1;
+const int MIN_MESSAGE_LINES = 2; // 画面の下に最低限残すメッセージの行数
+const int MESSAGE_LOG_LIMIT = 64; // 1ターン分として保持するメッセージの最大行数
+const int CHASE_RADIUS = 10; // この歩数以内にプレイヤーがいるとモンスターが追いかける (--chase-radius。0 なら距離無制限)
+const int TICK_MS = 30; // ゲームループの1ティックの長さ (--tick-ms で変更可能)
+const int BATTLE_ROUND_MS = 500; // 戦闘の1ラウンドを表示する間隔
+const size_t KEY_BATCH_LIMIT = 8; // 1ティックで処理するキーの最大数
+const size_t KEY_QUEUE_LIMIT = 32; // 処理待ちのキーがこれ以上あれば、減るまで新しい入力を読まない
+
+// チャンク分割モード (--chunked)
+// フロアを CHUNK_SIZE 四方のチャンクに分け、プレイヤーの周りの CHUNK_WINDOW 四方だけをメモリに置く
+const int CHUNK_SIZE = 64;
+const int CHUNK_WINDOW = 5;
+const int CHUNKED_DEFAULT_SIZE = CHUNK_SIZE * 64 + 1; // 既定のフロアは 4097 四方 (約1680万セル)
+
+// チャンク座標 (cx, cy) を1つの整数にまとめる (map のキー。cy, cx の順に並ぶ)
+inline uint64_t chunkKey(int cx, int cy) {
+    return static_cast<uint64_t>(static_cast<uint32_t>(cy)) << 32 | static_cast<uint32_t>(cx);
+}
+
+// 迷路の生成方法 (--algo)
+//   Dfs   穴掘り法 (既定)。通路が長く曲がりくねる。グリッド全体をメモリに置いて掘る
+//   Eller 行ごとの生成 (maze_stream.h)。分岐が多く、1行ずつ作れるので --generate で巨大な迷路を流し出せる
+// 値はセーブファイルにも書くので変えないこと
+enum class MazeAlgorithm {
+    Dfs = 0,
+    Eller = 1,
+};
+
+inline const char* mazeAlgorithmName(MazeAlgorithm algorithm) {
+    return algorithm == MazeAlgorithm::Eller ? "eller" : "dfs";
+}
+
+// 名前から生成方法を得る (知らない名前なら false)
+inline bool parseMazeAlgorithm(const std::string& name, MazeAlgorithm& algorithm) {
+    if (name == "dfs") {
+        algorithm = MazeAlgorithm::Dfs;
+        return true;
+    }
+    if (name == "eller") {
+        algorithm = MazeAlgorithm::Eller;
+        return true;
+    }
+    return false;
+}
+
+// 名前 (NameTable に登録した番号)
+const NameId NAME_PLAYER = NameTable::intern("プレイヤー");
+const NameId NAME_MONSTER = NameTable::intern("モンスター");
+const NameId NAME_BARE_HANDS = NameTable::intern("素手");
 
-// 武器の構造体
+// 武器の構造体 (名前は番号なので、コピーしても文字列は写さない)
 struct Weapon {
-    std::string name;
+    NameId name;
     int attack_bonus;
 };
 
+// ドロップする武器の表 (弱い順)
+inline std::vector<Weapon> defaultWeapons() {
+    static const std::vector<Weapon> weapons = {
+        { NameTable::intern("木刀"), 5 }, { NameTable::intern("銅の剣"), 10 }, { NameTable::intern("鉄の剣"), 15 },
+        { NameTable::intern("銀の剣"), 25 }, { NameTable::intern("伝説の剣"), 50 },
+    };
+    return weapons;
+}
+
 // プレイヤーとモンスターの属性
 struct Character {
     int hp;
     int base_attack;
-    std::string name;
+    NameId name;
     Weapon equipped_weapon;
 };
 
-// 迷路の構造体 (各階の迷路データと階段の位置を保持)
-struct MazeFloor {
-    std::vector<std::vector<char>> maze_data;
-    int up_stair_x, up_stair_y;
-    int down_stair_x, down_stair_y;
+// モンスターの状態
+enum class MonsterState : uint8_t {
+    Wandering, // ランダムに歩き回る
+    Chasing,   // 距離場をたどってプレイヤーを追いかける
 };
 
-// 迷路の生成とゲーム進行を管理するクラス
-class MazeGame {
-public:
-    MazeGame() {
-        player.name = "プレイヤー";
-        player.hp = MAX_HP;
-        player.base_attack = 10;
-        player.equipped_weapon = { "素手", 0 };
+// モンスターの実体 (位置・能力値・状態)
+// フロアごとに配列でまとめて持ち、倒されたら末尾と入れ替えて詰める
+struct MonsterEntity {
+    int x, y;
+    int hp;
+    int16_t attack;
+    MonsterState state;
+};
 
-        initializeWeapons();
+// ヘッドレス実行で時間を測る処理の区分
+enum GamePhase {
+    PHASE_PLAYER,    // プレイヤーの移動 (戦闘の最初のラウンドを含む)
+    PHASE_BATTLE,    // 戦闘の2ラウンド目以降
+    PHASE_MONSTERS,  // モンスターの移動 (距離場の更新を含む)
+    PHASE_MESSAGES,  // メッセージの回収
+    PHASE_COUNT
+};
 
-        currentFloor = 1;
-        playerX = 1;
-        playerY = 1;
+const char* const PHASE_NAMES[PHASE_COUNT] = { "プレイヤー移動", "戦闘", "モンスター移動", "メッセージ" };
 
-        srand(time(NULL));
+// 区分ごとの経過時間 (enabled のときだけ測る)
+struct PhaseProfile {
+    bool enabled = false;
+    std::chrono::steady_clock::duration total[PHASE_COUNT] = {};
+    std::chrono::steady_clock::time_point mark;
+
+    void start() {
+        if (enabled) {
+            mark = std::chrono::steady_clock::now();
+        }
     }
 
-    void run() {
-        // 全フロアの迷路を生成
-        for (int i = 0; i < NUM_FLOORS; ++i) {
-            generateMazeFloor(i + 1);
+    // 前回の区切りからの時間を phase に積算する
+    void lap(GamePhase phase) {
+        if (enabled) {
+            auto now = std::chrono::steady_clock::now();
+            total[phase] += now - mark;
+            mark = now;
         }
+    }
+};
 
-        // ゲーム開始
-        while (true) {
-            std::vector<std::vector<char>>& current_maze = floors[currentFloor - 1].maze_data;
+// ヘッドレス実行 (スクリプト・リプレイ) の結果
+struct HeadlessReport {
+    uint64_t steps;          // 処理したキーの数
+    uint64_t ticks;          // 最後のティック番号
+    uint64_t battles;
+    double generation_seconds;
+    double seconds;          // ゲームループの時間 (生成を除く)
+    double phase_seconds[PHASE_COUNT];
+    uint64_t state_hash;
+    uint64_t floors_generated;  // 生成した (作り直しを含む) フロアの数
+    size_t floors_cached;       // 最後にメモリにあったフロアの数
+    size_t floor_deltas;        // 差分として持っているフロアの数
+    const char* outcome;
+};
 
-            // プレイヤーの位置を表示
-            current_maze[playerY][playerX] = 'P';
+// 進行中の戦闘
+// 戦闘は1ティックに最大1ラウンドずつ進め、その間も入力と描画は止めない
+struct BattleState {
+    bool active;
+    int monster_index;           // 戦っているモンスター (戦闘中は配列が変わらない)
+    int target_x, target_y;      // 勝ったときにプレイヤーが進むセル
+    int player_total_attack;
+    uint64_t next_round_tick;    // 次のラウンドを進めるティック
+    RngStream rng;               // この戦闘専用の乱数ストリーム
+};
 
-            displayMaze();
+// 追い出したフロアの差分
+// 地形は階ごとのシードから作り直せるので、プレイヤーが変えうるもの
+// (モンスターの位置・HP・撃破、モンスターの乱数の進み) だけを持つ
+// チャンク分割したフロアでは、モンスターを全てチャンクごと (ワールド座標) に預ける
+// 霧のモードでは探索済みのセルの記憶も残す (チャンク分割したフロアでは残さない)
+struct FloorDelta {
+    std::vector<MonsterEntity> monsters;
+    uint64_t monster_rng_position;
+    std::map<uint64_t, std::vector<MonsterEntity>> parked_monsters;
+    std::set<uint64_t> populated_chunks;
+    std::vector<uint64_t> explored;
+};
 
-            // プレイヤー情報表示
-            std::cout << "--- " << currentFloor << "階 (HP: " << player.hp << "/" << MAX_HP
-                << " | 装備: " << player.equipped_weapon.name
-                << " (+" << player.equipped_weapon.attack_bonus << ")) ---" << std::endl;
+// フロアの地形 (文字グリッドと移動判定用の壁ビットマップ)
+// 生成した後は書き換えず、フロアの複製どうしやスナップショットと shared_ptr<const> で共有する
+template <int W, int H>
+struct BasicFloorTerrain {
+    BasicMazeGrid<W, H> maze_data;
+    BasicWallBitmap<W, H> walls;
+};
 
-            // ゲーム終了条件
-            if (player.hp <= 0) {
-                std::cout << "ゲームオーバー！プレイヤーは力尽きました。" << std::endl;
-                break;
+// 地形の上に付けた表示 (index のセルを cell と表示する)
+struct CellMark {
+    uint32_t index;
+    char cell;
+};
+
+// 迷路の構造体 (各階の迷路データと階段の位置を保持)
+// terrain は地形 ('#', ' ', 'S', 'E', 'U', 'D') で、grid() と walls() で読む
+// marks はプレイヤーが地形の上に付けた表示 ('P' や、立ち去ったスタートマス) のうち地形と違うセルだけを持ち、
+// cell(x, y) は地形に印を重ねた文字、setCell で書き換える (印はふつう1つか2つ)
+// monsters はこの階のモンスター、occupied はモンスターがいるセルの索引 (O(1) で衝突判定できる)
+// free_cells はモンスターのいない通路 (' ') の索引 (階段やモンスターを置くセルを O(1) で選ぶ)
+// モンスターを置く・どけるときは occupy / vacate で occupied と free_cells をそろえる
+// player_distance はプレイヤーからの距離場 (グリッドと同じ並びの平らな配列)
+// player_view はプレイヤーの視界と探索済みのセル (霧のモードでだけ使う)
+// monster_rng はこの階のモンスターの移動に使う乱数ストリーム
+//
+// ゲームを進めると変わる大きな層 (occupied, free_cells, player_distance, player_view) は
+// ページ単位の copy-on-write で持つので、フロアを複製しても地形は共有したまま、
+// 変わる層もページのポインタを写すだけで済み、その後に書き換えたページだけが複製される
+//
+// チャンク分割したフロア (chunked) では、上のグリッド・ビットマップ・距離場・モンスター・階段の
+// 座標はすべてメモリにあるチャンクの範囲 (ウィンドウ) の中の座標で、ワールド座標は origin を足したもの
+// ウィンドウの外のチャンクのモンスターは parked_monsters にワールド座標で預けておく
+// ウィンドウを動かすときは地形を作り直し、それまでの印は新しい地形に焼き込む
+//
+// W, H はフロアの幅と高さ (DYNAMIC_SIZE なら実行時に決める)。チャンク分割したフロアは実行時サイズだけ
+template <int W, int H>
+struct BasicMazeFloor {
+    using Grid = BasicMazeGrid<W, H>;
+    using Walls = BasicWallBitmap<W, H>;
+    using Terrain = BasicFloorTerrain<W, H>;
+
+    std::shared_ptr<const Terrain> terrain;
+    std::vector<CellMark> marks;
+    int up_stair_x = -1, up_stair_y = -1;      // 階段のない階では -1
+    int down_stair_x = -1, down_stair_y = -1;
+    std::vector<MonsterEntity> monsters;
+    BasicPagedCellBitmap<W, H> occupied;
+    FreeCellSet free_cells;
+    DistanceField player_distance;
+    FieldOfView player_view;
+    RngStream monster_rng;
+    bool modified = false;   // シードから作り直した状態と変わったか (プレイヤーが入ったか、ワールドティックで動かした)
+    uint64_t last_used = 0;  // キャッシュの LRU 用の通し番号
+    int unplaced = 0;        // 空きセルが足りずに置けなかった階段とモンスターの数 (0 でなければ満杯)
+
+    bool chunked = false;
+    int origin_x = 0, origin_y = 0;  // ウィンドウの左上のワールド座標 (CHUNK_SIZE の倍数)
+    std::map<uint64_t, std::vector<MonsterEntity>> parked_monsters;
+    std::set<uint64_t> populated_chunks;  // モンスターを配置済みのチャンク (倒したモンスターは復活しない)
+
+    const Grid& grid() const { return terrain->maze_data; }
+    const Walls& walls() const { return terrain->walls; }
+
+    // (x, y) の表示用の文字 (地形に印を重ねたもの)
+    char cell(int x, int y) const {
+        uint32_t i = static_cast<uint32_t>(grid().index(x, y));
+        for (const CellMark& mark : marks) {
+            if (mark.index == i) {
+                return mark.cell;
             }
+        }
+        return grid()(x, y);
+    }
 
-            // 5階のゴールに到達した場合
-            if (currentFloor == NUM_FLOORS && playerX == MAZE_WIDTH - 2 && playerY == MAZE_HEIGHT - 2) {
-                std::cout << "おめでとうございます！ダンジョンをクリアしました！" << std::endl;
-                break;
+    // (x, y) の表示を value にする (地形と同じになれば印を外す)
+    void setCell(int x, int y, char value) {
+        uint32_t i = static_cast<uint32_t>(grid().index(x, y));
+        bool plain = grid()(x, y) == value;
+        for (size_t k = 0; k < marks.size(); ++k) {
+            if (marks[k].index == i) {
+                if (plain) {
+                    marks[k] = marks.back();
+                    marks.pop_back();
+                }
+                else {
+                    marks[k].cell = value;
+                }
+                return;
             }
+        }
+        if (!plain) {
+            marks.push_back({ i, value });
+        }
+    }
 
-            // キー入力と移動
-            movePlayer(getInput());
+    // 地形に印を重ねたグリッド (セーブファイルやウィンドウの移動で1枚の文字グリッドが要るとき用)
+    Grid markedGrid() const {
+        Grid marked = grid();
+        for (const CellMark& mark : marks) {
+            marked.data()[mark.index] = mark.cell;
+        }
+        return marked;
+    }
 
-            // プレイヤーの移動後にモンスターを動かす
-            moveMonsters();
+    // (x, y) にいるモンスターの添字 (いなければ -1)
+    // 戦闘開始時にしか呼ばないので線形探索でよい
+    int findMonster(int x, int y) const {
+        for (size_t i = 0; i < monsters.size(); ++i) {
+            if (monsters[i].x == x && monsters[i].y == y) {
+                return static_cast<int>(i);
+            }
         }
+        return -1;
     }
 
-private:
-    std::vector<MazeFloor> floors;
-    int currentFloor;
-    int playerX, playerY;
-    Character player;
-    std::vector<Weapon> availableWeapons;
+    // モンスターを取り除く (末尾と入れ替えて配列を詰める)
+    void removeMonster(int index) {
+        vacate(monsters[index].x, monsters[index].y);
+        monsters[index] = monsters.back();
+        monsters.pop_back();
+    }
 
-    // --- 武器リストの初期化 ---
-    void initializeWeapons() {
-        availableWeapons.push_back({ "木刀", 5 });
-        availableWeapons.push_back({ "銅の剣", 10 });
-        availableWeapons.push_back({ "鉄の剣", 15 });
-        availableWeapons.push_back({ "銀の剣", 25 });
-        availableWeapons.push_back({ "伝説の剣", 50 });
+    // (x, y) にモンスターを置く / (x, y) からモンスターをどける
+    // モンスターは階段などの上にもいられるが、空きセルに戻すのは通路だけ
+    // (モンスターとプレイヤーは同じセルにいないので、どけたセルの文字は地形のまま)
+    void occupy(int x, int y) {
+        occupied.set(x, y);
+        free_cells.erase(x, y);
     }
 
-    // --- 迷路生成 (DFS) ---
-    void generateMazeFloor(int floor_num) {
-        MazeFloor newFloor;
-        newFloor.maze_data.resize(MAZE_HEIGHT, std::vector<char>(MAZE_WIDTH, '#'));
+    void vacate(int x, int y) {
+        occupied.clear(x, y);
+        if (cell(x, y) == ' ') {
+            free_cells.insert(x, y);
+        }
+    }
 
-        dfs(newFloor.maze_data, 1, 1);
+    // monsters から occupied と free_cells を作り直す
+    // プレイヤーの表示 ('P') は階段の上でなければ通路として数える
+    void rebuildOccupancy() {
+        occupied.reset(grid().width(), grid().height());
+        for (const MonsterEntity& monster : monsters) {
+            occupied.set(monster.x, monster.y);
+        }
+        free_cells.build(1, 1, grid().width() - 2, grid().height() - 2, [this](int x, int y) {
+            char value = cell(x, y);
+            bool stair = (x == up_stair_x && y == up_stair_y) || (x == down_stair_x && y == down_stair_y);
+            return (value == ' ' || (value == 'P' && !stair)) && !occupied.test(x, y);
+        });
+    }
 
-        // スタート/ゴール/階段の設定
-        if (floor_num == 1) {
-            newFloor.maze_data[1][1] = 'S';
-            placeStair(newFloor.maze_data, 'U', newFloor.up_stair_x, newFloor.up_stair_y);
+    // 追い出すときに残す差分
+    FloorDelta makeDelta() const {
+        if (!chunked) {
+            return FloorDelta{ monsters, monster_rng.position(), {}, {},
+                               player_view.valid() ? player_view.exploredWords() : std::vector<uint64_t>() };
+        }
+        FloorDelta delta{ {}, monster_rng.position(), parked_monsters, populated_chunks, {} };
+        for (MonsterEntity monster : monsters) {
+            monster.x += origin_x;
+            monster.y += origin_y;
+            delta.parked_monsters[chunkKey(monster.x / CHUNK_SIZE, monster.y / CHUNK_SIZE)].push_back(monster);
         }
-        else if (floor_num == NUM_FLOORS) {
-            placeStair(newFloor.maze_data, 'D', newFloor.down_stair_x, newFloor.down_stair_y);
-            newFloor.maze_data[MAZE_HEIGHT - 2][MAZE_WIDTH - 2] = 'E';
+        return delta;
+    }
+
+    // シードから作り直したフロアに差分を適用する
+    void applyDelta(const FloorDelta& delta) {
+        if (chunked) {
+            // 作り直しで配置されたモンスターのうち、差分の時点で配置済みだったチャンクのものは捨て、
+            // 代わりに預けてあったモンスターを戻す
+            parked_monsters = delta.parked_monsters;
+            std::vector<MonsterEntity> resident;
+            for (const MonsterEntity& monster : monsters) {
+                int cx = (monster.x + origin_x) / CHUNK_SIZE;
+                int cy = (monster.y + origin_y) / CHUNK_SIZE;
+                if (!delta.populated_chunks.count(chunkKey(cx, cy))) {
+                    resident.push_back(monster);
+                }
+            }
+            populated_chunks = delta.populated_chunks;
+            for (int j = 0; j < CHUNK_WINDOW; ++j) {
+                for (int i = 0; i < CHUNK_WINDOW; ++i) {
+                    uint64_t key = chunkKey(origin_x / CHUNK_SIZE + i, origin_y / CHUNK_SIZE + j);
+                    auto parked = parked_monsters.find(key);
+                    if (parked != parked_monsters.end()) {
+                        for (MonsterEntity monster : parked->second) {
+                            monster.x -= origin_x;
+                            monster.y -= origin_y;
+                            resident.push_back(monster);
+                        }
+                        parked_monsters.erase(parked);
+                    }
+                    else if (!delta.populated_chunks.count(key)) {
+                        populated_chunks.insert(key);
+                    }
+                }
+            }
+            monsters = resident;
         }
         else {
-            placeStair(newFloor.maze_data, 'U', newFloor.up_stair_x, newFloor.up_stair_y);
-            placeStair(newFloor.maze_data, 'D', newFloor.down_stair_x, newFloor.down_stair_y);
+            monsters = delta.monsters;
+            if (!delta.explored.empty()) {
+                player_view.restoreExplored(grid().width(), grid().height(), delta.explored);
+            }
         }
+        rebuildOccupancy();
+        monster_rng = RngStream(monster_rng.streamKey(), delta.monster_rng_position);
+        modified = true;
+    }
+};
 
-        // モンスターの配置
-        placeMonsters(newFloor.maze_data);
+using MazeFloor = BasicMazeFloor<DYNAMIC_SIZE, DYNAMIC_SIZE>;
+
+// メッセージの番号 (MAZE_MESSAGES の並びと同じ順)
+enum MazeMessage : uint8_t {
+    MSG_BATTLE_START,
+    MSG_FORECAST,
+    MSG_AUTO_RESOLVED,
+    MSG_HIT_MONSTER,
+    MSG_HIT_PLAYER,
+    MSG_KILL,
+    MSG_DROP,
+    MSG_EQUIP,
+    MSG_KEEP_EQUIPMENT,
+    MSG_FLOOR_UP,
+    MSG_FLOOR_DOWN,
+};
 
-        floors.push_back(newFloor);
+const MessageCatalog MAZE_MESSAGES = {
+    "\nモンスターが出現しました！戦闘開始！\nモンスターHP: {0}, 攻撃力: {1}\n",
+    "勝率: {0:tenths}%, 予想される被ダメージ: {1}\n",
+    "(楽な相手なので一気に決着をつけます)\n",
+    "{0:name}の攻撃！{1:name}に {2} ダメージを与えた。(残りHP: {3})\n",
+    "{0:name}の攻撃！{1:name}は {2} ダメージを受けた。(残りHP: {3})\n",
+    "{0:name}を倒した！\n",
+    "\n\033[32m新しい武器を獲得しました: {0:name} (攻撃力+{1})\033[0m\n",
+    "\033[36m{0:name} を装備しました。\033[0m\n",
+    "現在装備中の {0:name} の方が強力です。\n",
+    "\n\033[33m階段を上り、{0}階に到達しました。\033[0m\n",
+    "\n\033[33m階段を下り、{0}階に戻りました。\033[0m\n",
+};
+
+// 迷路のメッセージの書式 (TextEventSink 用)
+void formatMazeEvent(std::string& out, const GameEvent& event) {
+    switch (event.type) {
+    case GameEventType::BattleStart:
+        MAZE_MESSAGES.format(out, MSG_BATTLE_START, { intArg(event.value), intArg(event.extra) });
+        break;
+    case GameEventType::BattleForecast:
+        MAZE_MESSAGES.format(out, MSG_FORECAST, { tenthsArg(event.value), intArg(event.extra) });
+        if (event.flags & EVENT_AUTO_RESOLVED) {
+            MAZE_MESSAGES.format(out, MSG_AUTO_RESOLVED, {});
+        }
+        break;
+    case GameEventType::Damage:
+        MAZE_MESSAGES.format(out, (event.flags & EVENT_FROM_PLAYER) ? MSG_HIT_MONSTER : MSG_HIT_PLAYER,
+                             { nameArg(event.actor), nameArg(event.target), intArg(event.value), intArg(event.extra) });
+        break;
+    case GameEventType::Kill:
+        MAZE_MESSAGES.format(out, MSG_KILL, { nameArg(event.target) });
+        break;
+    case GameEventType::Drop:
+        MAZE_MESSAGES.format(out, MSG_DROP, { nameArg(event.item), intArg(event.value) });
+        break;
+    case GameEventType::Equip:
+        MAZE_MESSAGES.format(out, MSG_EQUIP, { nameArg(event.item) });
+        break;
+    case GameEventType::KeepEquipment:
+        MAZE_MESSAGES.format(out, MSG_KEEP_EQUIPMENT, { nameArg(event.item) });
+        break;
+    case GameEventType::FloorChange:
+        MAZE_MESSAGES.format(out, event.extra > event.value ? MSG_FLOOR_UP : MSG_FLOOR_DOWN, { intArg(event.extra) });
+        break;
+    default:
+        break;
     }
+}
+
+// 方向の表
+// 穴掘り法で2セル先へ進む方向 (下, 上, 右, 左)。半分にすると隣のセル
+constexpr int CARVE_DX[4] = { 0, 0, 2, -2 };
+constexpr int CARVE_DY[4] = { 2, -2, 0, 0 };
+// モンスターが1歩動く方向 (上, 下, 左, 右)
+constexpr int STEP_DX[4] = { 0, 0, -1, 1 };
+constexpr int STEP_DY[4] = { -1, 1, 0, 0 };
+
+// 4方向の全順列 (4! = 24通り)。方向リストをシャッフルする代わりに1つを選ぶ
+constexpr unsigned char DIRECTION_ORDERS[24][4] = {
+    {0,1,2,3},{0,1,3,2},{0,2,1,3},{0,2,3,1},{0,3,1,2},{0,3,2,1},
+    {1,0,2,3},{1,0,3,2},{1,2,0,3},{1,2,3,0},{1,3,0,2},{1,3,2,0},
+    {2,0,1,3},{2,0,3,1},{2,1,0,3},{2,1,3,0},{2,3,0,1},{2,3,1,0},
+    {3,0,1,2},{3,0,2,1},{3,1,0,2},{3,1,2,0},{3,2,0,1},{3,2,1,0},
+};
 
-    int dx[4] = { 0, 0, 2, -2 };
-    int dy[4] = { 2, -2, 0, 0 };
+// 迷路の生成とゲーム進行を管理するクラス
+// W, H, Floors は迷路の幅・高さ・階数。よく使う大きさはコンパイル時に決めておくと、
+// グリッドとビットマップが std::array に収まり、範囲の判定が定数との比較になる
+// DYNAMIC_SIZE なら実行時に決める (MazeGame。チャンク分割モードはこちらだけ)
+// どちらも同じコードから作るので、同じ設定なら同じダンジョン・同じ状態ハッシュになる
+template <int W, int H, int Floors>
+class BasicMazeGame {
+public:
+    using Floor = BasicMazeFloor<W, H>;
+    using Grid = typename Floor::Grid;
+    using Terrain = typename Floor::Terrain;
+
+    // 幅と高さがコンパイル時に決まっているか
+    static constexpr bool kFixedSize = Extent<W>::fixed && Extent<H>::fixed;
+
+    // 固定サイズのゲームでも引数の並びは同じ (width, height, floor_count はテンプレート引数と同じ値であること)
+    BasicMazeGame(int width = MAZE_WIDTH, int height = MAZE_HEIGHT, int floor_count = NUM_FLOORS,
+             uint64_t master_seed = RngService::randomSeed(), unsigned threads = 1,
+             int monsters_per_floor = MONSTER_COUNT, int chase_radius = CHASE_RADIUS)
+        : mazeWidth(width), mazeHeight(height), numFloors(floor_count),
+          monsterCount(monsters_per_floor), chaseRadius(chase_radius),
+          rngs(master_seed) {
+        player.name = NAME_PLAYER;
+        player.hp = MAX_HP;
+        player.base_attack = PLAYER_BASE_ATTACK;
+        player.equipped_weapon = { NAME_BARE_HANDS, 0 };
 
-    void dfs(std::vector<std::vector<char>>& current_maze, int x, int y) {
-        current_maze[y][x] = ' ';
+        initializeWeapons();
 
-        std::vector<int> directions = { 0, 1, 2, 3 };
-        std::random_device rd;
-        std::mt19937 g(rd());
-        std::shuffle(directions.begin(), directions.end(), g);
+        currentFloor = 1;
+        playerX = 1;
+        playerY = 1;
+        battleCount = 0;
+        battle.active = false;
+        quitRequested = false;
+        fullFloor = 0;
+        tickCount = 0;
+        stepCount = 0;
+        recorder = nullptr;
+        activeFloor = nullptr;
+        activeShared = false;
+        floorUseCounter = 0;
+        floorsGenerated = 0;
+        chunkedFloors = false;
+        mazeAlgorithm = MazeAlgorithm::Dfs;
+        autoBattlePermille = -1;
+        fogRadius = 0;
+        worldRadius = 0;
+        workerThreads = threads;
+        setTickInterval(TICK_MS, 0);
+
+        // 次のフロアを裏で生成するスレッド (0 なら先読みせず、必要になったときに生成する)
+        if (threads > 0) {
+            prefetchPool.reset(new ThreadPool(threads));
+        }
 
-        for (int dir : directions) {
-            int nx = x + dx[dir];
-            int ny = y + dy[dir];
+        // 既定では日本語のメッセージを組み立て、画面下のメッセージ欄に表示する
+        events = &textSink;
+    }
 
-            if (nx > 0 && nx < MAZE_WIDTH - 1 && ny > 0 && ny < MAZE_HEIGHT - 1) {
-                if (current_maze[ny][nx] == '#') {
-                    current_maze[y + dy[dir] / 2][x + dx[dir] / 2] = ' ';
-                    dfs(current_maze, nx, ny);
-                }
-            }
-        }
+    // イベントの送り先を差し替える (nullptr なら何も出力しない)
+    void setEventSink(EventSink* sink) {
+        events = sink ? sink : &nullSink;
     }
 
-    // --- 階段の配置 ---
-    void placeStair(std::vector<std::vector<char>>& current_maze, char type, int& stair_x, int& stair_y) {
-        int placedCount = 0;
-        while (placedCount == 0) {
-            int sx = (rand() % (MAZE_WIDTH - 2)) + 1;
-            int sy = (rand() % (MAZE_HEIGHT - 2)) + 1;
+    // 処理したキーを (ティック, キー) の組で記録する (nullptr なら記録しない)
+    void setRecorder(std::vector<ReplayInput>* inputs) {
+        recorder = inputs;
+    }
 
-            if (current_maze[sy][sx] == ' ') {
-                current_maze[sy][sx] = type;
-                stair_x = sx;
-                stair_y = sy;
-                placedCount++;
-            }
+    uint64_t currentTick() const { return tickCount; }
+
+    // フロアをチャンクに分けて、プレイヤーの周りだけを生成・保持する (ゲームを始める前に呼ぶ)
+    // 幅と高さは CHUNK_SIZE の倍数 + 1 であること (normalizeChunkedSize)
+    // 固定サイズのゲームではチャンク分割しない (main は実行時サイズのゲームを選ぶ)
+    void setChunkedFloors(bool enabled) {
+        chunkedFloors = enabled && !kFixedSize;
+    }
+
+    // 霧のモード: プレイヤーから radius 歩以内で視線の通るセルだけを見せ、一度見たセルは薄く表示する
+    // (0 なら全体を見せる。半径は FieldOfView::kMaxRadius まで)。表示だけの設定で、ゲームの進行と状態ハッシュには影響しない
+    void setFogOfWar(int radius) {
+        fogRadius = std::max(0, std::min(radius, FieldOfView::kMaxRadius));
+    }
+
+    // ワールドティック: 現在の階から radius 階以内を読み込んだままにし、ターンごとに読み込み済みの
+    // 全フロアのモンスターを動かす (0 なら今までどおり現在のフロアだけ。ゲームを始める前に呼ぶ)
+    // フロアはコンストラクタの threads 本のスレッドと呼び出し元で並行に進め、結果はスレッドの数によらない
+    void setWorldTick(int radius) {
+        worldRadius = std::max(0, radius);
+        if (worldRadius > 0 && workerThreads > 0 && !worldPool) {
+            worldPool.reset(new ThreadPool(workerThreads));
         }
     }
 
-    // --- モンスターの配置 ---
-    void placeMonsters(std::vector<std::vector<char>>& current_maze) {
-        int placedCount = 0;
-        while (placedCount < MONSTER_COUNT) {
-            int mx = (rand() % (MAZE_WIDTH - 2)) + 1;
-            int my = (rand() % (MAZE_HEIGHT - 2)) + 1;
+    // 迷路の生成方法を選ぶ (ゲームを始める前に呼ぶ)
+    void setMazeAlgorithm(MazeAlgorithm algorithm) {
+        mazeAlgorithm = algorithm;
+    }
 
-            if (current_maze[my][mx] == ' ') {
-                current_maze[my][mx] = 'M';
-                placedCount++;
+    // ゲームの状態全体のハッシュ (リプレイの再現性の確認用)
+    // 地形・モンスター・プレイヤー・乱数の位置が1ビットでも違えば別の値になる
+    uint64_t stateHash() const {
+        uint64_t hash = rngs.seed();
+        auto add = [&hash](uint64_t value) { hash = mixBits(hash ^ mixBits(value + 0x9E3779B97F4A7C15ull)); };
+
+        add(static_cast<uint64_t>(currentFloor));
+        // プレイヤーの位置はワールド座標で見る (チャンク分割したフロアのウィンドウの位置によらない)
+        add(static_cast<uint64_t>(playerX + (activeFloor ? activeFloor->origin_x : 0)));
+        add(static_cast<uint64_t>(playerY + (activeFloor ? activeFloor->origin_y : 0)));
+        add(static_cast<uint64_t>(player.hp));
+        add(static_cast<uint64_t>(player.equipped_weapon.attack_bonus));
+        add(battleCount);
+        add(tickCount);
+
+        // 地形はシードで決まるので、プレイヤーの印がある現在のフロアだけを見る
+        // (地形に印を重ねた文字を 8 バイトずつ見る)
+        if (activeFloor) {
+            const Grid& grid = activeFloor->grid();
+            for (size_t i = 0; i < grid.size(); i += 8) {
+                size_t length = std::min<size_t>(8, grid.size() - i);
+                char bytes[8] = {};
+                std::memcpy(bytes, grid.data() + i, length);
+                for (const CellMark& mark : activeFloor->marks) {
+                    if (mark.index >= i && mark.index < i + length) {
+                        bytes[mark.index - i] = mark.cell;
+                    }
+                }
+                uint64_t chunk = 0;
+                std::memcpy(&chunk, bytes, sizeof(chunk));
+                add(chunk);
             }
         }
-    }
 
-    // --- モンスターの移動 ---
-    void moveMonsters() {
-        std::vector<std::vector<char>>& current_maze = floors[currentFloor - 1].maze_data;
-        std::vector<std::pair<int, int>> monster_positions;
+        // 変わったフロアのモンスターと乱数の進み (キャッシュにあるか差分かは区別しない)
+        auto add_floor = [&add](int floor_num, const std::vector<MonsterEntity>& monsters, uint64_t rng_position) {
+            add(static_cast<uint64_t>(floor_num));
+            add(monsters.size());
+            for (const MonsterEntity& monster : monsters) {
+                add(static_cast<uint64_t>(monster.x) | static_cast<uint64_t>(monster.y) << 32);
+                add(static_cast<uint64_t>(monster.hp) | static_cast<uint64_t>(monster.attack) << 32
+                    | static_cast<uint64_t>(monster.state) << 48);
+            }
+            add(rng_position);
+        };
+        // チャンク分割したフロアは、メモリにあるモンスターも預けたものと合わせてチャンク順に見る
+        auto add_delta = [&add, &add_floor](int floor_num, const FloorDelta& delta) {
+            if (delta.populated_chunks.empty()) {
+                add_floor(floor_num, delta.monsters, delta.monster_rng_position);
+                return;
+            }
+            std::vector<MonsterEntity> monsters;
+            for (const auto& parked : delta.parked_monsters) {
+                monsters.insert(monsters.end(), parked.second.begin(), parked.second.end());
+            }
+            add_floor(floor_num, monsters, delta.monster_rng_position);
+            add(delta.populated_chunks.size());
+            for (uint64_t key : delta.populated_chunks) {
+                add(key);
+            }
+        };
+        // セーブファイルからまだ読み込んでいないフロアも、差分として同じ順に混ぜる
+        // 読み込んだフロアはセーブファイルの表から外すので両方にあることはないが、
+        // あれば後から作られた floorDeltas の方を正とする
+        std::map<int, std::shared_ptr<const FloorDelta>> deltas;
+        for (const auto& saved : savedFloors) {
+            if (savedFloorIntact(*saved.second)) {
+                deltas.emplace(saved.first, std::make_shared<const FloorDelta>(savedDelta(*saved.second)));
+            }
+        }
+        for (const auto& evicted : floorDeltas) {
+            deltas.insert_or_assign(evicted.first, evicted.second);
+        }
 
-        // 現在のモンスターの位置を収集
-        for (int y = 1; y < MAZE_HEIGHT - 1; ++y) {
-            for (int x = 1; x < MAZE_WIDTH - 1; ++x) {
-                if (current_maze[y][x] == 'M') {
-                    monster_positions.push_back({ x, y });
+        auto cached = floors.begin();
+        auto delta = deltas.begin();
+        while (cached != floors.end() || delta != deltas.end()) {
+            if (delta == deltas.end() || (cached != floors.end() && cached->first < delta->first)) {
+                const Floor& floor = *cached->second;
+                if (floor.modified && floor.chunked) {
+                    add_delta(cached->first, floor.makeDelta());
                 }
+                else if (floor.modified) {
+                    add_floor(cached->first, floor.monsters, floor.monster_rng.position());
+                }
+                ++cached;
+            }
+            else {
+                add_delta(delta->first, *delta->second);
+                ++delta;
             }
         }
+        return hash;
+    }
 
-        // 各モンスターをランダムに移動させる
-        for (const auto& pos : monster_positions) {
-            int mx = pos.first;
-            int my = pos.second;
+    // ティックの長さと、リアルタイムでモンスターを動かす間隔 (0 ならプレイヤーの移動ごと)
+    void setTickInterval(int tick_ms, int monster_tick_ms) {
+        tickMs = std::max(1, tick_ms);
+        monsterTickMs = std::max(0, monster_tick_ms);
+        battleRoundTicks = std::max(1, BATTLE_ROUND_MS / tickMs);
+        monsterTicks = monsterTickMs > 0 ? std::max(1, monsterTickMs / tickMs) : 0;
+    }
 
-            // 4方向 (上, 下, 左, 右)
-            int move_dx[] = { 0, 0, -1, 1 };
-            int move_dy[] = { -1, 1, 0, 0 };
+    // 勝率がこの値 (0.1% 単位) 以上の戦闘は、ラウンドを待たずにその場で決着させる (負の値なら行わない)
+    // 乱数と戦闘のルールは変わらず、結果も同じ (決着するティックだけが早くなる)
+    void setAutoBattle(int win_permille) {
+        autoBattlePermille = win_permille;
+    }
 
-            std::vector<int> directions = { 0, 1, 2, 3 };
-            std::random_device rd;
-            std::mt19937 g(rd());
-            std::shuffle(directions.begin(), directions.end(), g);
+    // 今の状態でプレイヤーがこのモンスターと戦ったときの見込み (厳密値)
+    BattleOdds battleOddsAgainst(const MonsterEntity& monster) {
+        return battleOdds.odds(player.base_attack + player.equipped_weapon.attack_bonus, monster.attack,
+                               player.hp, monster.hp);
+    }
 
-            bool moved = false;
-            for (int dir : directions) {
-                int next_mx = mx + move_dx[dir];
-                int next_my = my + move_dy[dir];
+    // ゲームオーバーかクリアで終わったか (途中で終了したなら false)
+    bool finished() const {
+        return player.hp <= 0 || reachedGoal();
+    }
 
-                // 移動先のチェック
-                if (next_mx > 0 && next_mx < MAZE_WIDTH - 1 && next_my > 0 && next_my < MAZE_HEIGHT - 1) {
-                    char target = current_maze[next_my][next_mx];
-
-                    // 通路 (' ') または階段 ('U', 'D'), スタート ('S'), ゴール ('E') に移動可能
-                    if (target == ' ' || target == 'U' || target == 'D' || target == 'S' || target == 'E') {
-                        // プレイヤーの位置には移動しない
-                        if (next_mx != playerX || next_my != playerY) {
-                            // 現在の位置を空にする
-                            current_maze[my][mx] = ' ';
-
-                            // 新しい位置にモンスターを配置
-                            current_maze[next_my][next_mx] = 'M';
-                            moved = true;
-                            break;
-                        }
-                    }
-                }
+    // --- 1キーずつ進めるインターフェース (サーバーのセッション用) ---
+    // startSteps で最初のフロアに入り、以降は stepKey に1キーずつ渡す
+    // 進め方はスクリプトの実行 (runHeadless の follow_ticks == false) と同じで、
+    // 同じキー列を与えれば同じ状態 (stateHash) になる
+
+    void startSteps() {
+        enterFloor(currentFloor);
+    }
+
+    // まだキーを受け付けるか (終了・ゲームオーバー・クリアのどれでもない)
+    bool playing() const {
+        return !quitRequested && player.hp > 0 && !reachedGoal();
+    }
+
+    // キーを1つ処理し、戦闘などの待ちを飛ばして次のキーを受け付けられるところまで進める
+    void stepKey(char key) {
+        if (!playing()) {
+            return;
+        }
+        stepKeys.push_back(key);
+        do {
+            if (battle.active && battle.next_round_tick > tickCount + 1) {
+                tickCount = battle.next_round_tick - 1;
             }
+            updateTick(stepKeys);
+            markPlayer();
+        } while ((battle.active || !stepKeys.empty()) && playing());
+    }
+
+    // キーを1つ押したときに起きることの見込み (previewKey の結果)
+    struct KeyPreview {
+        bool moves = false;              // プレイヤーが動くか戦闘になる (壁にぶつかるだけなら false)
+        bool battle = false;             // 行き先にモンスターがいて戦闘になる
+        int target_x = 0, target_y = 0;  // 行き先のワールド座標
+        BattleOdds odds = { 0.0, 0.0 };          // battle のとき、今の HP で戦ったときの見込み
+        BattleOdds rested_odds = { 0.0, 0.0 };   // battle のとき、HP を満タンまで回復してから戦ったときの見込み
+    };
+
+    // key を押したときに起きることを、状態を変えずに調べる (先読みで戦闘の乱数を使わずに済ませる用)
+    KeyPreview previewKey(char key) {
+        KeyPreview preview;
+        int dx, dy;
+        if (!playing() || battle.active || !keyDirection(key, dx, dy)) {
+            return preview;
+        }
+        Floor& floor = currentFloorData();
+        int x = playerX + dx;
+        int y = playerY + dy;
+        if (!floor.grid().inBounds(x, y)) {
+            return preview;
         }
+        preview.target_x = x + floor.origin_x;
+        preview.target_y = y + floor.origin_y;
+        if (floor.occupied.test(x, y)) {
+            const MonsterEntity& monster = floor.monsters[floor.findMonster(x, y)];
+            preview.moves = true;
+            preview.battle = true;
+            preview.odds = battleOddsAgainst(monster);
+            preview.rested_odds = battleOdds.odds(player.base_attack + player.equipped_weapon.attack_bonus,
+                                                  monster.attack, MAX_HP, monster.hp);
+            return preview;
+        }
+        // movePlayer と同じ判定
+        char target = floor.cell(x, y);
+        preview.moves = target == ' ' || target == 'S' || target == 'E'
+            || (target == 'U' && (numFloors == 0 || currentFloor < numFloors))
+            || (target == 'D' && currentFloor > 1);
+        return preview;
     }
 
-    // --- 戦闘システム ---
-    bool startBattle() {
-        std::cout << "\nモンスターが出現しました！戦闘開始！" << std::endl;
+    // 状態の要約: 歩数, 階, プレイヤーのワールド座標, HP
+    uint64_t steps() const { return stepCount; }
+    int floorNumber() const { return currentFloor; }
+    // 空きセルが足りずに階段やモンスターを置ききれなかった階 (なければ 0。その階に入った時点でゲームを止める)
+    int fullFloorNumber() const { return fullFloor; }
+    int playerWorldX() const { return playerX + (activeFloor ? activeFloor->origin_x : 0); }
+    int playerWorldY() const { return playerY + (activeFloor ? activeFloor->origin_y : 0); }
+    int playerHp() const { return player.hp; }
+
+    // 終わり方 ("play" はまだ続いている)
+    const char* outcomeName() const {
+        return player.hp <= 0 ? "over" : reachedGoal() ? "clear" : fullFloor ? "full" : quitRequested ? "quit" : "play";
+    }
 
-        Character monster;
-        monster.name = "モンスター";
+    // --- スナップショット ---
+    // ゲームの状態を写し取り、後で同じゲームか同じ設定で作った別のゲームに戻す (探索で局面を分けるとき用)
+    // フロアと差分は shared_ptr でゲームと共有し、どちらかで書き換えるときに初めてそのフロアだけを複製する
+    // (copy-on-write)。プレイヤーや戦闘などの残りの状態は数十バイトの値なので、そのまま写す
+    // 取る・戻すのはフロアの数だけのポインタの複製で済む。戻して1キー進めると現在のフロアの複製が1つできるが、
+    // 地形 (terrain) は共有したままで、変わる層もページのポインタを写し、書き換えたページだけが複製される
+    // (フロアの広さによらず、1キーで変わったセルの数に比例する)
+    // 共有しているフロアはどのゲームも書き換えないので、1つのスナップショットを別々のスレッドのゲームに戻してよい
+    struct Snapshot {
+        uint64_t seed = 0;
+        int width = 0, height = 0, floor_count = 0;
+        int monsters_per_floor = 0, chase_radius = 0;
+        MazeAlgorithm algorithm = MazeAlgorithm::Dfs;
+        bool chunked = false;
+
+        std::map<int, std::shared_ptr<Floor>> floors;
+        std::map<int, std::shared_ptr<const FloorDelta>> floor_deltas;
+        std::map<int, const SavedFloor*> saved_floors;  // save_file の中を指すので、同じファイルを持つゲームにだけ戻せる
+        const MappedFile* save_file = nullptr;
+
+        Character player = {};
+        int current_floor = 1;
+        int player_x = 1, player_y = 1;
+        BattleState battle;
+        uint64_t battle_count = 0, tick_count = 0, step_count = 0;
+        uint64_t floor_use_counter = 0, floors_generated = 0;
+        bool quit_requested = false;
+        int full_floor = 0;
+    };
+
+    // 今の状態のスナップショット (この後このゲームで書き換えるフロアは、その時に複製する)
+    Snapshot snapshot() {
+        Snapshot snapshot;
+        snapshot.seed = rngs.seed();
+        snapshot.width = mazeWidth;
+        snapshot.height = mazeHeight;
+        snapshot.floor_count = numFloors;
+        snapshot.monsters_per_floor = monsterCount;
+        snapshot.chase_radius = chaseRadius;
+        snapshot.algorithm = mazeAlgorithm;
+        snapshot.chunked = chunkedFloors;
+        snapshot.floors = floors;
+        snapshot.floor_deltas = floorDeltas;
+        snapshot.saved_floors = savedFloors;
+        snapshot.save_file = saveFile.get();
+        snapshot.player = player;
+        snapshot.current_floor = currentFloor;
+        snapshot.player_x = playerX;
+        snapshot.player_y = playerY;
+        snapshot.battle = battle;
+        snapshot.battle_count = battleCount;
+        snapshot.tick_count = tickCount;
+        snapshot.step_count = stepCount;
+        snapshot.floor_use_counter = floorUseCounter;
+        snapshot.floors_generated = floorsGenerated;
+        snapshot.quit_requested = quitRequested;
+        snapshot.full_floor = fullFloor;
+        activeShared = true;
+        return snapshot;
+    }
 
-        // 階層に基づいたモンスターの強化
-        int floor_bonus_hp = (currentFloor - 1) * 15;
-        int floor_bonus_attack = (currentFloor - 1) * 5;
+    // スナップショットの状態に戻す (設定が違うゲームのものなら false で、error に理由を入れる)
+    // 生成中の先読みはフロアの中身が階ごとのシードだけで決まるので、そのまま使い続ける
+    bool restoreSnapshot(const Snapshot& snapshot, std::string& error) {
+        if (snapshot.seed != rngs.seed() || snapshot.width != mazeWidth || snapshot.height != mazeHeight
+            || snapshot.floor_count != numFloors || snapshot.monsters_per_floor != monsterCount
+            || snapshot.chase_radius != chaseRadius || snapshot.algorithm != mazeAlgorithm
+            || snapshot.chunked != chunkedFloors) {
+            error = "スナップショットとゲームの設定が一致しません";
+            return false;
+        }
+        if (!snapshot.saved_floors.empty() && snapshot.save_file != saveFile.get()) {
+            error = "セーブファイルから読み込みきっていないスナップショットは、同じゲームにしか戻せません";
+            return false;
+        }
 
-        monster.hp = 40 + floor_bonus_hp + (rand() % 30);
-        monster.base_attack = 10 + floor_bonus_attack + (rand() % 10);
+        floors = snapshot.floors;
+        floorDeltas = snapshot.floor_deltas;
+        savedFloors = snapshot.saved_floors;
+        player = snapshot.player;
+        currentFloor = snapshot.current_floor;
+        playerX = snapshot.player_x;
+        playerY = snapshot.player_y;
+        battle = snapshot.battle;
+        battleCount = snapshot.battle_count;
+        tickCount = snapshot.tick_count;
+        stepCount = snapshot.step_count;
+        floorUseCounter = snapshot.floor_use_counter;
+        floorsGenerated = snapshot.floors_generated;
+        quitRequested = snapshot.quit_requested;
+        fullFloor = snapshot.full_floor;
+        stepKeys.clear();
+        messageLog.clear();
+        // 戻した視界は差分の系列は同じでも回数が巻き戻るので、霧は次の表示で調べ直す
+        fogLayer.lineage = 0;
+
+        auto active = floors.find(currentFloor);
+        activeFloor = active != floors.end() ? active->second.get() : nullptr;
+        activeShared = true;
+        return true;
+    }
 
-        std::cout << "モンスターHP: " << monster.hp << ", 攻撃力: " << monster.base_attack << std::endl;
+    // floor_num 階の出口 (上り階段、最上階ならゴール) から各セルまでの歩数 (自動プレイの評価用)
+    // 地形は階ごとのシードだけで決まるので、ゲームの状態によらない。チャンク分割したフロアには使えない
+    DistanceField exitDistances(int floor_num) const {
+        Floor floor = generateMazeFloor(floor_num);
+        bool top = numFloors > 0 && floor_num == numFloors;
+        int exit_x = top ? mazeWidth - 2 : floor.up_stair_x;
+        int exit_y = top ? mazeHeight - 2 : floor.up_stair_y;
+        DistanceField field;
+        if (exit_x >= 0) {
+            field.track(floor.walls(), exit_x, exit_y);
+        }
+        return field;
+    }
 
-        int player_total_attack = player.base_attack + player.equipped_weapon.attack_bonus;
+    // --- セーブとロード ---
+    // 書き出すフロア:
+    //   メモリ上の変わったフロア → グリッドと壁ビットマップごと (再開時に生成し直さずに写すだけで済む)
+    //   差分として持っているフロア → シードと差分だけ (地形は階ごとのシードから作り直せる)
+    //   セーブファイルからまだ読み込んでいないフロア → 読み込んだときの形のまま
+    // 一度も入っておらず、ワールドティックでも動かしていないフロアは書かない
+
+    // 現在の状態を path に書き出す (失敗したら false)
+    // チャンク分割したフロアはまだこの形式で表せないので書き出さない
+    bool saveGame(const char* path) const {
+        if (chunkedFloors) {
+            return false;
+        }
+        SaveWriter writer;
+        writer.reserve(sizeof(SaveHeader));
+        size_t floor_count = savedFloors.size() + floorDeltas.size();
+        for (const auto& cached : floors) {
+            floor_count += cached.second->modified ? 1 : 0;
+        }
+        uint64_t table_offset = writer.reserve(floor_count * sizeof(SavedFloor));
+        std::vector<SavedFloor> table;
+        table.reserve(floor_count);
+
+        // モンスター・グリッド・壁を書き、索引の1件を作る (grid が nullptr ならシードだけのフロア)
+        auto write_floor = [&](int floor_num, const std::vector<MonsterEntity>& monsters, uint64_t rng_position,
+                               const Floor* stairs, const char* grid, const uint64_t* walls) {
+            SavedFloor record = {};
+            record.floor_num = floor_num;
+            record.kind = grid ? SAVED_FLOOR_FULL : SAVED_FLOOR_SEED_ONLY;
+            record.up_stair_x = stairs ? stairs->up_stair_x : -1;
+            record.up_stair_y = stairs ? stairs->up_stair_y : -1;
+            record.down_stair_x = stairs ? stairs->down_stair_x : -1;
+            record.down_stair_y = stairs ? stairs->down_stair_y : -1;
+            record.monster_rng_position = rng_position;
+            record.monster_count = static_cast<uint32_t>(monsters.size());
+
+            std::vector<SavedMonster> packed(monsters.size());
+            for (size_t i = 0; i < monsters.size(); ++i) {
+                packed[i] = { monsters[i].x, monsters[i].y, monsters[i].hp, monsters[i].attack,
+                              static_cast<uint8_t>(monsters[i].state), 0 };
+            }
+            record.monsters_offset = writer.append(packed.data(), packed.size() * sizeof(SavedMonster));
+            if (grid) {
+                size_t cells = static_cast<size_t>(mazeWidth) * mazeHeight;
+                record.grid_offset = writer.append(grid, cells);
+                record.walls_offset = writer.append(walls, (cells + 63) / 64 * sizeof(uint64_t));
+            }
+            record.payload_end = writer.size();
+            table.push_back(record);
+        };
+
+        for (const auto& cached : floors) {
+            const Floor& floor = *cached.second;
+            if (floor.modified) {
+                Grid marked = floor.markedGrid();
+                write_floor(cached.first, floor.monsters, floor.monster_rng.position(), &floor,
+                            marked.data(), floor.walls().words());
+            }
+        }
+        for (const auto& delta : floorDeltas) {
+            write_floor(delta.first, delta.second->monsters, delta.second->monster_rng_position, nullptr, nullptr, nullptr);
+        }
+        for (const auto& saved : savedFloors) {
+            const SavedFloor& record = *saved.second;
+            if (!savedFloorIntact(record)) {
+                continue;
+            }
+            Floor stairs;
+            stairs.up_stair_x = record.up_stair_x;
+            stairs.up_stair_y = record.up_stair_y;
+            stairs.down_stair_x = record.down_stair_x;
+            stairs.down_stair_y = record.down_stair_y;
+            FloorDelta delta = savedDelta(record);
+            bool full = record.kind == SAVED_FLOOR_FULL;
+            const unsigned char* base = saveFile->data();
+            write_floor(saved.first, delta.monsters, delta.monster_rng_position, &stairs,
+                        full ? reinterpret_cast<const char*>(base + record.grid_offset) : nullptr,
+                        full ? reinterpret_cast<const uint64_t*>(base + record.walls_offset) : nullptr);
+        }
 
-        while (player.hp > 0 && monster.hp > 0) {
-            int playerDamage = rand() % player_total_attack + 1;
-            monster.hp -= playerDamage;
-            std::cout << "プレイヤーの攻撃！モンスターに " << playerDamage << " ダメージを与えた。(残りHP: " << monster.hp << ")" << std::endl;
+        for (SavedFloor& record : table) {
+            record.checksum = savedFloorChecksum(writer.at(0), record);
+        }
+        if (!table.empty()) {
+            std::memcpy(writer.at(table_offset), table.data(), table.size() * sizeof(SavedFloor));
+        }
 
-            if (monster.hp <= 0) {
-                std::cout << "モンスターを倒した！" << std::endl;
-                handleWeaponDrop();
-                return true;
+        SaveHeader header = {};
+        std::memcpy(header.magic, SAVE_MAGIC, sizeof(SAVE_MAGIC));
+        header.version = SAVE_VERSION;
+        header.endian_mark = SAVE_ENDIAN_MARK;
+        header.header_size = sizeof(SaveHeader);
+        header.floor_count = static_cast<uint32_t>(table.size());
+        header.file_size = writer.size();
+        header.floor_table_offset = table_offset;
+        header.seed = rngs.seed();
+        header.width = mazeWidth;
+        header.height = mazeHeight;
+        header.floors = numFloors;
+        header.monsters_per_floor = monsterCount;
+        header.chase_radius = chaseRadius;
+        header.maze_algorithm = static_cast<int32_t>(mazeAlgorithm);
+        header.current_floor = currentFloor;
+        header.player_x = playerX;
+        header.player_y = playerY;
+        header.player_hp = player.hp;
+        header.player_base_attack = player.base_attack;
+        header.weapon_index = -1;
+        for (size_t i = 0; i < availableWeapons.size(); ++i) {
+            if (availableWeapons[i].name == player.equipped_weapon.name) {
+                header.weapon_index = static_cast<int32_t>(i);
             }
+        }
+        header.weapon_bonus = player.equipped_weapon.attack_bonus;
+        header.battle_count = battleCount;
+        header.tick_count = tickCount;
+        header.step_count = stepCount;
+        header.checksum = saveChecksum(&header, sizeof(header));
+        header.checksum = saveChecksum(writer.at(table_offset), table.size() * sizeof(SavedFloor), header.checksum);
+        std::memcpy(writer.at(0), &header, sizeof(header));
+
+        return writer.writeTo(path);
+    }
 
-            int monsterDamage = rand() % monster.base_attack + 1;
-            player.hp -= monsterDamage;
-            std::cout << "モンスターの攻撃！プレイヤーは " << monsterDamage << " ダメージを受けた。(残りHP: " << player.hp << ")" << std::endl;
+    // openSaveFile で開いたファイルから状態を戻す (ゲームは同じファイルの設定で作っておく)
+    // ファイルは mmap したまま持ち、ここでは索引だけを確かめる
+    // 各フロアは初めて必要になったときにチェックサムを確かめて写す
+    bool restore(std::unique_ptr<MappedFile> file, std::string& error) {
+        const SaveHeader& header = *reinterpret_cast<const SaveHeader*>(file->data());
+        if (header.seed != rngs.seed() || header.width != mazeWidth || header.height != mazeHeight
+            || header.floors != numFloors || header.monsters_per_floor != monsterCount
+            || header.chase_radius != chaseRadius
+            || header.maze_algorithm != static_cast<int32_t>(mazeAlgorithm)) {
+            error = "セーブファイルとゲームの設定が一致しません";
+            return false;
+        }
 
-            if (player.hp <= 0) {
+        std::map<int, const SavedFloor*> table;
+        const SavedFloor* records = savedFloorTable(*file, header);
+        for (uint32_t i = 0; i < header.floor_count; ++i) {
+            if (!savedFloorInRange(*file, records[i]) || !table.emplace(records[i].floor_num, &records[i]).second) {
+                error = "セーブファイルのフロアの索引が不正です";
                 return false;
             }
+        }
+        // 現在のフロアは再開してすぐに使うので、ここで本体も確かめる
+        auto current = table.find(header.current_floor);
+        if (current != table.end() && savedFloorChecksum(file->data(), *current->second) != current->second->checksum) {
+            error = "セーブファイルの現在のフロアが壊れています (チェックサム不一致)";
+            return false;
+        }
+        if (current == table.end() || current->second->kind != SAVED_FLOOR_FULL
+            || header.player_x < 0 || header.player_x >= mazeWidth
+            || header.player_y < 0 || header.player_y >= mazeHeight || header.player_hp <= 0
+            || header.weapon_index < -1 || header.weapon_index >= static_cast<int32_t>(availableWeapons.size())) {
+            error = "セーブファイルのプレイヤーの状態が不正です";
+            return false;
+        }
 
-#ifdef _WIN32
-            Sleep(500);
-#else
-            usleep(500000);
-#endif
+        pendingFloors.clear();
+        floors.clear();
+        floorDeltas.clear();
+        activeFloor = nullptr;
+        activeShared = false;
+        savedFloors.swap(table);
+        saveFile = std::move(file);
+
+        currentFloor = header.current_floor;
+        playerX = header.player_x;
+        playerY = header.player_y;
+        player.hp = header.player_hp;
+        player.base_attack = header.player_base_attack;
+        if (header.weapon_index >= 0) {
+            player.equipped_weapon = availableWeapons[header.weapon_index];
         }
-        return false;
+        else {
+            player.equipped_weapon = { NAME_BARE_HANDS, 0 };
+        }
+        player.equipped_weapon.attack_bonus = header.weapon_bonus;
+        battleCount = header.battle_count;
+        tickCount = header.tick_count;
+        stepCount = header.step_count;
+        return true;
     }
 
-    // 武器ドロップと装備処理
-    void handleWeaponDrop() {
-        if (rand() % 100 < 50) {
-            int weapon_index = rand() % availableWeapons.size();
-            Weapon dropped_weapon = availableWeapons[weapon_index];
+    // ゲームループ
+    // 端末は1回だけ raw モードにし、poll() で入力を待ちながら固定のティックで進める
+    // 何も進行していないときは次のキーまで待ち続けるので、待機中に CPU を使わない
+    void run() {
+        enterFloor(currentFloor);
 
-            std::cout << "\n\033[32m新しい武器を獲得しました: " << dropped_weapon.name
-                << " (攻撃力+" << dropped_weapon.attack_bonus << ")\033[0m" << std::endl;
+        RawTerminal terminal;
+        KeyReader input;
+        std::vector<char> keys;
+        const std::chrono::milliseconds tick_interval(tickMs);
+        auto next_tick = std::chrono::steady_clock::now();
+        bool dirty = true;
 
-            if (dropped_weapon.attack_bonus > player.equipped_weapon.attack_bonus) {
-                std::cout << "\033[36m" << dropped_weapon.name << " を装備しました。\033[0m" << std::endl;
-                player.equipped_weapon = dropped_weapon;
+        while (true) {
+            if (dirty) {
+                markPlayer();
+                displayMaze();
+                dirty = false;
             }
-            else {
-                std::cout << "現在装備中の " << player.equipped_weapon.name << " の方が強力です。" << std::endl;
+
+            // ゲーム終了条件
+            if (player.hp <= 0) {
+                renderer.finish();
+                std::cout << "ゲームオーバー！プレイヤーは力尽きました。" << std::endl;
+                break;
+            }
+
+            // 最上階のゴールに到達した場合
+            if (reachedGoal()) {
+                renderer.finish();
+                std::cout << "おめでとうございます！ダンジョンをクリアしました！" << std::endl;
+                break;
+            }
+
+            if (quitRequested || (input.eof() && keys.empty() && !battle.active)) {
+                renderer.finish();
+                std::cout << "ゲームを終了します。" << std::endl;
+                break;
+            }
+
+            // 次のティックまで入力を待つ。進行中のものがなければキーが来るまで待つ
+            bool waiting_for_tick = battle.active || monsterTicks > 0 || !keys.empty();
+            int timeout_ms = -1;
+            if (waiting_for_tick) {
+                auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    next_tick - std::chrono::steady_clock::now());
+                timeout_ms = static_cast<int>(std::max<std::chrono::milliseconds::rep>(0, remaining.count()));
+            }
+            if (keys.size() >= KEY_QUEUE_LIMIT) {
+                // 読まずに残した入力は OS のバッファで待たせる
+                std::this_thread::sleep_until(next_tick);
+            }
+            else if (input.poll(timeout_ms, keys) > 0 && !waiting_for_tick) {
+                // 待機中に来たキーはすぐに処理する
+                next_tick = std::chrono::steady_clock::now();
+            }
+
+            auto now = std::chrono::steady_clock::now();
+            if (now < next_tick) {
+                continue;
+            }
+            next_tick += tick_interval;
+            if (next_tick < now) {
+                // 描画などで遅れたら追いつこうとせず、ここから数え直す
+                next_tick = now + tick_interval;
             }
+            dirty |= updateTick(keys);
         }
     }
 
-    // --- プレイヤーの移動とキー入力 ---
-    void movePlayer(char key) {
-        int nextX = playerX;
-        int nextY = playerY;
+    // 画面もキーボードも使わずに入力列を最後まで実行する
+    // follow_ticks が true なら記録されたティックどおりに (リプレイ)、
+    // false なら戦闘などの待ちがないときに1キーずつ (スクリプト) 与える
+    // 待ち時間は取らず、ティックは実時間と関係なく進める
+    HeadlessReport runHeadless(const std::vector<ReplayInput>& inputs, bool follow_ticks, uint64_t end_tick = 0) {
+        HeadlessReport report = {};
+        auto start = std::chrono::steady_clock::now();
+        enterFloor(currentFloor);
+        auto loop_start = std::chrono::steady_clock::now();
+
+        profile = PhaseProfile();
+        profile.enabled = true;
+        std::vector<char> keys;
+        size_t next = 0;
+
+        while (!quitRequested && player.hp > 0 && !reachedGoal()) {
+            // 戦闘中はラウンドの間のティックで何も起きない (キーも溜まるだけ) ので飛ばす
+            if (battle.active && battle.next_round_tick > tickCount + 1) {
+                tickCount = battle.next_round_tick - 1;
+            }
 
-        // WASDまたは矢印キーによる移動
-        switch (key) {
-            // WASD
-        case 'w': case 'W': nextY--; break;
-        case 's': case 'S': nextY++; break;
-        case 'a': case 'A': nextX--; break;
-        case 'd': case 'D': nextX++; break;
-
-            // 矢印キー (OS依存)
-#ifdef _WIN32
-        case KEY_UP: nextY--; break;
-        case KEY_DOWN: nextY++; break;
-        case KEY_LEFT: nextX--; break;
-        case KEY_RIGHT: nextX++; break;
-#else
-        case ARROW_UP: nextY--; break;
-        case ARROW_DOWN: nextY++; break;
-        case ARROW_LEFT: nextX--; break;
-        case ARROW_RIGHT: nextX++; break;
-#endif
+            bool idle = !battle.active && keys.empty();
+            if (follow_ticks) {
+                // ターン制で何も進行していなければ、空のティックは状態を変えないので飛ばす
+                if (idle && monsterTicks == 0) {
+                    uint64_t target = next < inputs.size() ? inputs[next].tick : end_tick;
+                    if (target > tickCount + 1) {
+                        tickCount = target - 1;
+                    }
+                }
+                while (next < inputs.size() && inputs[next].tick <= tickCount + 1) {
+                    keys.push_back(inputs[next++].key);
+                }
+            }
+            else if (idle && next < inputs.size()) {
+                keys.push_back(inputs[next++].key);
+            }
 
-        case 'q': case 'Q':
-            std::cout << "ゲームを終了します。" << std::endl;
-            exit(0);
+            if (next >= inputs.size() && keys.empty() && !battle.active && tickCount >= end_tick) {
+                break;
+            }
+            updateTick(keys);
+            markPlayer();
         }
 
-        // 移動先のチェック
-        if (nextX >= 0 && nextX < MAZE_WIDTH && nextY >= 0 && nextY < MAZE_HEIGHT) {
-            std::vector<std::vector<char>>& current_maze = floors[currentFloor - 1].maze_data;
-            char target = current_maze[nextY][nextX];
+        auto end = std::chrono::steady_clock::now();
+        report.steps = stepCount;
+        report.ticks = tickCount;
+        report.battles = battleCount;
+        report.generation_seconds = std::chrono::duration<double>(loop_start - start).count();
+        report.seconds = std::chrono::duration<double>(end - loop_start).count();
+        for (int i = 0; i < PHASE_COUNT; ++i) {
+            report.phase_seconds[i] = std::chrono::duration<double>(profile.total[i]).count();
+        }
+        report.state_hash = stateHash();
+        report.floors_generated = floorsGenerated;
+        report.floors_cached = floors.size();
+        report.floor_deltas = floorDeltas.size();
+        report.outcome = player.hp <= 0 ? "ゲームオーバー" : reachedGoal() ? "クリア" : fullFloor ? "満杯のフロア"
+                       : quitRequested ? "終了" : "入力の終わり";
+        profile.enabled = false;
+        return report;
+    }
 
-            // プレイヤーが移動元のマスをリセットする
-            resetPlayerPosition(current_maze);
+private:
+    // ベンチマーク (bench.cpp) から内部の処理を直接呼ぶ
+    friend struct MazeGameBench;
+
+    // 階段で別の階へ移るモンスター (ワールドティックの送り箱の1件)
+    // monster の座標は元の階の階段のセル (行き先が決まるまで元の階で占有したままにする)
+    struct StairTraveler {
+        MonsterEntity monster;
+        bool upward;  // 上り階段なら true
+    };
+
+    // ワールドティックのフロア1つ分
+    struct WorldSlot {
+        int floor_num = 0;
+        Floor* floor = nullptr;
+        int up = -1, down = -1;              // 上下の階の worldSlots の添字 (読み込まれていなければ -1)
+        std::vector<StairTraveler> outbox;   // このティックに階段を使ったモンスター
+    };
+
+    // 霧のモードで描くビューポートの各セルの見え方 (FOG_UNSEEN / FOG_EXPLORED / FOG_VISIBLE)
+    // 視界の差分 (revealed / hidden) で更新し、ビューポートが動いたら新しく入った端だけを調べる
+    struct FogLayer {
+        std::vector<uint8_t> cells;
+        std::vector<uint8_t> scratch;          // ビューポートが動いたときの組み直し用
+        int origin_x = 0, origin_y = 0;
+        int columns = 0, rows = 0;
+        uint64_t lineage = 0, version = 0;     // 写している視界 (lineage 0 は何も写していない)
+    };
+    static constexpr uint8_t FOG_UNSEEN = 0;
+    static constexpr uint8_t FOG_EXPLORED = 1;
+    static constexpr uint8_t FOG_VISIBLE = 2;
+
+    // 読み込み済みのフロア (階 -> フロア)
+    // スナップショットと共有していることがあるので、書き換える前に ownFloor で自分だけのものにする
+    // (activeFloor が共有されている間は activeShared が true)
+    std::map<int, std::shared_ptr<Floor>> floors;
+    // 追い出した変わったフロアの差分 (階 -> 差分)。作った後は書き換えないので、スナップショットとそのまま共有する
+    std::map<int, std::shared_ptr<const FloorDelta>> floorDeltas;
+    // 裏で生成中のフロア (階 -> 結果)
+    std::map<int, std::future<Floor>> pendingFloors;
+    // セーブファイルにあってまだ読み込んでいないフロア (階 -> saveFile の中の索引)
+    std::map<int, const SavedFloor*> savedFloors;
+    std::unique_ptr<MappedFile> saveFile;
+    Floor* activeFloor;
+    bool activeShared;
+    uint64_t floorUseCounter;
+    uint64_t floorsGenerated;
+    Extent<W> mazeWidth;
+    Extent<H> mazeHeight;
+    bool chunkedFloors;
+    MazeAlgorithm mazeAlgorithm;
+    int autoBattlePermille;
+    int fogRadius;
+    int worldRadius;
+    unsigned workerThreads;
+    BattleOddsCache battleOdds{ MAX_HP };
+    Extent<Floors> numFloors;
+    int monsterCount;
+    int chaseRadius;
+    RngService rngs;
+    uint64_t battleCount;
+    EventSink* events;
+    TextEventSink textSink{ formatMazeEvent };
+    NullEventSink nullSink;
+    TerminalRenderer renderer;
+    FogLayer fogLayer;
+    std::vector<std::string> messageLog;
+    BattleState battle;
+    bool quitRequested;
+    int fullFloor;
+    uint64_t tickCount;
+    uint64_t stepCount;
+    std::vector<ReplayInput>* recorder;
+    std::vector<char> stepKeys;     // stepKey で処理中のキー
+    PhaseProfile profile;
+    int tickMs, monsterTickMs;
+    int battleRoundTicks, monsterTicks;
+    int currentFloor;
+    int playerX, playerY;
+    Character player;
+    std::vector<Weapon> availableWeapons;
+    std::vector<WorldSlot> worldSlots;  // ワールドティックのフロアごとの作業場所 (送り箱の領域を使い回す)
+    // ワールドティックでフロアを並行に進めるスレッド (parallelFor の間だけ使う)
+    std::unique_ptr<ThreadPool> worldPool;
+    // 先読み用のスレッド。生成中のタスクが this を使うので、最初に破棄されるよう最後に置く
+    std::unique_ptr<ThreadPool> prefetchPool;
 
-            if (target == ' ' || target == 'S' || target == 'E') {
-                updatePlayerPosition(nextX, nextY);
-                recoverHP();
-            }
-            else if (target == 'M') {
-                // モンスターとの戦闘
-                bool result = startBattle();
-                if (result) {
-                    // 勝利した場合
-                    // モンスターがいた場所を通路に戻す
-                    current_maze[nextY][nextX] = ' ';
-                    updatePlayerPosition(nextX, nextY);
-                    recoverHP();
-                }
-                else {
-                    // 戦闘敗北時は移動しないため、リセットした場所にプレイヤーを再描画する
-                    current_maze[playerY][playerX] = 'P';
+    // --- 武器リストの初期化 ---
+    void initializeWeapons() {
+        availableWeapons = defaultWeapons();
+    }
+
+    // --- フロアのキャッシュ ---
+    // フロアは初めて必要になったときに生成し、FLOOR_CACHE_LIMIT を超えたら
+    // 最も長く使っていないものを追い出す。変わったフロアは差分だけを残し、
+    // 次に必要になったらシードから作り直して差分を当てる
+    // 各フロアはマスターシードから導出した専用のシードだけで決まるので、
+    // どのスレッドでいつ生成しても同じダンジョンになる
+
+    Floor& currentFloorData() { return *activeFloor; }
+    const Floor& currentFloorData() const { return *activeFloor; }
+
+    // floor_num 階を読み込む (キャッシュ → セーブファイル → 先読みの結果 → 生成 の順に探す)
+    Floor& loadFloor(int floor_num) {
+        auto cached = floors.find(floor_num);
+        if (cached == floors.end()) {
+            // 本体が壊れているフロアはセーブファイルになかったものとして作り直す
+            const SavedFloor* record = nullptr;
+            auto saved = savedFloors.find(floor_num);
+            if (saved != savedFloors.end()) {
+                if (savedFloorIntact(*saved->second)) {
+                    record = saved->second;
                 }
+                savedFloors.erase(saved);
             }
-            else if (target == 'U' && currentFloor < NUM_FLOORS) {
-                gotoNextFloor();
+
+            Floor floor;
+            auto pending = pendingFloors.find(floor_num);
+            if (record && record->kind == SAVED_FLOOR_FULL) {
+                floor = savedTerrain(*record);
             }
-            else if (target == 'D' && currentFloor > 1) {
-                gotoPreviousFloor();
+            else if (pending != pendingFloors.end()) {
+                floor = pending->second.get();
+                pendingFloors.erase(pending);
+                ++floorsGenerated;
             }
             else {
-                // 壁 ('#') やその他の無効な移動
-                // リセットした場所にプレイヤーを再描画する
-                current_maze[playerY][playerX] = 'P';
+                floor = generateMazeFloor(floor_num);
+                ++floorsGenerated;
+            }
+
+            auto delta = floorDeltas.find(floor_num);
+            if (record) {
+                floor.applyDelta(savedDelta(*record));
+            }
+            else if (delta != floorDeltas.end()) {
+                floor.applyDelta(*delta->second);
+                floorDeltas.erase(delta);
             }
+            cached = floors.emplace(floor_num, std::make_shared<Floor>(std::move(floor))).first;
         }
+        Floor& floor = ownFloor(cached->second);
+        floor.last_used = ++floorUseCounter;
+        return floor;
     }
 
-    // プレイヤーの位置を更新
-    void updatePlayerPosition(int newX, int newY) {
-        playerX = newX;
-        playerY = newY;
+    // floor を他 (スナップショット) と共有していれば複製して差し替え、自分だけのものにして返す (copy-on-write)
+    // 複製しても地形は共有し、変わる層はページ単位で共有する (BasicMazeFloor のコメント)
+    Floor& ownFloor(std::shared_ptr<Floor>& floor) {
+        if (floor.use_count() > 1) {
+            floor = std::make_shared<Floor>(*floor);
+        }
+        return *floor;
     }
 
-    // 移動前のP表示をリセットする
-    void resetPlayerPosition(std::vector<std::vector<char>>& current_maze) {
-        char cell_at_current_pos = current_maze[playerY][playerX];
+    // 現在のフロアを書き換える前に呼ぶ (スナップショットを取った・戻した後の最初の1回だけ複製する)
+    void ownActiveFloor() {
+        if (activeShared && activeFloor) {
+            activeFloor = &ownFloor(floors[currentFloor]);
+        }
+        activeShared = false;
+    }
 
-        // プレイヤーがいた場所がスタートマス ('S') でなければ、通路 (' ') に戻す
-        if (cell_at_current_pos != 'S') {
-            current_maze[playerY][playerX] = ' ';
+    // floor_num 階を現在のフロアにし、次の階を先読みして、キャッシュを整理する
+    Floor& enterFloor(int floor_num) {
+        activeFloor = &loadFloor(floor_num);
+        activeFloor->modified = true;
+        checkFloorFull();
+        if (worldRadius > 0) {
+            loadWorld();
         }
+        prefetchFloor(floor_num + 1);
+        trimFloorCache();
+        return *activeFloor;
+    }
 
-        // 階段の上にいる場合は元の階段表示に戻す
-        MazeFloor& current_floor_data = floors[currentFloor - 1];
-        if (playerX == current_floor_data.up_stair_x && playerY == current_floor_data.up_stair_y) {
-            current_maze[playerY][playerX] = 'U';
+    // ワールドティックで動かす階 (現在の階から worldRadius 階以内) をすべて読み込む
+    // まだ生成していない階は先読みと同じく pendingFloors に置き、worldPool で並行に生成してから読み込む
+    void loadWorld() {
+        int first = std::max(1, currentFloor - worldRadius);
+        int last = numFloors > 0 ? std::min<int>(currentFloor + worldRadius, numFloors) : currentFloor + worldRadius;
+        std::vector<int> missing;
+        for (int floor_num = first; floor_num <= last; ++floor_num) {
+            auto saved = savedFloors.find(floor_num);
+            if (!floors.count(floor_num) && !pendingFloors.count(floor_num)
+                && (saved == savedFloors.end() || saved->second->kind != SAVED_FLOOR_FULL)) {
+                missing.push_back(floor_num);
+            }
         }
-        else if (playerX == current_floor_data.down_stair_x && playerY == current_floor_data.down_stair_y) {
-            current_maze[playerY][playerX] = 'D';
+        std::vector<std::promise<Floor>> promises(missing.size());
+        for (size_t i = 0; i < missing.size(); ++i) {
+            pendingFloors.emplace(missing[i], promises[i].get_future());
+        }
+        forEachFloorTask(missing.size(), [this, &missing, &promises](size_t i) {
+            promises[i].set_value(generateMazeFloor(missing[i]));
+        });
+        for (int floor_num = first; floor_num <= last; ++floor_num) {
+            loadFloor(floor_num);
+        }
+    }
+
+    // ワールドティックで読み込んだままにする階か
+    bool inWorld(int floor_num) const {
+        return worldRadius > 0 && std::abs(floor_num - currentFloor) <= worldRadius;
+    }
+
+    // [0, count) の各 i について fn(i) を worldPool で並行に実行し、全て終わるまで待つ
+    // (スレッドがなければこのスレッドで順に実行する)
+    template <class Fn>
+    void forEachFloorTask(size_t count, Fn fn) {
+        if (worldPool) {
+            worldPool->parallelFor(count, fn);
+            return;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            fn(i);
+        }
+    }
+
+    // 今のフロアに置けなかった階段やモンスターがあればゲームを止める
+    // (空きセルより多くは置けないので、満杯のフロアは設定の誤りとして扱う)
+    void checkFloorFull() {
+        if (activeFloor->unplaced > 0 && fullFloor == 0) {
+            fullFloor = currentFloor;
+            quitRequested = true;
+        }
+    }
+
+    // floor_num 階を裏のスレッドで生成し始める (読み込み済み・生成中なら何もしない)
+    void prefetchFloor(int floor_num) {
+        auto saved = savedFloors.find(floor_num);
+        if (!prefetchPool || (numFloors > 0 && floor_num > numFloors)
+            || floors.count(floor_num) || pendingFloors.count(floor_num)
+            || (saved != savedFloors.end() && saved->second->kind == SAVED_FLOOR_FULL)) {
+            return;
+        }
+        auto promise = std::make_shared<std::promise<Floor>>();
+        pendingFloors.emplace(floor_num, promise->get_future());
+        // generateMazeFloor は生成後に変わらないメンバーしか読まないので、並行に呼んでよい
+        prefetchPool->enqueue([this, promise, floor_num] {
+            promise->set_value(generateMazeFloor(floor_num));
+        });
+    }
+
+    // 現在のフロアから離れた先読みを捨て、上限を超えたフロアを追い出す
+    void trimFloorCache() {
+        for (auto it = pendingFloors.begin(); it != pendingFloors.end();) {
+            if (std::abs(it->first - currentFloor) > 1) {
+                it = pendingFloors.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+
+        // ワールドティックで動かしている階は追い出さない (その分だけ上限を超えてよい)
+        while (floors.size() > FLOOR_CACHE_LIMIT) {
+            auto victim = floors.end();
+            for (auto it = floors.begin(); it != floors.end(); ++it) {
+                if (it->second.get() != activeFloor && !inWorld(it->first)
+                    && (victim == floors.end() || it->second->last_used < victim->second->last_used)) {
+                    victim = it;
+                }
+            }
+            if (victim == floors.end()) {
+                break;
+            }
+            if (victim->second->modified) {
+                floorDeltas[victim->first] = std::make_shared<const FloorDelta>(victim->second->makeDelta());
+            }
+            floors.erase(victim);
+        }
+    }
+
+    // --- セーブファイルのフロア ---
+
+    // 索引の1件がファイルの中に収まっているか (restore で全件を確かめる)
+    bool savedFloorInRange(const MappedFile& file, const SavedFloor& record) const {
+        if (record.floor_num < 1 || (numFloors > 0 && record.floor_num > numFloors)
+            || (record.kind != SAVED_FLOOR_FULL && record.kind != SAVED_FLOOR_SEED_ONLY)
+            || record.monsters_offset % 8 != 0 || record.payload_end < record.monsters_offset
+            || !file.contains(record.monsters_offset, record.payload_end - record.monsters_offset)) {
+            return false;
+        }
+        // 各部分が本体 [monsters_offset, payload_end) の中にあるか
+        auto inside = [&record](uint64_t offset, uint64_t size) {
+            return offset >= record.monsters_offset && offset <= record.payload_end
+                && size <= record.payload_end - offset;
+        };
+        if (!inside(record.monsters_offset, uint64_t(record.monster_count) * sizeof(SavedMonster))) {
+            return false;
+        }
+        if (record.kind == SAVED_FLOOR_SEED_ONLY) {
+            return true;
+        }
+        uint64_t cells = static_cast<uint64_t>(mazeWidth) * mazeHeight;
+        return record.walls_offset % 8 == 0 && inside(record.grid_offset, cells)
+            && inside(record.walls_offset, (cells + 63) / 64 * sizeof(uint64_t))
+            && record.up_stair_x < mazeWidth && record.up_stair_y < mazeHeight
+            && record.down_stair_x < mazeWidth && record.down_stair_y < mazeHeight;
+    }
+
+    // 本体のチェックサムが合い、モンスターが迷路の中にいるか
+    bool savedFloorIntact(const SavedFloor& record) const {
+        if (savedFloorChecksum(saveFile->data(), record) != record.checksum) {
+            return false;
+        }
+        const SavedMonster* monsters = reinterpret_cast<const SavedMonster*>(saveFile->data() + record.monsters_offset);
+        for (uint32_t i = 0; i < record.monster_count; ++i) {
+            if (monsters[i].x < 0 || monsters[i].x >= mazeWidth || monsters[i].y < 0 || monsters[i].y >= mazeHeight) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // 保存されたモンスターと乱数の進み
+    FloorDelta savedDelta(const SavedFloor& record) const {
+        const SavedMonster* saved = reinterpret_cast<const SavedMonster*>(saveFile->data() + record.monsters_offset);
+        FloorDelta delta;
+        delta.monsters.resize(record.monster_count);
+        for (uint32_t i = 0; i < record.monster_count; ++i) {
+            delta.monsters[i] = { saved[i].x, saved[i].y, saved[i].hp, saved[i].attack,
+                                  static_cast<MonsterState>(saved[i].state) };
+        }
+        delta.monster_rng_position = record.monster_rng_position;
+        return delta;
+    }
+
+    // 保存されたグリッドと壁ビットマップを写したフロア (モンスターは savedDelta で当てる)
+    Floor savedTerrain(const SavedFloor& record) const {
+        const unsigned char* base = saveFile->data();
+        std::shared_ptr<Terrain> terrain = std::make_shared<Terrain>();
+        terrain->maze_data.assignData(mazeWidth, mazeHeight, reinterpret_cast<const char*>(base + record.grid_offset));
+        terrain->walls.assignWords(mazeWidth, mazeHeight, reinterpret_cast<const uint64_t*>(base + record.walls_offset));
+        Floor floor;
+        floor.terrain = std::move(terrain);
+        floor.up_stair_x = record.up_stair_x;
+        floor.up_stair_y = record.up_stair_y;
+        floor.down_stair_x = record.down_stair_x;
+        floor.down_stair_y = record.down_stair_y;
+        floor.monster_rng = rngs.stream(RngDomain::MonsterMove, record.floor_num);
+        return floor;
+    }
+
+    // --- 迷路生成 ---
+    // メンバーを書き換えないので、複数のフロアを同時に生成できる
+    Floor generateMazeFloor(int floor_num) const {
+        if constexpr (!kFixedSize) {
+            if (chunkedFloors) {
+                return generateChunkedFloor(floor_num);
+            }
+        }
+        RngStream rng = rngs.stream(RngDomain::FloorGeneration, floor_num);
+        Floor newFloor;
+        newFloor.monster_rng = rngs.stream(RngDomain::MonsterMove, floor_num);
+        // 地形は共有する前のこの関数の中でだけ書き換える
+        std::shared_ptr<Terrain> terrain = std::make_shared<Terrain>();
+        Grid& grid = terrain->maze_data;
+        grid.assign(mazeWidth, mazeHeight, '#');
+
+        carveMaze(grid, rng);
+        terrain->walls.buildFrom(grid, '#');
+        newFloor.terrain = terrain;
+
+        // 空きセルの索引 (スタート・ゴール・階段・モンスターは置いたセルを取り除いていく)
+        newFloor.occupied.reset(mazeWidth, mazeHeight);
+        newFloor.rebuildOccupancy();
+
+        // スタート/ゴール/階段の設定
+        if (floor_num == 1) {
+            grid(1, 1) = 'S';
+            newFloor.free_cells.erase(1, 1);
+            placeStair(newFloor, grid, 'U', newFloor.up_stair_x, newFloor.up_stair_y, rng);
+        }
+        else if (floor_num == numFloors) {
+            // 最上階 (階数 0 の無限ダンジョンには最上階がない)
+            placeStair(newFloor, grid, 'D', newFloor.down_stair_x, newFloor.down_stair_y, rng);
+            grid(mazeWidth - 2, mazeHeight - 2) = 'E';
+            newFloor.free_cells.erase(mazeWidth - 2, mazeHeight - 2);
+        }
+        else {
+            placeStair(newFloor, grid, 'U', newFloor.up_stair_x, newFloor.up_stair_y, rng);
+            placeStair(newFloor, grid, 'D', newFloor.down_stair_x, newFloor.down_stair_y, rng);
+        }
+
+        // モンスターの配置
+        placeMonsters(newFloor, floor_num, rng, monsterCount, newFloor.free_cells);
+
+        return newFloor;
+    }
+
+    // --- チャンク分割したフロアの生成 ---
+    // 各チャンクは (シード, 階, チャンク座標) だけから作るので、どの順に何度作り直しても同じ地形になる
+    // チャンクの中は奇数座標のセルを穴掘り法でつないだ木で、西と北の境目の壁には
+    // そのチャンクが通路を1本ずつ開ける (東と南は隣のチャンクが開ける)
+    // どのチャンクも内部がつながっていて隣とも必ずつながるので、フロア全体がつながる
+    // 階段・スタート・ゴールは奇数座標 (必ず通路になるセル) に置く
+
+    RngStream chunkStream(int floor_num, int cx, int cy) const {
+        return rngs.stream(RngDomain::ChunkGeneration,
+                           static_cast<uint64_t>(floor_num) << 42 | static_cast<uint64_t>(cy) << 21 | cx);
+    }
+
+    // フロアの中のランダムな奇数座標
+    void randomOddCell(RngStream& rng, int& x, int& y) const {
+        x = 1 + 2 * rng.range(0, (mazeWidth - 3) / 2);
+        y = 1 + 2 * rng.range(0, (mazeHeight - 3) / 2);
+    }
+
+    // 階段などの位置だけを決め、到着地点の周りのチャンクを読み込む
+    Floor generateChunkedFloor(int floor_num) const {
+        RngStream rng = rngs.stream(RngDomain::FloorGeneration, floor_num);
+        Floor newFloor;
+        newFloor.chunked = true;
+        newFloor.monster_rng = rngs.stream(RngDomain::MonsterMove, floor_num);
+
+        // ウィンドウを置く前なので、ここではワールド座標がそのままウィンドウの座標になる
+        if (floor_num > 1) {
+            randomOddCell(rng, newFloor.down_stair_x, newFloor.down_stair_y);
+        }
+        if (numFloors == 0 || floor_num < numFloors) {
+            do {
+                randomOddCell(rng, newFloor.up_stair_x, newFloor.up_stair_y);
+            } while ((newFloor.up_stair_x == newFloor.down_stair_x && newFloor.up_stair_y == newFloor.down_stair_y)
+                     || (floor_num == 1 && newFloor.up_stair_x == 1 && newFloor.up_stair_y == 1));
+        }
+
+        int arrival_x = floor_num == 1 ? 1 : newFloor.down_stair_x;
+        int arrival_y = floor_num == 1 ? 1 : newFloor.down_stair_y;
+        placeWindow(newFloor, floor_num, arrival_x, arrival_y);
+        return newFloor;
+    }
+
+    // ワールド座標 (x, y) が中央のチャンクに来るウィンドウの左上 (フロアの端では止める)
+    void windowOriginFor(int x, int y, int& origin_x, int& origin_y) const {
+        int chunks_x = (mazeWidth - 1) / CHUNK_SIZE;
+        int chunks_y = (mazeHeight - 1) / CHUNK_SIZE;
+        origin_x = std::max(0, std::min(x / CHUNK_SIZE - CHUNK_WINDOW / 2, chunks_x + 1 - CHUNK_WINDOW)) * CHUNK_SIZE;
+        origin_y = std::max(0, std::min(y / CHUNK_SIZE - CHUNK_WINDOW / 2, chunks_y + 1 - CHUNK_WINDOW)) * CHUNK_SIZE;
+    }
+
+    // ワールド座標 (center_x, center_y) の周りにウィンドウを移す
+    // 前のウィンドウと重なるチャンクは写し、新しく入るチャンクだけを生成する
+    // 外れるチャンクのモンスターは預け、入るチャンクのモンスターは戻す (初めてなら配置する)
+    void placeWindow(Floor& floor, int floor_num, int center_x, int center_y) const {
+        int origin_x, origin_y;
+        windowOriginFor(center_x, center_y, origin_x, origin_y);
+        bool resident = floor.terrain != nullptr;
+        if (resident && origin_x == floor.origin_x && origin_y == floor.origin_y) {
+            return;
+        }
+
+        const int window_size = CHUNK_SIZE * CHUNK_WINDOW;
+        const int chunks_x = (mazeWidth - 1) / CHUNK_SIZE;
+        const int chunks_y = (mazeHeight - 1) / CHUNK_SIZE;
+        const int shift_x = origin_x - floor.origin_x;
+        const int shift_y = origin_y - floor.origin_y;
+        auto in_window = [window_size](int x, int y) {
+            return x >= 0 && x < window_size && y >= 0 && y < window_size;
+        };
+
+        // ウィンドウに残るモンスターは座標をずらし、外れるものは預ける
+        std::vector<MonsterEntity> staying;
+        for (MonsterEntity monster : floor.monsters) {
+            monster.x -= shift_x;
+            monster.y -= shift_y;
+            if (in_window(monster.x, monster.y)) {
+                staying.push_back(monster);
+            }
+            else {
+                monster.x += origin_x;
+                monster.y += origin_y;
+                floor.parked_monsters[chunkKey(monster.x / CHUNK_SIZE, monster.y / CHUNK_SIZE)].push_back(monster);
+            }
+        }
+
+        // 地形: 前のウィンドウにあったチャンクは写し、それ以外は生成する
+        MazeGrid grid(window_size, window_size, '#');
+        std::vector<std::pair<int, int>> loaded;
+        for (int j = 0; j < CHUNK_WINDOW; ++j) {
+            for (int i = 0; i < CHUNK_WINDOW; ++i) {
+                int cx = origin_x / CHUNK_SIZE + i;
+                int cy = origin_y / CHUNK_SIZE + j;
+                if (cx >= chunks_x || cy >= chunks_y) {
+                    continue;  // フロアの東・南の外側は壁のまま
+                }
+                int old_left = i * CHUNK_SIZE + shift_x;
+                int old_top = j * CHUNK_SIZE + shift_y;
+                if (resident && in_window(old_left, old_top)) {
+                    for (int y = 0; y < CHUNK_SIZE; ++y) {
+                        std::copy_n(floor.grid().row(old_top + y) + old_left, CHUNK_SIZE,
+                                    grid.row(j * CHUNK_SIZE + y) + i * CHUNK_SIZE);
+                    }
+                }
+                else {
+                    generateChunk(grid, i * CHUNK_SIZE, j * CHUNK_SIZE, cx, cy, floor_num);
+                    loaded.push_back({ i, j });
+                }
+            }
+        }
+
+        // 残るセルの印は地形に焼き込む (写したチャンクは印を重ねた文字のまま移す)
+        if (resident) {
+            const int old_width = floor.grid().width();
+            for (const CellMark& mark : floor.marks) {
+                int x = static_cast<int>(mark.index % old_width) - shift_x;
+                int y = static_cast<int>(mark.index / old_width) - shift_y;
+                if (in_window(x, y)) {
+                    grid(x, y) = mark.cell;
+                }
+            }
+        }
+
+        // 階段はウィンドウの座標に直し、新しく入ったチャンクにあれば描き込む
+        auto move_feature = [&](int& x, int& y, bool exists, char type) {
+            if (!exists) {
+                return;
+            }
+            if (resident) {
+                x -= shift_x;
+                y -= shift_y;
+            }
+            else {
+                x -= origin_x;
+                y -= origin_y;
+            }
+            if (in_window(x, y) && grid(x, y) == ' ') {
+                grid(x, y) = type;
+            }
+        };
+        move_feature(floor.up_stair_x, floor.up_stair_y, numFloors == 0 || floor_num < numFloors, 'U');
+        move_feature(floor.down_stair_x, floor.down_stair_y, floor_num > 1, 'D');
+        int start_x = 1, start_y = 1, goal_x = mazeWidth - 2, goal_y = mazeHeight - 2;
+        start_x -= origin_x;
+        start_y -= origin_y;
+        goal_x -= origin_x;
+        goal_y -= origin_y;
+        if (floor_num == 1 && in_window(start_x, start_y) && grid(start_x, start_y) == ' ') {
+            grid(start_x, start_y) = 'S';
+        }
+        if (floor_num == numFloors && in_window(goal_x, goal_y) && grid(goal_x, goal_y) == ' ') {
+            grid(goal_x, goal_y) = 'E';
+        }
+
+        std::shared_ptr<Terrain> terrain = std::make_shared<Terrain>();
+        terrain->maze_data = std::move(grid);
+        terrain->walls.buildFrom(terrain->maze_data, '#');
+        floor.terrain = std::move(terrain);
+        floor.marks.clear();
+        if (resident && floor.player_view.valid()) {
+            floor.player_view.shift(shift_x, shift_y);
+        }
+        floor.origin_x = origin_x;
+        floor.origin_y = origin_y;
+        floor.monsters = std::move(staying);
+        floor.rebuildOccupancy();
+        floor.player_distance = DistanceField();
+
+        // 新しく入ったチャンクのモンスター
+        FreeCellSet chunk_cells;
+        for (const std::pair<int, int>& chunk : loaded) {
+            int cx = origin_x / CHUNK_SIZE + chunk.first;
+            int cy = origin_y / CHUNK_SIZE + chunk.second;
+            uint64_t key = chunkKey(cx, cy);
+            auto parked = floor.parked_monsters.find(key);
+            if (parked != floor.parked_monsters.end()) {
+                for (MonsterEntity monster : parked->second) {
+                    monster.x -= origin_x;
+                    monster.y -= origin_y;
+                    floor.monsters.push_back(monster);
+                    floor.occupy(monster.x, monster.y);
+                }
+                floor.parked_monsters.erase(parked);
+            }
+            else if (floor.populated_chunks.insert(key).second) {
+                // チャンクの中だけから選ぶ (並びはチャンクの地形だけで決まるので、いつ配置しても同じになる)
+                RngStream rng = chunkStream(floor_num, cx, cy).split(1);
+                int left = chunk.first * CHUNK_SIZE;
+                int top = chunk.second * CHUNK_SIZE;
+                chunk_cells.build(left + 1, top + 1, left + CHUNK_SIZE - 1, top + CHUNK_SIZE - 1,
+                                  [&floor](int x, int y) {
+                                      return floor.grid()(x, y) == ' ' && !floor.occupied.test(x, y);
+                                  });
+                placeMonsters(floor, floor_num, rng, monsterCount, chunk_cells);
+            }
+        }
+    }
+
+    // チャンク (cx, cy) の地形を grid の (left, top) から CHUNK_SIZE 四方に書く
+    void generateChunk(MazeGrid& grid, int left, int top, int cx, int cy, int floor_num) const {
+        RngStream rng = chunkStream(floor_num, cx, cy);
+
+        // 東と南の境目の1列も含めた奇数サイズのグリッドで掘る (境目の列は隣のチャンクのもの)
+        MazeGrid chunk(CHUNK_SIZE + 1, CHUNK_SIZE + 1, '#');
+        carveMaze(chunk, rng);
+        if (cx > 0) {
+            chunk(0, 1 + 2 * rng.range(0, CHUNK_SIZE / 2 - 1)) = ' ';
+        }
+        if (cy > 0) {
+            chunk(1 + 2 * rng.range(0, CHUNK_SIZE / 2 - 1), 0) = ' ';
+        }
+
+        for (int y = 0; y < CHUNK_SIZE; ++y) {
+            std::copy_n(chunk.row(y), CHUNK_SIZE, grid.row(top + y) + left);
+        }
+    }
+
+    // プレイヤーが中央のチャンクから出ていたらウィンドウを移す
+    // 座標が変わるのでプレイヤーの位置もずらす (戦闘中は呼ばない)
+    // 固定サイズのゲームでは何もしない (ウィンドウを扱うコードは作らない)
+    void followPlayer() {
+        if constexpr (!kFixedSize) {
+            Floor& floor = currentFloorData();
+            if (!floor.chunked) {
+                return;
+            }
+            int world_x = playerX + floor.origin_x;
+            int world_y = playerY + floor.origin_y;
+            placeWindow(floor, currentFloor, world_x, world_y);
+            playerX = world_x - floor.origin_x;
+            playerY = world_y - floor.origin_y;
+            checkFloorFull();
+        }
+    }
+
+    // 壁で埋めたグリッドに、選んだ生成方法で迷路を掘る (rng は使った分だけ進む)
+    // フロアのグリッドにもチャンクのグリッドにも使う
+    template <class AnyGrid>
+    void carveMaze(AnyGrid& grid, RngStream& rng) const {
+        if (mazeAlgorithm == MazeAlgorithm::Eller) {
+            EllerMaze eller(grid.width(), static_cast<uint64_t>(grid.height()), rng);
+            for (int y = 0; y < grid.height(); ++y) {
+                eller.next(grid.row(y));
+            }
+            rng = eller.rng();
+            return;
+        }
+        dfs(grid, 1, 1, rng);
+    }
+
+    // 明示的なスタックによる穴掘り法 (再帰版と同じ探索順で、深さに上限がない)
+    // グリッドの幅と高さは奇数であることを前提とする
+    template <class AnyGrid>
+    void dfs(AnyGrid& current_maze, int start_x, int start_y, RngStream& g) const {
+        const int width = current_maze.width();
+        const int height = current_maze.height();
+
+        // スタックの1要素: 位置, 選んだ方向の順列, 次に試す方向の添字
+        struct Frame {
+            int x, y;
+            unsigned char order;
+            unsigned char next;
+        };
+
+        std::vector<Frame> stack;
+        stack.reserve(static_cast<size_t>(width / 2) * (height / 2) / 4 + 1);
+
+        current_maze(start_x, start_y) = ' ';
+        stack.push_back({ start_x, start_y, static_cast<unsigned char>(g.below(24)), 0 });
+
+        while (!stack.empty()) {
+            Frame& top = stack.back();
+            if (top.next == 4) {
+                stack.pop_back();
+                continue;
+            }
+
+            int dir = DIRECTION_ORDERS[top.order][top.next++];
+            int x = top.x;
+            int y = top.y;
+            int nx = x + CARVE_DX[dir];
+            int ny = y + CARVE_DY[dir];
+
+            if (nx > 0 && nx < width - 1 && ny > 0 && ny < height - 1) {
+                if (current_maze(nx, ny) == '#') {
+                    current_maze(x + CARVE_DX[dir] / 2, y + CARVE_DY[dir] / 2) = ' ';
+                    current_maze(nx, ny) = ' ';
+                    // push_back で top は無効になる可能性があるので、以降は参照しない
+                    stack.push_back({ nx, ny, static_cast<unsigned char>(g.below(24)), 0 });
+                }
+            }
+        }
+    }
+
+    // --- 階段の配置 ---
+    // 空きセルから1つ選んで階段にする (空きセルがなければ置かずに floor.unplaced に数える)
+    // (grid は floor がまだ共有していない生成中の地形)
+    void placeStair(Floor& floor, Grid& grid, char type, int& stair_x, int& stair_y, RngStream& rng) const {
+        int sx, sy;
+        if (!floor.free_cells.take(rng, sx, sy)) {
+            ++floor.unplaced;
+            return;
+        }
+        grid(sx, sy) = type;
+        stair_x = sx;
+        stair_y = sy;
+    }
+
+    // --- モンスターの配置 ---
+    // 能力値は階層に応じて出現時に決める
+    // candidates (モンスターのいない通路の集合) から count 体分のセルを選んで置く
+    // 1体ごとに O(1) で、足りなければ置けた分だけ置いて残りを floor.unplaced に数える
+    // candidates が floor.free_cells でなくても、置いたセルは floor.free_cells からも取り除く
+    void placeMonsters(Floor& floor, int floor_num, RngStream& rng, int count, FreeCellSet& candidates) const {
+        floor.monsters.reserve(floor.monsters.size() + count);
+
+        // 階層に基づいたモンスターの強化
+        int floor_bonus_hp = (floor_num - 1) * 15;
+        int floor_bonus_attack = (floor_num - 1) * 5;
+
+        for (int placed = 0; placed < count; ++placed) {
+            int mx, my;
+            if (!candidates.take(rng, mx, my)) {
+                floor.unplaced += count - placed;
+                return;
+            }
+            MonsterEntity monster;
+            monster.x = mx;
+            monster.y = my;
+            monster.hp = 40 + floor_bonus_hp + rng.range(0, 29);
+            monster.attack = static_cast<int16_t>(10 + floor_bonus_attack + rng.range(0, 9));
+            monster.state = MonsterState::Wandering;
+
+            floor.monsters.push_back(monster);
+            floor.occupy(mx, my);
+        }
+    }
+
+    // --- モンスターの移動 ---
+    // モンスターの配列だけを走査するので、コストは迷路の広さではなくモンスター数に比例する
+    // 距離場はプレイヤーが動いたターンに1回だけ更新し、全モンスターで共有する
+    // (追跡範囲が有限なら範囲内だけ、無制限なら1歩分の差分更新)
+    void moveMonsters() {
+        moveFloorMonsters(currentFloorData(), true, nullptr);
+    }
+
+    // floor のモンスターを1歩ずつ動かす
+    // with_player ならプレイヤー (playerX, playerY) を追跡し、そうでなければ全員がランダムに歩く
+    // slot があれば、ランダムに歩いて読み込み済みの階へ通じる階段に乗ったモンスターを配列から外して
+    // slot->outbox に移す (セルは占有したままにし、exchangeTravelers で行き先が決まってからどける)
+    // floor と slot 以外には書き込まないので、別々のフロアなら並行に呼んでよい
+    void moveFloorMonsters(Floor& floor, bool with_player, WorldSlot* slot) const {
+        DistanceField& field = floor.player_distance;
+        const auto& walls = floor.walls();
+        if (with_player) {
+            field.track(walls, playerX, playerY, chaseRadius);
+        }
+
+        size_t kept = 0;
+        for (size_t index = 0; index < floor.monsters.size(); ++index) {
+            MonsterEntity& monster = floor.monsters[index];
+            const unsigned char* directions = DIRECTION_ORDERS[floor.monster_rng.below(24)];
+
+            // 追跡範囲内なら距離場で1歩近づくセル、範囲外ならランダムなセルへ移動する
+            uint32_t here = with_player ? field.distance(monster.x, monster.y) : DistanceField::kUnreachable;
+            monster.state = (here != DistanceField::kUnreachable) ? MonsterState::Chasing : MonsterState::Wandering;
+
+            bool moved = false;
+            for (int i = 0; i < 4; ++i) {
+                int dir = directions[i];
+                int next_mx = monster.x + STEP_DX[dir];
+                int next_my = monster.y + STEP_DY[dir];
+
+                // 移動先のチェック
+                // 壁と他のモンスターのいるセル、プレイヤーの位置には移動しない
+                // (通路・階段・スタート・ゴールには移動できる。地形は書き換えない)
+                if (next_mx > 0 && next_mx < walls.width() - 1
+                    && next_my > 0 && next_my < walls.height() - 1
+                    && !walls.test(next_mx, next_my)
+                    && !floor.occupied.test(next_mx, next_my)
+                    && (!with_player || next_mx != playerX || next_my != playerY)) {
+                    if (monster.state == MonsterState::Chasing && field.distance(next_mx, next_my) >= here) {
+                        continue;
+                    }
+                    floor.vacate(monster.x, monster.y);
+                    floor.occupy(next_mx, next_my);
+                    monster.x = next_mx;
+                    monster.y = next_my;
+                    moved = true;
+                    break;
+                }
+            }
+
+            // 追跡していないモンスターは、この歩で乗った階段の先が読み込み済みならその階へ移る
+            // (着いた階段の上からはすぐには戻らない)
+            if (slot && moved && monster.state == MonsterState::Wandering) {
+                bool up = monster.x == floor.up_stair_x && monster.y == floor.up_stair_y && slot->up >= 0;
+                bool down = monster.x == floor.down_stair_x && monster.y == floor.down_stair_y && slot->down >= 0;
+                if (up || down) {
+                    slot->outbox.push_back({ monster, up });
+                    continue;
+                }
+            }
+            floor.monsters[kept++] = monster;
+        }
+        floor.monsters.erase(floor.monsters.begin() + kept, floor.monsters.end());
+    }
+
+    // --- ワールドティック ---
+    // 読み込み済みの全フロアのモンスターを1歩ずつ進める
+    // 各フロアは自分のモンスター・占有の索引・乱数 (monster_rng) だけを使う独立したタスクとして並行に動かし、
+    // 階段で別の階へ移るモンスターはフロアごとの送り箱に積んでおく。全フロアが終わってから、
+    // 送り箱を階の順に1件ずつ行き先へ届ける。どちらの段階もスレッドの数や実行の順によらず同じ結果になる
+    void tickWorld() {
+        worldSlots.resize(floors.size());
+        size_t index = 0;
+        for (auto& entry : floors) {
+            WorldSlot& slot = worldSlots[index];
+            slot.floor_num = entry.first;
+            slot.floor = &ownFloor(entry.second);
+            slot.up = -1;
+            slot.down = -1;
+            slot.outbox.clear();
+            if (index > 0 && worldSlots[index - 1].floor_num == entry.first - 1) {
+                slot.down = static_cast<int>(index) - 1;
+                worldSlots[index - 1].up = static_cast<int>(index);
+            }
+            // 動かしたフロアはシードから作り直した状態と変わるので、入ったフロアと同じく差分を残す
+            slot.floor->modified = true;
+            ++index;
+        }
+
+        forEachFloorTask(worldSlots.size(), [this](size_t i) {
+            WorldSlot& slot = worldSlots[i];
+            moveFloorMonsters(*slot.floor, slot.floor == activeFloor, &slot);
+        });
+        exchangeTravelers();
+    }
+
+    // 送り箱のモンスターを行き先の階の着く側の階段 (上りで来たら下り階段、下りで来たら上り階段) に置く
+    // 階段がふさがっているか、チャンク分割したフロアでウィンドウの外にあれば行き先の空きセルから行き先の乱数で選び
+    // (プレイヤーのいるセルは除く)、空きセルもなければ元の階段に戻す
+    void exchangeTravelers() {
+        auto player_at = [this](const Floor& floor, int x, int y) {
+            return &floor == activeFloor && x == playerX && y == playerY;
+        };
+        for (WorldSlot& slot : worldSlots) {
+            for (const StairTraveler& traveler : slot.outbox) {
+                Floor& target = *worldSlots[traveler.upward ? slot.up : slot.down].floor;
+                int x = traveler.upward ? target.down_stair_x : target.up_stair_x;
+                int y = traveler.upward ? target.down_stair_y : target.up_stair_y;
+                bool open = target.grid().inBounds(x, y) && !target.occupied.test(x, y) && !player_at(target, x, y);
+                if (!open) {
+                    bool here = &target == activeFloor;
+                    open = target.free_cells.pickExcept(target.monster_rng, here ? playerX : -1, here ? playerY : -1, x, y);
+                }
+
+                MonsterEntity monster = traveler.monster;
+                if (!open) {
+                    slot.floor->monsters.push_back(monster);
+                    continue;
+                }
+                slot.floor->vacate(monster.x, monster.y);
+                monster.x = x;
+                monster.y = y;
+                target.monsters.push_back(monster);
+                target.occupy(x, y);
+            }
+        }
+    }
+
+    // ターンごとのモンスターの移動 (ワールドティックなら読み込み済みの全フロア)
+    void advanceMonsters() {
+        if (worldRadius > 0) {
+            tickWorld();
+        }
+        else {
+            moveMonsters();
+        }
+    }
+
+    // --- 1ティック分の更新 ---
+    // 戦闘中ならラウンドを進め、そうでなければ溜まったキーをまとめて処理する
+    // 画面を書き換える必要があれば true を返す
+    bool updateTick(std::vector<char>& keys) {
+        ownActiveFloor();
+        ++tickCount;
+        bool changed = false;
+        profile.start();
+
+        if (battle.active) {
+            if (tickCount >= battle.next_round_tick) {
+                advanceBattle();
+                profile.lap(PHASE_BATTLE);
+                if (!battle.active) {
+                    endTurn();
+                    profile.lap(PHASE_MONSTERS);
+                }
+                changed = true;
+            }
+        }
+        else if (!keys.empty()) {
+            // メッセージ欄にはこのティックの出来事だけを出す
+            messageLog.clear();
+            size_t processed = 0;
+            while (processed < keys.size() && processed < KEY_BATCH_LIMIT) {
+                char key = keys[processed++];
+                if (recorder) {
+                    recorder->push_back({ tickCount, key });
+                }
+                ++stepCount;
+                movePlayer(key);
+                profile.lap(PHASE_PLAYER);
+                // 戦闘が最初のラウンドで決着した場合もここでターンを締める
+                if (!battle.active) {
+                    endTurn();
+                    profile.lap(PHASE_MONSTERS);
+                }
+                if (battle.active || quitRequested || player.hp <= 0 || reachedGoal()) {
+                    break;
+                }
+            }
+            keys.erase(keys.begin(), keys.begin() + processed);
+            changed = true;
+        }
+
+        // リアルタイムモードではプレイヤーの入力と関係なくモンスターが動く
+        if (monsterTicks > 0 && !battle.active && tickCount % monsterTicks == 0) {
+            advanceMonsters();
+            profile.lap(PHASE_MONSTERS);
+            changed = true;
+        }
+
+        collectMessages();
+        profile.lap(PHASE_MESSAGES);
+        return changed;
+    }
+
+    // プレイヤーの位置を迷路のグリッドに書き込む (表示用。移動時に resetPlayerPosition で消す)
+    // 霧のモードでは視界も合わせる (プレイヤーが動いていなければ計算し直さない)
+    void markPlayer() {
+        Floor& floor = currentFloorData();
+        floor.setCell(playerX, playerY, 'P');
+        if (fogRadius > 0) {
+            floor.player_view.update(floor.walls(), playerX, playerY, fogRadius);
+        }
+    }
+
+    // プレイヤーの行動の後始末 (チャンク分割したフロアではウィンドウを追従させ、
+    // ターン制ではここでモンスターが動く)
+    void endTurn() {
+        followPlayer();
+        if (monsterTicks == 0) {
+            advanceMonsters();
+        }
+    }
+
+    // 最上階のゴールにいるか
+    bool reachedGoal() const {
+        return numFloors > 0 && currentFloor == numFloors && playerX + activeFloor->origin_x == mazeWidth - 2
+            && playerY + activeFloor->origin_y == mazeHeight - 2;
+    }
+
+    // --- 戦闘システム ---
+    // 能力値は出現時に決めたものを使い、戦闘の結果はモンスターに書き戻す
+    // 最初のラウンドはすぐに、以降は BATTLE_ROUND_MS ごとに1ラウンドずつ進める
+    void startBattle(int monster_index, int target_x, int target_y) {
+        MonsterEntity& monster = currentFloorData().monsters[monster_index];
+        events->emit(makeEvent(GameEventType::BattleStart, 0, monster.hp, monster.attack));
+        // 見込みを誰も使わない (イベントを捨てていて自動決着もしない) なら表を作らない
+        // (サーバーの多数のセッションがそれぞれ表を持たないように)
+        bool auto_resolve = false;
+        if (events != &nullSink || autoBattlePermille >= 0) {
+            BattleOdds odds = battleOddsAgainst(monster);
+            int win_permille = static_cast<int>(odds.win * 1000);
+            auto_resolve = autoBattlePermille >= 0 && win_permille >= autoBattlePermille;
+            events->emit(makeEvent(GameEventType::BattleForecast, auto_resolve ? EVENT_AUTO_RESOLVED : 0, win_permille,
+                                   static_cast<int>(odds.expected_hp_loss + 0.5)));
+        }
+
+        battle.active = true;
+        battle.monster_index = monster_index;
+        battle.target_x = target_x;
+        battle.target_y = target_y;
+        battle.player_total_attack = player.base_attack + player.equipped_weapon.attack_bonus;
+        // 戦闘ごとに独立した乱数ストリームを使う
+        battle.rng = rngs.stream(RngDomain::Battle, battleCount++);
+
+        advanceBattle();
+        while (auto_resolve && battle.active) {
+            advanceBattle();
+        }
+    }
+
+    // 戦闘を1ラウンド進める。決着がついたら戦闘を終える (ターンを締めるのは呼び出し側)
+    void advanceBattle() {
+        Floor& current_floor_data = currentFloorData();
+        MonsterEntity& monster = current_floor_data.monsters[battle.monster_index];
+        battle.next_round_tick = tickCount + battleRoundTicks;
+
+        int playerDamage = battle.rng.range(1, battle.player_total_attack);
+        monster.hp -= playerDamage;
+        events->emit(makeEvent(GameEventType::Damage, EVENT_FROM_PLAYER, playerDamage, monster.hp,
+                               player.name, NAME_MONSTER));
+
+        if (monster.hp <= 0) {
+            events->emit(makeEvent(GameEventType::Kill, EVENT_FROM_PLAYER, 0, 0,
+                                   player.name, NAME_MONSTER));
+            handleWeaponDrop(battle.rng);
+
+            // 勝利した場合: モンスターを取り除いて、そのセルへ進む
+            current_floor_data.removeMonster(battle.monster_index);
+            resetPlayerPosition(current_floor_data);
+            updatePlayerPosition(battle.target_x, battle.target_y);
+            recoverHP();
+            battle.active = false;
+            return;
+        }
+
+        int monsterDamage = battle.rng.range(1, monster.attack);
+        player.hp -= monsterDamage;
+        events->emit(makeEvent(GameEventType::Damage, 0, monsterDamage, player.hp,
+                               NAME_MONSTER, player.name));
+
+        if (player.hp <= 0) {
+            // 戦闘敗北時は移動しない
+            battle.active = false;
+        }
+    }
+
+    // 武器ドロップと装備処理
+    void handleWeaponDrop(RngStream& rng) {
+        if (rng.chance(50, 100)) {
+            int weapon_index = rng.range(0, static_cast<int>(availableWeapons.size()) - 1);
+            const Weapon& dropped_weapon = availableWeapons[weapon_index];
+
+            events->emit(makeEvent(GameEventType::Drop, EVENT_FROM_PLAYER, dropped_weapon.attack_bonus, 0,
+                                   NO_NAME, NO_NAME, dropped_weapon.name));
+
+            if (dropped_weapon.attack_bonus > player.equipped_weapon.attack_bonus) {
+                events->emit(makeEvent(GameEventType::Equip, EVENT_FROM_PLAYER, dropped_weapon.attack_bonus, 0,
+                                       NO_NAME, NO_NAME, dropped_weapon.name));
+                player.equipped_weapon = dropped_weapon;
+            }
+            else {
+                events->emit(makeEvent(GameEventType::KeepEquipment, EVENT_FROM_PLAYER,
+                                       player.equipped_weapon.attack_bonus, 0,
+                                       NO_NAME, NO_NAME, player.equipped_weapon.name));
+            }
+        }
+    }
+
+    // --- プレイヤーの移動とキー入力 ---
+    // 移動キーの向き (移動キーでなければ false で、dx, dy は 0)
+    static bool keyDirection(char key, int& dx, int& dy) {
+        dx = 0;
+        dy = 0;
+        // WASDまたは矢印キーによる移動
+        switch (key) {
+            // WASD
+        case 'w': case 'W': dy = -1; return true;
+        case 's': case 'S': dy = 1; return true;
+        case 'a': case 'A': dx = -1; return true;
+        case 'd': case 'D': dx = 1; return true;
+
+            // 矢印キー (getInput が OS ごとのコードを KEY_* に揃える)
+        case KEY_UP: dy = -1; return true;
+        case KEY_DOWN: dy = 1; return true;
+        case KEY_LEFT: dx = -1; return true;
+        case KEY_RIGHT: dx = 1; return true;
+        }
+        return false;
+    }
+
+    void movePlayer(char key) {
+        if (key == 'q' || key == 'Q') {
+            quitRequested = true;
+            return;
+        }
+        int dx, dy;
+        keyDirection(key, dx, dy);
+        int nextX = playerX + dx;
+        int nextY = playerY + dy;
+
+        // 移動先のチェック
+        Floor& current_floor_data = currentFloorData();
+        if (current_floor_data.grid().inBounds(nextX, nextY)) {
+            char target = current_floor_data.cell(nextX, nextY);
+
+            // プレイヤーが移動元のマスをリセットする
+            resetPlayerPosition(current_floor_data);
+
+            if (current_floor_data.occupied.test(nextX, nextY)) {
+                // モンスターとの戦闘 (決着は advanceBattle で付く)
+                // 決着までは移動しないため、リセットした場所にプレイヤーを再描画する
+                current_floor_data.setCell(playerX, playerY, 'P');
+                startBattle(current_floor_data.findMonster(nextX, nextY), nextX, nextY);
+            }
+            else if (target == ' ' || target == 'S' || target == 'E') {
+                updatePlayerPosition(nextX, nextY);
+                recoverHP();
+            }
+            else if (target == 'U' && (numFloors == 0 || currentFloor < numFloors)) {
+                gotoNextFloor();
+            }
+            else if (target == 'D' && currentFloor > 1) {
+                gotoPreviousFloor();
+            }
+            else {
+                // 壁 ('#') やその他の無効な移動
+                // リセットした場所にプレイヤーを再描画する
+                current_floor_data.setCell(playerX, playerY, 'P');
+            }
+        }
+    }
+
+    // 隣のモンスターのうち最も勝率の低い相手との見込み (状態の行に出す。隣にいなければ空)
+    std::string dangerText() {
+        const Floor& floor = currentFloorData();
+        bool found = false;
+        BattleOdds odds = {};
+        for (int dir = 0; dir < 4; ++dir) {
+            int x = playerX + STEP_DX[dir];
+            int y = playerY + STEP_DY[dir];
+            if (floor.grid().inBounds(x, y) && floor.occupied.test(x, y)) {
+                BattleOdds candidate = battleOddsAgainst(floor.monsters[floor.findMonster(x, y)]);
+                if (!found || candidate.win < odds.win) {
+                    odds = candidate;
+                    found = true;
+                }
+            }
+        }
+        if (!found) {
+            return std::string();
+        }
+        char text[64];
+        std::snprintf(text, sizeof(text), " | 隣の敵: 勝率 %.1f%% 被ダメージ %.0f", odds.win * 100, odds.expected_hp_loss);
+        return text;
+    }
+
+    // プレイヤーの位置を更新
+    void updatePlayerPosition(int newX, int newY) {
+        playerX = newX;
+        playerY = newY;
+    }
+
+    // 移動前のP表示をリセットする
+    void resetPlayerPosition(Floor& current_floor_data) {
+        char cell_at_current_pos = current_floor_data.cell(playerX, playerY);
+
+        // プレイヤーがいた場所がスタートマス ('S') でなければ、通路 (' ') に戻す
+        if (cell_at_current_pos != 'S') {
+            current_floor_data.setCell(playerX, playerY, ' ');
+        }
+
+        // 階段の上にいる場合は元の階段表示に戻す
+        if (playerX == current_floor_data.up_stair_x && playerY == current_floor_data.up_stair_y) {
+            current_floor_data.setCell(playerX, playerY, 'U');
+        }
+        else if (playerX == current_floor_data.down_stair_x && playerY == current_floor_data.down_stair_y) {
+            current_floor_data.setCell(playerX, playerY, 'D');
+        }
+        // 通路に戻したセルは空きセルの索引にも入れる (スタートマスも立ち去ると通路になる)
+        else if (current_floor_data.cell(playerX, playerY) == ' '
+                 && !current_floor_data.occupied.test(playerX, playerY)) {
+            current_floor_data.free_cells.insert(playerX, playerY);
         }
     }
 
@@ -440,91 +2414,1542 @@ private:
         }
     }
 
-    // 階段移動 (次のフロアへ)
-    void gotoNextFloor() {
-        // 現在のフロアの上り階段を 'U' に戻す
-        MazeFloor& current_floor_data = floors[currentFloor - 1];
-        current_floor_data.maze_data[current_floor_data.up_stair_y][current_floor_data.up_stair_x] = 'U';
+    // 階段移動 (次のフロアへ)
+    void gotoNextFloor() {
+        // 現在のフロアの上り階段を 'U' に戻す
+        Floor& current_floor_data = currentFloorData();
+        current_floor_data.setCell(current_floor_data.up_stair_x, current_floor_data.up_stair_y, 'U');
+
+        currentFloor++;
+        // 次のフロアの下り階段の位置に移動 (ここで前のフロアが追い出されることがある)
+        Floor& nextFloor = enterFloor(currentFloor);
+        playerX = nextFloor.down_stair_x;
+        playerY = nextFloor.down_stair_y;
+
+        events->emit(makeEvent(GameEventType::FloorChange, EVENT_FROM_PLAYER, currentFloor - 1, currentFloor));
+    }
+
+    // 階段移動 (前のフロアへ)
+    void gotoPreviousFloor() {
+        // 現在のフロアの下り階段を 'D' に戻す
+        Floor& current_floor_data = currentFloorData();
+        current_floor_data.setCell(current_floor_data.down_stair_x, current_floor_data.down_stair_y, 'D');
+
+        currentFloor--;
+        // 前のフロアの上り階段の位置に移動 (ここで前のフロアが追い出されることがある)
+        Floor& prevFloor = enterFloor(currentFloor);
+        playerX = prevFloor.up_stair_x;
+        playerY = prevFloor.up_stair_y;
+
+        events->emit(makeEvent(GameEventType::FloorChange, EVENT_FROM_PLAYER, currentFloor + 1, currentFloor));
+    }
+
+    // イベントのメッセージをメッセージ欄に移す
+    // 既定のテキストシンク以外が設定されていれば、そのシンクに書き出させる
+    void collectMessages() {
+        if (events != &textSink) {
+            events->flush();
+            return;
+        }
+
+        std::string text = textSink.take();
+        size_t start = 0;
+        while (start < text.size()) {
+            size_t end = text.find('\n', start);
+            if (end == std::string::npos) {
+                end = text.size();
+            }
+            if (end > start) {
+                messageLog.emplace_back(text, start, end - start);
+            }
+            start = end + 1;
+        }
+        if (messageLog.size() > static_cast<size_t>(MESSAGE_LOG_LIMIT)) {
+            messageLog.erase(messageLog.begin(), messageLog.end() - MESSAGE_LOG_LIMIT);
+        }
+    }
+
+    // 霧の層を視界 view とビューポート (左上 origin_x, origin_y、columns x rows) に合わせる
+    // 同じ視界の続きなら直前の差分だけを当て、ビューポートが動いたら重なる部分を移して新しく入った端だけを調べる
+    // 視界を差分なしに入れ替えた (別の階・読み込み・ウィンドウの移動) か、更新を読み飛ばしたときだけ全体を調べ直す
+    void syncFogLayer(const FieldOfView& view, int origin_x, int origin_y, int columns, int rows) {
+        FogLayer& layer = fogLayer;
+        auto scan = [&view](int mx, int my) {
+            return view.visible(mx, my) ? FOG_VISIBLE : view.explored(mx, my) ? FOG_EXPLORED : FOG_UNSEEN;
+        };
+        bool continued = layer.lineage == view.lineage() && layer.columns == columns && layer.rows == rows
+            && (layer.version == view.version() || layer.version + 1 == view.version());
+        if (!continued) {
+            layer.cells.resize(static_cast<size_t>(columns) * rows);
+            for (int y = 0; y < rows; ++y) {
+                for (int x = 0; x < columns; ++x) {
+                    layer.cells[static_cast<size_t>(y) * columns + x] = scan(origin_x + x, origin_y + y);
+                }
+            }
+        }
+        else {
+            if (origin_x != layer.origin_x || origin_y != layer.origin_y) {
+                // 調べ直した端のセルはもう新しい視界を写しているが、下の差分を当て直しても同じ値になる
+                int dx = origin_x - layer.origin_x;
+                int dy = origin_y - layer.origin_y;
+                layer.scratch.resize(layer.cells.size());
+                for (int y = 0; y < rows; ++y) {
+                    int oy = y + dy;
+                    for (int x = 0; x < columns; ++x) {
+                        int ox = x + dx;
+                        layer.scratch[static_cast<size_t>(y) * columns + x] =
+                            ox >= 0 && ox < columns && oy >= 0 && oy < rows
+                                ? layer.cells[static_cast<size_t>(oy) * columns + ox] : scan(origin_x + x, origin_y + y);
+                    }
+                }
+                layer.cells.swap(layer.scratch);
+            }
+            if (layer.version != view.version()) {
+                auto apply = [&](const std::vector<FieldOfView::Cell>& changed, uint8_t state) {
+                    for (const FieldOfView::Cell& cell : changed) {
+                        int vx = cell.x - origin_x;
+                        int vy = cell.y - origin_y;
+                        if (vx >= 0 && vx < columns && vy >= 0 && vy < rows) {
+                            layer.cells[static_cast<size_t>(vy) * columns + vx] = state;
+                        }
+                    }
+                };
+                apply(view.hidden(), FOG_EXPLORED);
+                apply(view.revealed(), FOG_VISIBLE);
+            }
+        }
+        layer.origin_x = origin_x;
+        layer.origin_y = origin_y;
+        layer.columns = columns;
+        layer.rows = rows;
+        layer.lineage = view.lineage();
+        layer.version = view.version();
+    }
+
+    // 迷路の表示
+    // 端末に収まる範囲 (ビューポート) をプレイヤー中心に切り出して背面フレームに描き、
+    // 前回の画面との差分だけを書き出す
+    void displayMaze() {
+        const Floor& current_floor_data = currentFloorData();
+        const Grid& current_maze = current_floor_data.grid();
+
+        // 描ける範囲 (チャンク分割したフロアではメモリにあるウィンドウのうちフロアの中の部分)
+        int area_width = std::min(current_maze.width(), mazeWidth - current_floor_data.origin_x);
+        int area_height = std::min(current_maze.height(), mazeHeight - current_floor_data.origin_y);
+
+        // ビューポートの大きさ (1セル2桁。下に空行・説明・状態・メッセージ欄を残す)
+        int term_columns, term_rows;
+        renderer.screenSize(term_columns, term_rows);
+        int view_columns = std::max(1, std::min(area_width, term_columns / 2));
+        int view_rows = std::max(1, std::min(area_height, term_rows - 3 - MIN_MESSAGE_LINES));
+        int text_lines = std::max(3 + MIN_MESSAGE_LINES, term_rows - view_rows);
+
+        // プレイヤーが中央に来るように左上を決め、迷路の端で止める
+        int origin_x = std::max(0, std::min(playerX - view_columns / 2, area_width - view_columns));
+        int origin_y = std::max(0, std::min(playerY - view_rows / 2, area_height - view_rows));
+
+        renderer.beginFrame(view_columns, view_rows, text_lines);
+        renderer.setTextWidth(term_columns - 1);
+        // 霧のモードでは、見えているセルはそのまま、覚えているだけのセルは薄く、見たことのないセルは空白にする
+        const bool fog = fogRadius > 0;
+        if (fog) {
+            syncFogLayer(current_floor_data.player_view, origin_x, origin_y, view_columns, view_rows);
+        }
+        auto fogged = [&](char cell, int vx, int vy) {
+            uint8_t state = fogLayer.cells[static_cast<size_t>(vy) * view_columns + vx];
+            return state == FOG_VISIBLE ? cell : state == FOG_EXPLORED ? static_cast<char>(cell | CELL_DIM) : ' ';
+        };
+        for (int y = 0; y < view_rows; ++y) {
+            const char* source = current_maze.row(origin_y + y) + origin_x;
+            char* cells = renderer.row(y);
+            if (!fog) {
+                std::copy_n(source, view_columns, cells);
+                continue;
+            }
+            for (int x = 0; x < view_columns; ++x) {
+                cells[x] = fogged(source[x], x, y);
+            }
+        }
+
+        // 地形の上にビューポート内の印 (プレイヤーなど) を重ねる
+        for (const CellMark& mark : current_floor_data.marks) {
+            int mx = static_cast<int>(mark.index % current_maze.width());
+            int my = static_cast<int>(mark.index / current_maze.width());
+            int vx = mx - origin_x;
+            int vy = my - origin_y;
+            if (vx < 0 || vx >= view_columns || vy < 0 || vy >= view_rows) {
+                continue;
+            }
+            renderer.row(vy)[vx] = fog ? fogged(mark.cell, vx, vy) : mark.cell;
+        }
+
+        // 地形の上にビューポート内の (霧のモードでは見えている) モンスターを重ねる
+        for (const MonsterEntity& monster : current_floor_data.monsters) {
+            int vx = monster.x - origin_x;
+            int vy = monster.y - origin_y;
+            if (vx >= 0 && vx < view_columns && vy >= 0 && vy < view_rows
+                && (!fog || fogLayer.cells[static_cast<size_t>(vy) * view_columns + vx] == FOG_VISIBLE)) {
+                renderer.setCell(vx, vy, 'M');
+            }
+        }
+
+        // 説明とプレイヤー情報
+        renderer.setText(0, "");
+        renderer.setText(1, "WASD または 矢印キーで移動 (Qで終了), P:プレイヤー, M:モンスター, S:スタート, E:ゴール, U:上り階段, D:下り階段, #:壁"
+            " (シード: " + std::to_string(rngs.seed()) + ")");
+        renderer.setText(2, "--- " + std::to_string(currentFloor) + "階 (HP: " + std::to_string(player.hp) + "/"
+            + std::to_string(MAX_HP) + " | 装備: " + NameTable::text(player.equipped_weapon.name)
+            + " (+" + std::to_string(player.equipped_weapon.attack_bonus) + ")"
+            + (current_floor_data.chunked ? " | 位置: " + std::to_string(playerX + current_floor_data.origin_x) + ", "
+               + std::to_string(playerY + current_floor_data.origin_y) : std::string()) + dangerText() + ") ---");
+
+        // メッセージ欄 (入りきらなければ新しい方を残す)
+        int message_lines = text_lines - 3;
+        size_t first = messageLog.size() > static_cast<size_t>(message_lines) ? messageLog.size() - message_lines : 0;
+        for (int i = 0; i < message_lines; ++i) {
+            size_t index = first + i;
+            renderer.setText(3 + i, index < messageLog.size() ? messageLog[index] : std::string());
+        }
+
+        renderer.present();
+    }
+};
+
+// 実行時サイズのゲーム
+using MazeGame = BasicMazeGame<DYNAMIC_SIZE, DYNAMIC_SIZE, DYNAMIC_SIZE>;
+
+// 既定の大きさの固定サイズのゲーム (main は設定がこれに一致すればこちらを使う)
+using DefaultMazeGame = BasicMazeGame<MAZE_WIDTH, MAZE_HEIGHT, NUM_FLOORS>;
+
+// 迷路のサイズを正規化する (穴掘り法は奇数サイズを前提とするため切り上げる)
+int normalizeMazeSize(int size) {
+    if (size < 5) {
+        size = 5;
+    }
+    return (size % 2 == 0) ? size + 1 : size;
+}
+
+// チャンク分割モードのフロアのサイズを正規化する (CHUNK_SIZE の倍数 + 1 に切り上げる。最小で CHUNK_WINDOW 個分)
+int normalizeChunkedSize(int size) {
+    int chunks = std::max(CHUNK_WINDOW - 1, (size - 1 + CHUNK_SIZE - 1) / CHUNK_SIZE);
+    return chunks * CHUNK_SIZE + 1;
+}
+
+// Eller 法の迷路をゲームなしでファイルに流し出す (path が "-" なら標準出力)
+// 乱数は1階の地形と同じストリームを使うので、同じシード・サイズなら --algo eller の1階と同じ迷路になる
+// (階段とスタートの印は書かない)。メモリは幅に比例する分しか使わない
+// 生成の速さ (セル/秒) は標準エラーに出す
+int generateMazeFile(const char* path, MazeFileFormat format, int width, uint64_t height, uint64_t seed) {
+    bool to_stdout = std::strcmp(path, "-") == 0;
+    FILE* out = to_stdout ? stdout : std::fopen(path, format == MazeFileFormat::Bits ? "wb" : "w");
+    if (!out) {
+        std::cerr << "出力ファイルを開けません: " << path << std::endl;
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    EllerMaze eller(width, height, RngService(seed).stream(RngDomain::FloorGeneration, 1));
+    MazeRowWriter writer(out, format, width, height);
+    std::vector<char> row(width);
+    while (!eller.done()) {
+        eller.next(row.data());
+        writer.writeRow(row.data());
+    }
+    bool ok = writer.finish();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (!to_stdout) {
+        ok = std::fclose(out) == 0 && ok;
+    }
+    if (!ok) {
+        std::cerr << "出力ファイルに書き込めません: " << path << std::endl;
+        return 1;
+    }
+
+    double cells = static_cast<double>(width) * static_cast<double>(height);
+    std::fprintf(stderr, "生成: %d x %llu (%.0f セル)  %.3f 秒  %.1f 百万セル/秒  %.1f MB/秒 (%llu バイト)\n",
+                 width, static_cast<unsigned long long>(height), cells, seconds,
+                 seconds > 0 ? cells / seconds / 1e6 : 0.0,
+                 seconds > 0 ? writer.bytes() / seconds / 1e6 : 0.0,
+                 static_cast<unsigned long long>(writer.bytes()));
+    return 0;
+}
+
+// 階ごとの戦闘の見込みの表 (--odds。バランス調整用)
+// その階に出るモンスターの能力値の全ての組 (HP 30通り x 攻撃力 10通り、出現は一様) について、
+// 最大HPのプレイヤーが武器ごとに勝つ確率と失うHPの期待値を厳密に求めて平均する
+void printBattleOddsTable(int floor_count) {
+    std::vector<Weapon> weapons = defaultWeapons();
+    weapons.insert(weapons.begin(), Weapon{ NAME_BARE_HANDS, 0 });
+    const int base_attack = PLAYER_BASE_ATTACK;
+    BattleOddsCache cache(MAX_HP, 1024);
+    auto start = std::chrono::steady_clock::now();
+
+    std::printf("--- 戦闘の見込み (最大HP %d、攻撃力 %d + 武器。勝率 / 失うHPの期待値) ---\n", MAX_HP, base_attack);
+    std::printf("%4s", "階");
+    for (const Weapon& weapon : weapons) {
+        std::printf("  %14s", NameTable::text(weapon.name));
+    }
+    std::printf("\n");
+    for (int floor_num = 1; floor_num <= floor_count; ++floor_num) {
+        // placeMonsters と同じ能力値の範囲
+        int hp_low = 40 + (floor_num - 1) * 15;
+        int attack_low = 10 + (floor_num - 1) * 5;
+        std::printf("%4d", floor_num);
+        for (const Weapon& weapon : weapons) {
+            double win = 0, loss = 0;
+            for (int attack = attack_low; attack < attack_low + 10; ++attack) {
+                // HP の大きい方から引くと、表を1回で必要な大きさに作れる
+                for (int hp = hp_low + 29; hp >= hp_low; --hp) {
+                    BattleOdds odds = cache.odds(base_attack + weapon.attack_bonus, attack, MAX_HP, hp);
+                    win += odds.win;
+                    loss += odds.expected_hp_loss;
+                }
+            }
+            std::printf("  %6.2f%% / %5.1f", win / 3, loss / 300);
+        }
+        std::printf("\n");
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::printf("\n表: %zu 個 (作成 %llu 回)  時間: %.3f ミリ秒\n", cache.tableCount(),
+                static_cast<unsigned long long>(cache.tablesBuilt()), seconds * 1e3);
+}
+
+#ifdef __linux__
+// --------------------------------------------------
+// 多数のセッションを1つのプロセスで動かすサーバー (--serve)
+// 接続ごとに独立した MazeGame (フロアも乱数も自分だけのもの) を持ち、セッションどうしは何も共有しない
+//
+// スレッドの役割:
+//   I/O スレッド (run を呼んだスレッド): epoll で接続の受け付けと読み書きの準備を待ち、
+//                                        準備のできたセッションをタスクとしてワーカーに渡す
+//   ワーカー (WorkStealingPool): セッションのタスクを実行する。受け取ったキーでゲームを進めて返事を送る
+// セッションの fd は EPOLLONESHOT で登録するので、1つのセッションのタスクが同時に2つ動くことはなく、
+// セッションの中身にロックはいらない。タスクの最後に epoll に登録し直す
+// 終わったセッションはロックなしのスタックで I/O スレッドに返し、I/O スレッドが閉じて解放する
+//
+// プロトコル (1行ずつのテキスト):
+//   接続直後      サーバー -> "HELLO <セッション番号> <シード>"
+//   キー (1バイト) クライアント -> サーバー。空白と改行は無視する
+//   キーごとに    サーバー -> "<歩数> <階> <x> <y> <HP> <play|over|clear|quit>"
+//   終わったら    サーバー -> "END <状態のハッシュ (16進)>" を送って切断する
+// ゲームの設定はサーバーの起動時のものを全セッションで使い、シードだけセッションごとに変える
+// 同じシードと設定で、送ったキー列を --script で実行すれば同じハッシュになる
+// ゲームは最初のキーが来たときに作るので、つないだだけのセッションはソケットと小さな構造体の分しか使わない
+// --------------------------------------------------
+
+struct MazeSettings {
+    int width;
+    int height;
+    int floors;
+    uint64_t seed;
+    int monsters;
+    int chase_radius;
+    int tick_ms;
+    int monster_tick_ms;
+    bool chunked;
+    MazeAlgorithm algorithm;
+    int auto_battle;
+};
 
-        currentFloor++;
-        // 次のフロアの下り階段の位置に移動
-        MazeFloor& nextFloor = floors[currentFloor - 1];
-        playerX = nextFloor.down_stair_x;
-        playerY = nextFloor.down_stair_y;
+// サーバーの停止要求 (SIGINT / SIGTERM)
+static volatile std::sig_atomic_t serverStopRequested = 0;
+
+class MazeServer {
+public:
+    MazeServer(const MazeSettings& game_settings, unsigned workers)
+        : settings(game_settings), pool(new WorkStealingPool(workers)), retired(nullptr), turns(0), gamesStarted(0), gamesFinished(0),
+          nextSessionId(1) {}
+
+    // seconds 秒 (0 なら SIGINT / SIGTERM まで) 待ち受ける。エラーなら 1 を返す
+    int run(const SocketAddress& address, double seconds) {
+        rlim_t file_limit = raiseFileLimit();
+        std::string error;
+        int listen_fd = listenSocket(address, error);
+        if (listen_fd < 0) {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        epoll_event listen_event = {};
+        listen_event.events = EPOLLIN;
+        listen_event.data.ptr = nullptr;     // セッションは data.ptr が nullptr でない
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, listen_fd, &listen_event);
+
+        installStopHandler();
+        std::fprintf(stderr, "待ち受け: %s  ワーカー: %zu  ファイル記述子の上限: %llu\n",
+                     address.unix_domain ? ("unix:" + address.path).c_str() : ("tcp:" + std::to_string(address.port)).c_str(),
+                     pool->size(), static_cast<unsigned long long>(file_limit));
+
+        auto start = std::chrono::steady_clock::now();
+        auto next_report = start + std::chrono::seconds(5);
+        uint64_t last_turns = 0;
+        size_t peak_sessions = 0;
+        bool accept_warned = false;
+        std::vector<epoll_event> ready(1024);
+
+        while (!serverStopRequested) {
+            int count = epoll_wait(epollFd, ready.data(), static_cast<int>(ready.size()), 100);
+            for (int i = 0; i < count; ++i) {
+                ServerSession* session = static_cast<ServerSession*>(ready[i].data.ptr);
+                if (session) {
+                    pool->submit(runSession, session);
+                }
+                else {
+                    acceptAll(listen_fd, address, accept_warned);
+                }
+            }
+            reapRetired();
+            peak_sessions = std::max(peak_sessions, sessions.size());
+
+            auto now = std::chrono::steady_clock::now();
+            if (seconds > 0 && std::chrono::duration<double>(now - start).count() >= seconds) {
+                break;
+            }
+            if (now >= next_report) {
+                uint64_t total = turns.load(std::memory_order_relaxed);
+                std::fprintf(stderr, "接続中: %zu  ターン/秒: %.0f\n", sessions.size(), (total - last_turns) / 5.0);
+                last_turns = total;
+                next_report += std::chrono::seconds(5);
+            }
+        }
 
-        std::cout << "\n\033[33m階段を上り、" << currentFloor << "階に到達しました。\033[0m" << std::endl;
+        // 新しい接続を止めてから、動いているタスクが終わるのを待ってセッションを片付ける
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, listen_fd, nullptr);
+        close(listen_fd);
+        if (address.unix_domain) {
+            unlink(address.path.c_str());
+        }
+        uint64_t steals = pool->steals();
+        pool.reset();
+        reapRetired();
+        size_t open_sessions = sessions.size();
+        for (ServerSession* session : sessions) {
+            close(session->fd);
+            delete session;
+        }
+        sessions.clear();
+        close(epollFd);
+
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::printf("=== サーバー ===\n");
+        std::printf("時間:             %.2f 秒\n", elapsed);
+        std::printf("接続:             %llu (最大同時 %zu, 終了時 %zu)\n",
+                    static_cast<unsigned long long>(nextSessionId - 1), peak_sessions, open_sessions);
+        std::printf("ゲーム:           開始 %llu / 終了 %llu\n",
+                    static_cast<unsigned long long>(gamesStarted.load()),
+                    static_cast<unsigned long long>(gamesFinished.load()));
+        std::printf("ターン:           %llu (%.0f ターン/秒)\n",
+                    static_cast<unsigned long long>(turns.load()), elapsed > 0 ? turns.load() / elapsed : 0.0);
+        std::printf("盗んだタスク:     %llu\n", static_cast<unsigned long long>(steals));
+        return 0;
     }
 
-    // 階段移動 (前のフロアへ)
-    void gotoPreviousFloor() {
-        // 現在のフロアの下り階段を 'D' に戻す
-        MazeFloor& current_floor_data = floors[currentFloor - 1];
-        current_floor_data.maze_data[current_floor_data.down_stair_y][current_floor_data.down_stair_x] = 'D';
+private:
+    struct ServerSession {
+        MazeServer* server;
+        int fd;
+        uint64_t id;
+        uint64_t seed;
+        std::unique_ptr<MazeGame> game;
+        std::string output;          // 送りきれていない返事
+        size_t output_sent;
+        bool closing;                // END を送ったら閉じる
+        ServerSession* next_retired;
+        // 登録し直した回数。前のタスクの書き込みを次のタスク (別のワーカーかもしれない) に見せるための
+        // release / acquire (epoll を通した受け渡しは C++ のメモリモデルの外なので、それだけに頼らない)
+        std::atomic<uint64_t> handoffs{ 0 };
+    };
+
+    static const size_t READ_BUFFER = 4096;
+    static const int READS_PER_TASK = 16;        // 1回のタスクで読む回数の上限 (他のセッションを待たせない)
+    static const size_t OUTPUT_LIMIT = 1 << 16;  // 返事がこれ以上溜まったら、送りきるまで読まない
+
+    MazeSettings settings;
+    std::unique_ptr<WorkStealingPool> pool;
+    int epollFd = -1;
+    std::unordered_set<ServerSession*> sessions;   // I/O スレッドだけが触る
+    std::atomic<ServerSession*> retired;           // 終わったセッションのスタック
+    std::atomic<uint64_t> turns;
+    std::atomic<uint64_t> gamesStarted;
+    std::atomic<uint64_t> gamesFinished;
+    uint64_t nextSessionId;
+
+    static void onStopSignal(int) {
+        serverStopRequested = 1;
+    }
 
-        currentFloor--;
-        // 前のフロアの上り階段の位置に移動
-        MazeFloor& prevFloor = floors[currentFloor - 1];
-        playerX = prevFloor.up_stair_x;
-        playerY = prevFloor.up_stair_y;
+    static void installStopHandler() {
+        struct sigaction action = {};
+        action.sa_handler = onStopSignal;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGINT, &action, nullptr);
+        sigaction(SIGTERM, &action, nullptr);
+        signal(SIGPIPE, SIG_IGN);
+    }
+
+    void acceptAll(int listen_fd, const SocketAddress& address, bool& warned) {
+        while (true) {
+            int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                if ((errno == EMFILE || errno == ENFILE) && !warned) {
+                    std::fprintf(stderr, "ファイル記述子が足りないため接続を受け付けられません\n");
+                    warned = true;
+                }
+                return;
+            }
+            tuneAcceptedSocket(fd, address);
+
+            ServerSession* session = new ServerSession();
+            session->server = this;
+            session->fd = fd;
+            session->id = nextSessionId++;
+            session->seed = mixBits(settings.seed + session->id * 0x9E3779B97F4A7C15ull);
+            session->output_sent = 0;
+            session->closing = false;
+            session->next_retired = nullptr;
+            sessions.insert(session);
+
+            session->output = "HELLO " + std::to_string(session->id) + " " + std::to_string(session->seed) + "\n";
+            if (!flushOutput(*session)) {
+                sessions.erase(session);
+                close(fd);
+                delete session;
+                continue;
+            }
+            epoll_event event = {};
+            event.events = EPOLLIN | EPOLLONESHOT | (session->output.empty() ? 0u : static_cast<uint32_t>(EPOLLOUT));
+            event.data.ptr = session;
+            epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+        }
+    }
 
-        std::cout << "\n\033[33m階段を下り、" << currentFloor << "階に戻りました。\033[0m" << std::endl;
+    static void runSession(void* arg) {
+        ServerSession* session = static_cast<ServerSession*>(arg);
+        session->server->serviceSession(*session);
     }
 
-    // キーボード入力の取得 (OS依存)
-    char getInput() {
-#ifdef _WIN32
-        int key = _getch();
-        if (key == 0 || key == 224) {
-            return _getch();
+    // ワーカーで実行する。返ったあとは session に触らない (登録し直した時点で別のタスクが動きうる)
+    void serviceSession(ServerSession& session) {
+        session.handoffs.load(std::memory_order_acquire);
+        if (!flushOutput(session)) {
+            retire(session);
+            return;
         }
-        return (char)key;
-#else
-        struct termios oldt, newt;
-        char ch;
+        if (session.closing || !session.output.empty()) {
+            if (session.output.empty()) {
+                retire(session);
+            }
+            else {
+                rearm(session);
+            }
+            return;
+        }
+
+        char buffer[READ_BUFFER];
+        for (int reads = 0; reads < READS_PER_TASK && !session.closing; ++reads) {
+            ssize_t received = recv(session.fd, buffer, sizeof(buffer), 0);
+            if (received == 0) {
+                retire(session);
+                return;
+            }
+            if (received < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    break;
+                }
+                retire(session);
+                return;
+            }
+            for (ssize_t i = 0; i < received && !session.closing; ++i) {
+                handleKey(session, buffer[i]);
+            }
+            if (session.output.size() >= OUTPUT_LIMIT) {
+                break;
+            }
+        }
+
+        if (!flushOutput(session) || (session.closing && session.output.empty())) {
+            retire(session);
+            return;
+        }
+        rearm(session);
+    }
 
-        tcgetattr(STDIN_FILENO, &oldt);
-        newt = oldt;
-        newt.c_lflag &= ~(ICANON | ECHO);
-        tcsetattr(STDIN_FILENO, TCSANOW, &newt);
+    void handleKey(ServerSession& session, char key) {
+        if (key == ' ' || key == '\n' || key == '\r' || key == '\t') {
+            return;
+        }
+        if (!session.game) {
+            session.game.reset(new MazeGame(settings.width, settings.height, settings.floors, session.seed, 0,
+                                            settings.monsters, settings.chase_radius));
+            session.game->setTickInterval(settings.tick_ms, settings.monster_tick_ms);
+            session.game->setChunkedFloors(settings.chunked);
+            session.game->setMazeAlgorithm(settings.algorithm);
+            session.game->setAutoBattle(settings.auto_battle);
+            session.game->setEventSink(nullptr);
+            session.game->startSteps();
+            gamesStarted.fetch_add(1, std::memory_order_relaxed);
+        }
 
-        ch = getchar();
+        MazeGame& game = *session.game;
+        game.stepKey(key);
+        turns.fetch_add(1, std::memory_order_relaxed);
+
+        char line[128];
+        int length = std::snprintf(line, sizeof(line), "%llu %d %d %d %d %s\n",
+                                   static_cast<unsigned long long>(game.steps()), game.floorNumber(),
+                                   game.playerWorldX(), game.playerWorldY(), game.playerHp(), game.outcomeName());
+        session.output.append(line, length);
+        if (!game.playing()) {
+            length = std::snprintf(line, sizeof(line), "END %016llx\n",
+                                   static_cast<unsigned long long>(game.stateHash()));
+            session.output.append(line, length);
+            session.closing = true;
+            session.game.reset();
+            gamesFinished.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
 
-        if (ch == 27) {
-            if (getchar() == 91) {
-                ch = getchar();
+    // 送れるだけ送る。接続が切れていたら false
+    bool flushOutput(ServerSession& session) {
+        while (session.output_sent < session.output.size()) {
+            ssize_t sent = send(session.fd, session.output.data() + session.output_sent,
+                                session.output.size() - session.output_sent, MSG_NOSIGNAL);
+            if (sent < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    return true;
+                }
+                return false;
             }
+            session.output_sent += static_cast<size_t>(sent);
         }
+        session.output.clear();
+        session.output_sent = 0;
+        return true;
+    }
 
-        tcsetattr(STDIN_FILENO, TCSANOW, &oldt);
+    void rearm(ServerSession& session) {
+        epoll_event event = {};
+        event.events = EPOLLONESHOT | (session.output.empty() ? EPOLLIN : EPOLLOUT);
+        event.data.ptr = &session;
+        session.handoffs.fetch_add(1, std::memory_order_release);
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, session.fd, &event);
+    }
 
-        return ch;
-#endif
+    // 終わったセッションを I/O スレッドに返す (ロックなしのスタックに積む)
+    void retire(ServerSession& session) {
+        ServerSession* head = retired.load(std::memory_order_relaxed);
+        do {
+            session.next_retired = head;
+        } while (!retired.compare_exchange_weak(head, &session, std::memory_order_release, std::memory_order_relaxed));
     }
 
-    // 迷路の表示と画面クリア
-    void displayMaze() {
-#ifdef _WIN32
-        system("cls");
-#else
-        system("clear");
+    void reapRetired() {
+        ServerSession* session = retired.exchange(nullptr, std::memory_order_acquire);
+        while (session) {
+            ServerSession* next = session->next_retired;
+            sessions.erase(session);
+            close(session->fd);
+            delete session;
+            session = next;
+        }
+    }
+};
+
+// --------------------------------------------------
+// 負荷をかけるクライアント (--loadgen)
+// clients 個の接続がそれぞれ「キーを1つ送って返事を待つ」を繰り返し (wasd をランダムに)、
+// ゲームが終わったらつなぎ直す。idle 個の接続はつないだまま何も送らない (同時接続数の確認用)
+// 接続はスレッドごとに分け、各スレッドが自分の epoll で待つ
+// --------------------------------------------------
+
+struct LoadStats {
+    uint64_t turns;
+    uint64_t games;
+    uint64_t errors;
+    double latency_sum;     // 秒
+    double latency_max;
+};
+
+class LoadClientThread {
+public:
+    LoadClientThread(const SocketAddress& server_address, int client_count, RngStream rng)
+        : address(server_address), clientCount(client_count), random(rng), stats() {}
+
+    void run(std::chrono::steady_clock::time_point deadline) {
+        int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        clients.resize(clientCount);
+        for (LoadClient& client : clients) {
+            client.fd = -1;
+            connectClient(epoll_fd, client);
+        }
+
+        std::vector<epoll_event> ready(256);
+        char buffer[4096];
+        while (std::chrono::steady_clock::now() < deadline) {
+            int count = epoll_wait(epoll_fd, ready.data(), static_cast<int>(ready.size()), 50);
+            for (int i = 0; i < count; ++i) {
+                LoadClient& client = *static_cast<LoadClient*>(ready[i].data.ptr);
+                ssize_t received = recv(client.fd, buffer, sizeof(buffer), 0);
+                if (received < 0 && (errno == EAGAIN || errno == EINTR)) {
+                    continue;
+                }
+                if (received <= 0) {
+                    ++stats.errors;
+                    connectClient(epoll_fd, client);
+                    continue;
+                }
+                client.partial.append(buffer, received);
+                size_t start = 0, end;
+                while ((end = client.partial.find('\n', start)) != std::string::npos) {
+                    if (handleLine(epoll_fd, client, client.partial.substr(start, end - start))) {
+                        start = std::string::npos;
+                        break;
+                    }
+                    start = end + 1;
+                }
+                if (start != std::string::npos) {
+                    client.partial.erase(0, start);
+                }
+            }
+        }
+
+        for (LoadClient& client : clients) {
+            if (client.fd >= 0) {
+                close(client.fd);
+            }
+        }
+        close(epoll_fd);
+    }
+
+    const LoadStats& result() const { return stats; }
+
+private:
+    struct LoadClient {
+        int fd;
+        std::string partial;        // 受信途中の行
+        std::chrono::steady_clock::time_point sent_at;
+    };
+
+    SocketAddress address;
+    int clientCount;
+    RngStream random;
+    LoadStats stats;
+    std::vector<LoadClient> clients;   // epoll が要素を指すので、作った後は大きさを変えない
+
+    void connectClient(int epoll_fd, LoadClient& client) {
+        if (client.fd >= 0) {
+            close(client.fd);
+        }
+        client.partial.clear();
+        std::string error;
+        client.fd = connectSocket(address, error);
+        if (client.fd < 0) {
+            std::cerr << error << std::endl;
+            ++stats.errors;
+            return;
+        }
+        setNonBlocking(client.fd);
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.ptr = &client;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client.fd, &event);
+    }
+
+    void sendKey(LoadClient& client) {
+        static const char keys[] = { 'w', 'a', 's', 'd' };
+        client.sent_at = std::chrono::steady_clock::now();
+        char key = keys[random.below(4)];
+        if (send(client.fd, &key, 1, MSG_NOSIGNAL) != 1) {
+            ++stats.errors;
+        }
+    }
+
+    // 1行の返事を処理する。つなぎ直したら true (残りの受信内容は捨てる)
+    bool handleLine(int epoll_fd, LoadClient& client, const std::string& line) {
+        if (line.compare(0, 6, "HELLO ") == 0) {
+            sendKey(client);
+            return false;
+        }
+        if (line.compare(0, 4, "END ") == 0) {
+            ++stats.games;
+            connectClient(epoll_fd, client);
+            return true;
+        }
+        double latency = std::chrono::duration<double>(std::chrono::steady_clock::now() - client.sent_at).count();
+        ++stats.turns;
+        stats.latency_sum += latency;
+        stats.latency_max = std::max(stats.latency_max, latency);
+        // ゲームが終わっていれば END を待つ
+        if (line.size() >= 5 && line.compare(line.size() - 5, 5, " play") == 0) {
+            sendKey(client);
+        }
+        return false;
+    }
+};
+
+int runLoadGenerator(const SocketAddress& address, int clients, int idle, double seconds, unsigned threads,
+                     uint64_t seed) {
+    raiseFileLimit();
+    signal(SIGPIPE, SIG_IGN);
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threads = std::max(1u, std::min<unsigned>(threads, static_cast<unsigned>(std::max(1, clients))));
+
+    // 何もしない接続を先に張っておく
+    std::vector<int> idle_fds;
+    std::string error;
+    for (int i = 0; i < idle; ++i) {
+        int fd = connectSocket(address, error);
+        if (fd < 0) {
+            std::cerr << error << " (" << i << " 本目の待機接続)" << std::endl;
+            break;
+        }
+        idle_fds.push_back(fd);
+    }
+
+    RngService rngs(seed);
+    std::vector<std::unique_ptr<LoadClientThread>> workers;
+    for (unsigned t = 0; t < threads; ++t) {
+        int count = clients / static_cast<int>(threads) + (static_cast<int>(t) < clients % static_cast<int>(threads));
+        workers.emplace_back(new LoadClientThread(address, count, rngs.stream(RngDomain::Simulation, t)));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    auto deadline = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(seconds));
+    std::vector<std::thread> running;
+    for (auto& worker : workers) {
+        running.emplace_back([&worker, deadline] { worker->run(deadline); });
+    }
+    for (std::thread& thread : running) {
+        thread.join();
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    LoadStats total = {};
+    for (auto& worker : workers) {
+        const LoadStats& stats = worker->result();
+        total.turns += stats.turns;
+        total.games += stats.games;
+        total.errors += stats.errors;
+        total.latency_sum += stats.latency_sum;
+        total.latency_max = std::max(total.latency_max, stats.latency_max);
+    }
+    for (int fd : idle_fds) {
+        close(fd);
+    }
+
+    std::printf("=== 負荷テスト ===\n");
+    std::printf("接続:             動く %d / 待機 %zu (スレッド %u)\n", clients, idle_fds.size(), threads);
+    std::printf("時間:             %.2f 秒\n", elapsed);
+    std::printf("ターン:           %llu (%.0f ターン/秒)\n",
+                static_cast<unsigned long long>(total.turns), elapsed > 0 ? total.turns / elapsed : 0.0);
+    std::printf("終わったゲーム:   %llu\n", static_cast<unsigned long long>(total.games));
+    std::printf("応答時間:         平均 %.1f us / 最大 %.1f us\n",
+                total.turns > 0 ? total.latency_sum / total.turns * 1e6 : 0.0, total.latency_max * 1e6);
+    std::printf("エラー:           %llu\n", static_cast<unsigned long long>(total.errors));
+    return total.errors > 0 ? 2 : 0;
+}
 #endif
 
-        const std::vector<std::vector<char>>& current_maze = floors[currentFloor - 1].maze_data;
+// 満杯のフロアで止まったならエラーとして知らせる (知らせたら true)
+template <class Game>
+bool reportFullFloor(const Game& game) {
+    if (game.fullFloorNumber() == 0) {
+        return false;
+    }
+    std::fprintf(stderr, "%d 階の通路が足りず、階段やモンスターを置ききれません (--monsters を減らすか迷路を広げてください)\n",
+                 game.fullFloorNumber());
+    return true;
+}
+
+// ヘッドレス実行の結果を表示する
+void printHeadlessReport(const char* mode, uint64_t seed, const HeadlessReport& report) {
+    std::printf("--- %s (シード: %llu) ---\n", mode, static_cast<unsigned long long>(seed));
+    std::printf("結果: %s  ステップ: %llu  ティック: %llu  戦闘: %llu\n", report.outcome,
+                static_cast<unsigned long long>(report.steps), static_cast<unsigned long long>(report.ticks),
+                static_cast<unsigned long long>(report.battles));
+    std::printf("生成: %.3f 秒  ループ: %.3f 秒  (%.0f ステップ/秒)\n", report.generation_seconds, report.seconds,
+                report.seconds > 0 ? report.steps / report.seconds : 0.0);
+    std::printf("フロア: 生成 %llu  メモリ上 %zu  差分 %zu\n", static_cast<unsigned long long>(report.floors_generated),
+                report.floors_cached, report.floor_deltas);
+
+    std::printf("\n処理ごとの時間:\n");
+    for (int i = 0; i < PHASE_COUNT; ++i) {
+        std::printf("  %10.3f ミリ秒  (%5.1f%%)  %s\n", report.phase_seconds[i] * 1e3,
+                    report.seconds > 0 ? 100.0 * report.phase_seconds[i] / report.seconds : 0.0, PHASE_NAMES[i]);
+    }
+    std::printf("\n状態ハッシュ: %016llx\n", static_cast<unsigned long long>(report.state_hash));
+}
+
+// 既定の大きさ (チャンク分割なし) なら固定サイズの DefaultMazeGame、それ以外は実行時サイズの MazeGame を使う
+// どちらでも遊び方・乱数・状態ハッシュ・セーブファイルは同じ
+inline bool usesDefaultMazeGame(int width, int height, int floor_count, bool chunked) {
+    return !chunked && width == MAZE_WIDTH && height == MAZE_HEIGHT && floor_count == NUM_FLOORS;
+}
+
+// 設定に合ったゲームを作って play(game) を呼ぶ
+template <class Play>
+int withMazeGame(int width, int height, int floor_count, bool chunked, uint64_t seed, unsigned threads,
+                 int monsters, int chase_radius, Play play) {
+    if (usesDefaultMazeGame(width, height, floor_count, chunked)) {
+        DefaultMazeGame game(width, height, floor_count, seed, threads, monsters, chase_radius);
+        return play(game);
+    }
+    MazeGame game(width, height, floor_count, seed, threads, monsters, chase_radius);
+    game.setChunkedFloors(chunked);
+    return play(game);
+}
+
+// --------------------------------------------------
+// 自動プレイ (--autoplay)
+// バランスの確認用に、画面なしでダンジョンを最後まで進めるボット
+// 手番ごとに今の状態からビームサーチで先を読み、最も評価の高い末端へ向かう最初の1手を指す
+// 各深さで、残っている状態 (最大でビーム幅) に4方向のキーを1つずつ試し、評価の高いものから次の深さに残す
+// (壁にぶつかるだけのキーは試さない。同じ階・位置・HP に着いた状態は最も評価の高いものだけを残す)
+// 評価は 階 > 出口 (上り階段、最上階ならゴール) までの歩数 > HP の順に重い
+// 戦闘になるキーは進めず (本物の戦闘の乱数で結果を先に知ってしまう)、戦闘の見込みで評価した末端にする
+// 状態はゲームのスナップショットで持ち、子の展開はワーカーごとのゲームで並行に行う (スレッドの数によらず同じ手を指す)
+// --------------------------------------------------
+const int AUTOPLAY_BEAM_WIDTH = 16;   // --beam
+const int AUTOPLAY_DEPTH = 6;         // --beam-depth
+const int AUTOPLAY_MAX_STEPS = 5000;  // 1ゲームの手数の上限 (超えたら打ち切る)
+const int AUTOPLAY_PATIENCE = 200;    // この手数の間、評価が一度も上がらなければ先に進めないとみなして打ち切る
+
+// 1ゲーム分の結果
+struct AutoplayResult {
+    const char* outcome;  // outcomeName() の値 (手数の上限などで打ち切ったら "stuck")
+    uint64_t steps;
+    int floor;
+    int hp;
+    uint64_t states;      // 探索で作った状態の数
+};
+
+template <class Game>
+class AutoplayBot {
+public:
+    using Snapshot = typename Game::Snapshot;
+
+    // games[0] を実際に進め、games[1..] をワーカーごとの展開に使う (どれも同じ設定・同じシードで作っておく)
+    // pool があれば、展開を pool のスレッドと呼び出し元で分け合う (games の数は pool のスレッド数 + 2)
+    AutoplayBot(std::vector<std::unique_ptr<Game>>& game_list, int floor_count, ThreadPool* thread_pool,
+                int beam_width, int search_depth)
+        : games(game_list), pool(thread_pool), beamWidth(static_cast<size_t>(std::max(1, beam_width))),
+          depth(std::max(1, search_depth)), states(0) {
+        exits.resize(static_cast<size_t>(floor_count));
+        forEachWorker(exits.size(), [this](size_t i, Game& worker) {
+            exits[i] = worker.exitDistances(static_cast<int>(i) + 1);
+        });
+    }
+
+    // ゲームが終わるか、max_steps 手指すか、patience 手の間評価が上がらなくなるまで進める
+    AutoplayResult play(uint64_t max_steps, uint64_t patience) {
+        Game& game = *games[0];
+        game.startSteps();
+        int64_t best = evaluate(game);
+        uint64_t best_step = 0;
+        while (game.playing() && game.steps() < max_steps && game.steps() - best_step < patience) {
+            game.stepKey(chooseKey());
+            int64_t score = evaluate(game);
+            if (score > best) {
+                best = score;
+                best_step = game.steps();
+            }
+        }
+        return { game.playing() ? "stuck" : game.outcomeName(), game.steps(), game.floorNumber(), game.playerHp(),
+                 states };
+    }
+
+private:
+    // 探索の1状態
+    struct Node {
+        Snapshot state;
+        size_t parent;   // 1つ前の深さの frontier の添字
+        char key;        // parent から進めたキー
+        char first_key;  // 根から最初に指したキー
+        bool expanded;   // state を作り終えたか (終わったゲームと戦闘はそれ以上広げずに次の深さへ持ち越す)
+        bool finished;   // ゲームが終わったか、戦闘の見込みで評価した末端 (state は持たない)
+        bool dropped;    // 何も起きないキーだったので捨てる
+        int64_t score;
+        uint64_t place;  // 同じ局面とみなす (階, 位置, HP)
+    };
+
+    static constexpr int64_t kCleared = INT64_C(1) << 60;
+    static constexpr int64_t kLost = -(INT64_C(1) << 60);
+    static constexpr int64_t kFloorScore = INT64_C(1) << 40;
+    static constexpr int64_t kStepScore = 1000;      // 出口に1歩近いことの重み
+    static constexpr int64_t kHpScore = 1;           // HP 1 の重み (同じ歩数の状態どうしを比べるときだけ効く)
+    static constexpr double kRiskScore = 300.0 * kStepScore;  // HP を満タンにすれば上がる勝率 1.0 あたりの重み
+    static constexpr char kKeys[4] = { 'w', 'a', 's', 'd' };
+
+    std::vector<std::unique_ptr<Game>>& games;
+    ThreadPool* pool;
+    size_t beamWidth;
+    int depth;
+    uint64_t states;
+    std::vector<DistanceField> exits;  // 階ごとの出口までの歩数 (作った後は読むだけなので、ワーカーで共有する)
+    std::vector<Node> frontier;
+    std::vector<Node> children;
+    std::unordered_set<uint64_t> seen;
+
+    // [0, count) の各 i について fn(i, ワーカーのゲーム) を実行する
+    // ワーカー w は i = w, w + ワーカー数, ... を受け持つ (同じゲームを2つのスレッドが使わない)
+    template <class Fn>
+    void forEachWorker(size_t count, Fn fn) {
+        size_t workers = games.size() - 1;
+        auto run = [&](size_t w) {
+            for (size_t i = w; i < count; i += workers) {
+                fn(i, *games[w + 1]);
+            }
+        };
+        if (pool) {
+            pool->parallelFor(workers, run);
+        }
+        else {
+            run(0);
+        }
+    }
+
+    char chooseKey() {
+        Game& game = *games[0];
+        frontier.clear();
+        frontier.push_back({ game.snapshot(), 0, 0, 0, true, false, false, 0, 0 });
+        for (int level = 0; level < depth; ++level) {
+            children.clear();
+            for (size_t parent = 0; parent < frontier.size(); ++parent) {
+                if (frontier[parent].finished) {
+                    children.push_back(frontier[parent]);
+                    continue;
+                }
+                for (char key : kKeys) {
+                    char first_key = level == 0 ? key : frontier[parent].first_key;
+                    children.push_back({ Snapshot(), parent, key, first_key, false, false, false, 0, 0 });
+                }
+            }
+            forEachWorker(children.size(), [this](size_t i, Game& worker) {
+                if (!children[i].expanded) {
+                    expand(children[i], worker);
+                }
+            });
+            for (const Node& child : children) {
+                states += child.parent < frontier.size() && !frontier[child.parent].finished ? 1 : 0;
+            }
+            children.erase(std::remove_if(children.begin(), children.end(),
+                                          [](const Node& child) { return child.dropped; }),
+                           children.end());
+            if (children.empty()) {
+                break;  // どのキーでも何も起きない (ふつうは起きない)
+            }
 
-        for (const auto& row : current_maze) {
-            for (char cell : row) {
-                std::cout << cell << " ";
+            // 評価の高い順 (同点なら作った順) に、同じ局面を除いてビーム幅まで残す
+            std::stable_sort(children.begin(), children.end(),
+                             [](const Node& a, const Node& b) { return a.score > b.score; });
+            frontier.clear();
+            seen.clear();
+            for (Node& child : children) {
+                if (frontier.size() >= beamWidth) {
+                    break;
+                }
+                if (seen.insert(child.place).second) {
+                    frontier.push_back(std::move(child));
+                }
             }
-            std::cout << std::endl;
         }
+        return frontier.empty() || frontier.front().first_key == 0 ? kKeys[0] : frontier.front().first_key;
+    }
+
+    // 親の状態を worker に戻してキーを1つ進め、子の状態と評価を作る
+    // 戦闘になるキーは進めずに、見込みの期待値で評価した末端にする
+    void expand(Node& node, Game& worker) {
+        std::string error;
+        // 同じ設定で作ったゲームどうしなので失敗しない
+        worker.restoreSnapshot(frontier[node.parent].state, error);
+        typename Game::KeyPreview preview = worker.previewKey(node.key);
+        node.expanded = true;
+        if (!preview.moves) {
+            node.dropped = true;
+            return;
+        }
+        if (preview.battle) {
+            node.finished = true;
+            node.score = battleScore(worker, preview);
+            node.place = placeKey(worker.floorNumber(), preview.target_x, preview.target_y, worker.playerHp())
+                       | kBattlePlace;
+            return;
+        }
+        worker.stepKey(node.key);
+        node.state = worker.snapshot();
+        node.finished = !worker.playing();
+        node.score = evaluate(worker);
+        node.place = placeKey(worker.floorNumber(), worker.playerWorldX(), worker.playerWorldY(), worker.playerHp());
+    }
+
+    // 同じ局面とみなす (階, 位置, HP)。戦闘の末端は kBattlePlace を足して、着いた状態と区別する
+    static constexpr uint64_t kBattlePlace = UINT64_C(1) << 63;
+
+    static uint64_t placeKey(int floor, int x, int y, int hp) {
+        return static_cast<uint64_t>(static_cast<uint16_t>(floor)) << 48
+             | static_cast<uint64_t>(static_cast<uint16_t>(x)) << 32
+             | static_cast<uint64_t>(static_cast<uint16_t>(y)) << 16
+             | static_cast<uint16_t>(hp);
+    }
+
+    // 戦闘になるキーの評価: 勝ったときの位置と HP の評価から、HP を満タンにしてから戦えば上がる勝率の分を引く
+    int64_t battleScore(const Game& game, const typename Game::KeyPreview& preview) const {
+        const BattleOdds& odds = preview.odds;
+        if (odds.win <= 0.0) {
+            return kLost;
+        }
+        // 失う HP の期待値は負けたとき (残りの HP を全て失う) も含むので、勝ったときだけの期待値に直す
+        int hp = game.playerHp();
+        double win_loss = (odds.expected_hp_loss - (1.0 - odds.win) * hp) / odds.win;
+        int hp_after = std::max(1, std::min(hp, static_cast<int>(hp - win_loss + 0.5)));
+        double regret = std::max(0.0, preview.rested_odds.win - odds.win) * kRiskScore;
+        return positionScore(game.floorNumber(), preview.target_x, preview.target_y, hp_after)
+             - static_cast<int64_t>(regret);
+    }
+
+    int64_t evaluate(const Game& game) const {
+        if (!game.playing()) {
+            return game.finished() && game.playerHp() > 0 ? kCleared - static_cast<int64_t>(game.steps()) : kLost;
+        }
+        return positionScore(game.floorNumber(), game.playerWorldX(), game.playerWorldY(), game.playerHp());
+    }
 
-        std::cout << "\nWASD または 矢印キーで移動 (Qで終了), P:プレイヤー, M:モンスター, S:スタート, E:ゴール, U:上り階段, D:下り階段, #:壁" << std::endl;
+    // floor 階の (x, y) に HP hp でいる状態の評価
+    int64_t positionScore(int floor, int x, int y, int hp) const {
+        const DistanceField& exit = exits[static_cast<size_t>(floor - 1)];
+        uint32_t distance = exit.valid() ? exit.distance(x, y) : DistanceField::kUnreachable;
+        // 出口に届かない位置は、その階のどこよりも悪いとみなす
+        int64_t steps_left = distance == DistanceField::kUnreachable ? kFloorScore / kStepScore / 2 : distance;
+        return floor * kFloorScore - steps_left * kStepScore + hp * kHpScore;
     }
 };
 
-int main() {
-    MazeGame game;
-    game.run();
+// 自動プレイを game_count 回 (シードは seed から1ずつ増やす) 行い、各ゲームの結果とクリア率、
+// 1秒あたりに探索した状態の数を出す。make_game(seed) は設定を済ませたゲームを作る
+// threads は展開に使うスレッドの数 (呼び出し元を含む。0 ならハードウェアスレッド数)
+template <class Game, class MakeGame>
+int runAutoplay(int game_count, uint64_t seed, int floor_count, unsigned threads, int beam_width, int depth,
+                MakeGame make_game) {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    std::unique_ptr<ThreadPool> pool;
+    if (threads > 1) {
+        pool.reset(new ThreadPool(threads - 1));
+    }
+    std::printf("--- 自動プレイ (シード: %llu から %d ゲーム  ビーム幅 %d  深さ %d  スレッド %u) ---\n",
+                static_cast<unsigned long long>(seed), game_count, beam_width, depth, threads);
+
+    int cleared = 0;
+    uint64_t states = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < game_count; ++i) {
+        std::vector<std::unique_ptr<Game>> games;
+        for (unsigned w = 0; w <= threads; ++w) {
+            games.push_back(make_game(seed + i));
+        }
+        AutoplayBot<Game> bot(games, floor_count, pool.get(), beam_width, depth);
+        AutoplayResult result = bot.play(AUTOPLAY_MAX_STEPS, AUTOPLAY_PATIENCE);
+        cleared += std::strcmp(result.outcome, "clear") == 0 ? 1 : 0;
+        states += result.states;
+        std::printf("シード %llu: %-5s  歩数 %5llu  階 %d  HP %3d  探索 %llu 状態\n",
+                    static_cast<unsigned long long>(seed + i), result.outcome,
+                    static_cast<unsigned long long>(result.steps), result.floor, result.hp,
+                    static_cast<unsigned long long>(result.states));
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 
+    std::printf("\nクリア率: %.1f%% (%d / %d)\n", game_count > 0 ? 100.0 * cleared / game_count : 0.0, cleared,
+                game_count);
+    std::printf("探索した状態: %llu  (%.3f 秒, %.0f 状態/秒)\n", static_cast<unsigned long long>(states), seconds,
+                seconds > 0 ? states / seconds : 0.0);
     return 0;
-}
\ No newline at end of file
+}
+
+// bench.cpp はこのファイルを取り込んで使うので、main を除外できるようにする
+#ifndef MAZE002_NO_MAIN
+int main(int argc, char* argv[]) {
+    int width = MAZE_WIDTH;
+    int height = MAZE_HEIGHT;
+    int floor_count = NUM_FLOORS;
+    uint64_t seed = RngService::randomSeed();
+    unsigned threads = 1;
+    int monsters = MONSTER_COUNT;
+    int chase_radius = CHASE_RADIUS;
+    int tick_ms = TICK_MS;
+    int monster_tick_ms = 0;
+    const char* script_path = nullptr;
+    const char* replay_path = nullptr;
+    const char* record_path = nullptr;
+    const char* save_path = nullptr;
+    const char* load_path = nullptr;
+    bool chunked = false;
+    bool size_given = false;
+    MazeAlgorithm algorithm = MazeAlgorithm::Dfs;
+    const char* generate_path = nullptr;
+    MazeFileFormat generate_format = MazeFileFormat::Text;
+    uint64_t generate_height = static_cast<uint64_t>(MAZE_HEIGHT);
+    int auto_battle = -1;
+    int fog_radius = 0;
+    int world_radius = 0;
+    int autoplay_games = 0;
+    int beam_width = AUTOPLAY_BEAM_WIDTH;
+    int beam_depth = AUTOPLAY_DEPTH;
+    int odds_floors = 0;
+    const char* serve_address = nullptr;
+    const char* loadgen_address = nullptr;
+    unsigned workers = 0;
+    int load_clients = 100;
+    int load_idle = 0;
+    double run_seconds = 0;
+
+    // コマンドライン引数: --width N --height N --floors N (0 なら無限) --seed N --monsters N --chase-radius N
+    //                     --threads N (次のフロアを裏で生成するスレッド数。0 なら先読みしない。
+    //                                  ワールドティックではフロアを並行に進めるスレッド数にもなる)
+    //                     --tick-ms N --monster-tick-ms N (0 ならプレイヤーが動くたびにモンスターも動く)
+    //                     --script FILE (キー列を画面なしで実行) --replay FILE (記録を画面なしで再生)
+    //                     --record FILE (遊んだ入力を記録する)
+    //                     --save FILE (Q で終了したときに状態を書き出す) --load FILE (書き出した状態から再開する)
+    //                     --chunked (フロアを 64 四方のチャンクに分け、周りだけを生成する。既定は 4097 四方。
+    //                                --monsters はチャンクあたりの数になる)
+    //                     --algo dfs|eller (迷路の生成方法。既定は dfs)
+    //                     --generate FILE (Eller 法の迷路を FILE に書き出して終わる。"-" なら標準出力。
+    //                                      --height は 64 ビットまで指定できる) --format text|bits (既定は text)
+    //                     --auto-battle PCT (勝率が PCT% 以上の戦闘はその場で決着させる)
+    //                     --fog N (霧: N 歩以内で視線の通るセルだけを見せる。0 なら全体を見せる。最大 31)
+    //                     --world-tick N (現在の階から N 階以内を読み込んだままにし、毎ターン読み込み済みの
+    //                                     全フロアのモンスターを動かす。階段を使って階を移るモンスターもいる)
+    //                     --odds N (1..N 階の戦闘の見込みの表を出して終わる)
+    //                     --serve unix:PATH|tcp:PORT (多数のセッションを受け付けるサーバーになる。
+    //                                                 ゲームの設定は上の引数のものを全セッションで使う)
+    //                     --loadgen unix:PATH|tcp:PORT (サーバーに負荷をかける) --clients N (キーを送る接続数)
+    //                     --idle N (つなぐだけの接続数) --seconds S (実行時間。サーバーでは 0 なら止めるまで)
+    //                     --workers N (サーバーのワーカー / 負荷テスト・自動プレイのスレッド数。0 ならハードウェアスレッド数)
+    //                     --autoplay N (ボットがビームサーチで N 個のダンジョンを遊び、クリア率を出して終わる。
+    //                                   シードは --seed から1ずつ増やす) --beam N (ビーム幅) --beam-depth N (読む深さ)
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--width" && i + 1 < argc) {
+            width = normalizeMazeSize(std::atoi(argv[++i]));
+            size_given = true;
+        }
+        else if (arg == "--height" && i + 1 < argc) {
+            // 書き出しモード用に、int に収まらない高さもそのまま取っておく
+            generate_height = std::strtoull(argv[++i], nullptr, 10);
+            height = normalizeMazeSize(static_cast<int>(std::min<uint64_t>(generate_height, INT32_MAX - 1)));
+            size_given = true;
+        }
+        else if (arg == "--chunked") {
+            chunked = true;
+        }
+        else if (arg == "--algo" && i + 1 < argc) {
+            if (!parseMazeAlgorithm(argv[++i], algorithm)) {
+                std::cerr << "知らない生成方法です: " << argv[i] << " (dfs または eller)" << std::endl;
+                return 1;
+            }
+        }
+        else if (arg == "--auto-battle" && i + 1 < argc) {
+            auto_battle = std::max(0, std::min(1000, static_cast<int>(std::atof(argv[++i]) * 10 + 0.5)));
+        }
+        else if (arg == "--fog" && i + 1 < argc) {
+            fog_radius = std::max(0, std::atoi(argv[++i]));
+        }
+        else if (arg == "--autoplay" && i + 1 < argc) {
+            autoplay_games = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (arg == "--beam" && i + 1 < argc) {
+            beam_width = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (arg == "--beam-depth" && i + 1 < argc) {
+            beam_depth = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (arg == "--world-tick" && i + 1 < argc) {
+            world_radius = std::max(0, std::atoi(argv[++i]));
+        }
+        else if (arg == "--odds" && i + 1 < argc) {
+            odds_floors = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (arg == "--serve" && i + 1 < argc) {
+            serve_address = argv[++i];
+        }
+        else if (arg == "--loadgen" && i + 1 < argc) {
+            loadgen_address = argv[++i];
+        }
+        else if (arg == "--workers" && i + 1 < argc) {
+            workers = static_cast<unsigned>(std::max(0, std::atoi(argv[++i])));
+        }
+        else if (arg == "--clients" && i + 1 < argc) {
+            load_clients = std::max(0, std::atoi(argv[++i]));
+        }
+        else if (arg == "--idle" && i + 1 < argc) {
+            load_idle = std::max(0, std::atoi(argv[++i]));
+        }
+        else if (arg == "--seconds" && i + 1 < argc) {
+            run_seconds = std::max(0.0, std::atof(argv[++i]));
+        }
+        else if (arg == "--generate" && i + 1 < argc) {
+            generate_path = argv[++i];
+        }
+        else if (arg == "--format" && i + 1 < argc) {
+            std::string name = argv[++i];
+            if (name != "text" && name != "bits") {
+                std::cerr << "知らない形式です: " << name << " (text または bits)" << std::endl;
+                return 1;
+            }
+            generate_format = name == "bits" ? MazeFileFormat::Bits : MazeFileFormat::Text;
+        }
+        else if (arg == "--floors" && i + 1 < argc) {
+            // 0 なら上り階段が無限に続く (ゴールなし)
+            int floors = std::max(0, std::atoi(argv[++i]));
+            floor_count = floors == 0 ? 0 : std::max(2, floors);
+        }
+        else if (arg == "--seed" && i + 1 < argc) {
+            seed = RngService::seedFromString(argv[++i]);
+        }
+        else if (arg == "--threads" && i + 1 < argc) {
+            threads = static_cast<unsigned>(std::max(0, std::atoi(argv[++i])));
+        }
+        else if (arg == "--monsters" && i + 1 < argc) {
+            monsters = std::max(0, std::atoi(argv[++i]));
+        }
+        else if (arg == "--chase-radius" && i + 1 < argc) {
+            chase_radius = std::max(0, std::atoi(argv[++i]));
+        }
+        else if (arg == "--tick-ms" && i + 1 < argc) {
+            tick_ms = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (arg == "--monster-tick-ms" && i + 1 < argc) {
+            monster_tick_ms = std::max(0, std::atoi(argv[++i]));
+        }
+        else if (arg == "--script" && i + 1 < argc) {
+            script_path = argv[++i];
+        }
+        else if (arg == "--replay" && i + 1 < argc) {
+            replay_path = argv[++i];
+        }
+        else if (arg == "--record" && i + 1 < argc) {
+            record_path = argv[++i];
+        }
+        else if (arg == "--save" && i + 1 < argc) {
+            save_path = argv[++i];
+        }
+        else if (arg == "--load" && i + 1 < argc) {
+            load_path = argv[++i];
+        }
+    }
+
+    if (odds_floors > 0) {
+        printBattleOddsTable(odds_floors);
+        return 0;
+    }
+
+    // 迷路の書き出しだけをして終わる (高さは奇数に揃える)
+    if (generate_path) {
+        generate_height = std::max<uint64_t>(5, generate_height | 1);
+        return generateMazeFile(generate_path, generate_format, width, generate_height, seed);
+    }
+
+    if (chunked) {
+        width = normalizeChunkedSize(size_given ? width : CHUNKED_DEFAULT_SIZE);
+        height = normalizeChunkedSize(size_given ? height : CHUNKED_DEFAULT_SIZE);
+        if (save_path || load_path) {
+            std::cerr << "チャンク分割モードではセーブ・ロードできません" << std::endl;
+            return 1;
+        }
+    }
+
+    // 自動プレイ: 同じ設定のゲームをシードごと・ワーカーごとに作る
+    if (autoplay_games > 0) {
+        if (chunked || floor_count == 0) {
+            std::cerr << "自動プレイはチャンク分割モードと無限の階では使えません" << std::endl;
+            return 1;
+        }
+        // ゲームは make_game が1つずつ作るので、ここでは型だけを選ぶ (game_type はその型の空ポインタ)
+        auto autoplay = [&](auto* game_type) {
+            using Game = typename std::remove_pointer<decltype(game_type)>::type;
+            return runAutoplay<Game>(autoplay_games, seed, floor_count, workers, beam_width, beam_depth,
+                                     [&](uint64_t game_seed) {
+                std::unique_ptr<Game> game(new Game(width, height, floor_count, game_seed, 0, monsters, chase_radius));
+                game->setMazeAlgorithm(algorithm);
+                game->setAutoBattle(auto_battle);
+                game->setWorldTick(world_radius);
+                game->setEventSink(nullptr);
+                return game;
+            });
+        };
+        return usesDefaultMazeGame(width, height, floor_count, chunked) ? autoplay(static_cast<DefaultMazeGame*>(nullptr))
+                                                                       : autoplay(static_cast<MazeGame*>(nullptr));
+    }
+
+    // サーバーと負荷テスト
+    if (serve_address || loadgen_address) {
+#ifdef __linux__
+        SocketAddress address;
+        std::string error;
+        if (!parseSocketAddress(serve_address ? serve_address : loadgen_address, address, error)) {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+        if (loadgen_address) {
+            return runLoadGenerator(address, load_clients, load_idle, run_seconds > 0 ? run_seconds : 10.0,
+                                    workers, seed);
+        }
+        MazeSettings settings = { width, height, floor_count, seed, monsters, chase_radius, tick_ms,
+                                  monster_tick_ms, chunked, algorithm, auto_battle };
+        MazeServer server(settings, workers);
+        return server.run(address, run_seconds);
+#else
+        std::cerr << "サーバーと負荷テストは Linux でのみ使えます" << std::endl;
+        return 1;
+#endif
+    }
+
+    // リプレイの再生: 設定はすべてファイルに記録されたものを使う
+    if (replay_path) {
+        ReplayLog log;
+        std::string error;
+        if (!log.load(replay_path, error)) {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+        if (!parseMazeAlgorithm(log.algorithm, algorithm)) {
+            std::cerr << "リプレイファイルの生成方法が不正です: " << log.algorithm << std::endl;
+            return 1;
+        }
+        return withMazeGame(log.width, log.height, log.floors, log.chunked, log.seed, threads, log.monsters,
+                            log.chase_radius, [&](auto& game) {
+            game.setTickInterval(log.tick_ms, log.monster_tick_ms);
+            game.setMazeAlgorithm(algorithm);
+            game.setAutoBattle(log.auto_battle);
+            game.setWorldTick(log.world_radius);
+            game.setEventSink(nullptr);
+            HeadlessReport report = game.runHeadless(log.inputs, true, log.has_end ? log.end_tick : 0);
+            printHeadlessReport("リプレイ", log.seed, report);
+            if (reportFullFloor(game)) {
+                return 1;
+            }
+            if (log.has_end) {
+                bool match = report.state_hash == log.end_hash && report.ticks == log.end_tick;
+                std::printf("記録との照合: %s\n", match ? "一致" : "不一致");
+                return match ? 0 : 2;
+            }
+            return 0;
+        });
+    }
+
+    // セーブファイルからの再開: ダンジョンの設定はファイルに書かれたものを使う
+    std::unique_ptr<MappedFile> save_file;
+    if (load_path) {
+        save_file.reset(new MappedFile);
+        std::string error;
+        const SaveHeader* header = openSaveFile(*save_file, load_path, error);
+        if (!header) {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+        seed = header->seed;
+        width = header->width;
+        height = header->height;
+        floor_count = header->floors;
+        monsters = header->monsters_per_floor;
+        chase_radius = header->chase_radius;
+        if (header->maze_algorithm != static_cast<int32_t>(MazeAlgorithm::Dfs)
+            && header->maze_algorithm != static_cast<int32_t>(MazeAlgorithm::Eller)) {
+            std::cerr << "セーブファイルの生成方法が不正です: " << load_path << std::endl;
+            return 1;
+        }
+        algorithm = static_cast<MazeAlgorithm>(header->maze_algorithm);
+    }
+
+    return withMazeGame(width, height, floor_count, chunked, seed, threads, monsters, chase_radius, [&](auto& game) {
+        game.setTickInterval(tick_ms, monster_tick_ms);
+        game.setMazeAlgorithm(algorithm);
+        game.setAutoBattle(auto_battle);
+        game.setFogOfWar(fog_radius);
+        game.setWorldTick(world_radius);
+        if (save_file) {
+            std::string error;
+            if (!game.restore(std::move(save_file), error)) {
+                std::cerr << error << ": " << load_path << std::endl;
+                return 1;
+            }
+        }
+
+        // 途中で終了したときだけ書き出す (ゲームオーバーやクリアの後は続きがない)
+        auto save_if_quit = [&game, save_path]() {
+            if (save_path && !game.finished()) {
+                if (!game.saveGame(save_path)) {
+                    std::cerr << "セーブファイルを書き込めません: " << save_path << std::endl;
+                    return false;
+                }
+                std::cout << "セーブしました: " << save_path << std::endl;
+            }
+            return true;
+        };
+
+        // キースクリプトの実行
+        if (script_path) {
+            std::vector<ReplayInput> inputs;
+            if (!loadKeyScript(script_path, inputs)) {
+                std::cerr << "スクリプトファイルを開けません: " << script_path << std::endl;
+                return 1;
+            }
+            game.setEventSink(nullptr);
+            HeadlessReport report = game.runHeadless(inputs, false);
+            printHeadlessReport("スクリプト", seed, report);
+            if (reportFullFloor(game)) {
+                return 1;
+            }
+            return save_if_quit() ? 0 : 1;
+        }
+
+        ReplayLog log;
+        if (record_path) {
+            game.setRecorder(&log.inputs);
+        }
+
+        game.run();
+
+        if (reportFullFloor(game)) {
+            return 1;
+        }
+        if (!save_if_quit()) {
+            return 1;
+        }
+
+        if (record_path) {
+            log.seed = seed;
+            log.width = width;
+            log.height = height;
+            log.floors = floor_count;
+            log.monsters = monsters;
+            log.chase_radius = chase_radius;
+            log.tick_ms = tick_ms;
+            log.monster_tick_ms = monster_tick_ms;
+            log.chunked = chunked;
+            log.algorithm = mazeAlgorithmName(algorithm);
+            log.auto_battle = auto_battle;
+            log.world_radius = world_radius;
+            log.has_end = true;
+            log.end_tick = game.currentTick();
+            log.end_hash = game.stateHash();
+            if (!log.save(record_path)) {
+                std::cerr << "リプレイファイルを書き込めません: " << record_path << std::endl;
+                return 1;
+            }
+        }
+
+        return 0;
+    });
+}
+#endif
@@ -0,0 +1,258 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "paged_array.h"
+
+// --------------------------------------------------
+// 固定サイズと実行時サイズ
+// グリッドやゲームのテンプレート引数に幅・高さを渡すと、その値がコンパイル時の定数になり、
+// 配列は std::array に置かれ、範囲の判定は定数との比較に畳み込まれる
+// DYNAMIC_SIZE を渡すと、これまでどおり実行時に決めたサイズを持ち std::vector に置く
+// どちらも同じコードから作る
+// --------------------------------------------------
+
+const int DYNAMIC_SIZE = -1;
+
+// サイズの値 (N が DYNAMIC_SIZE なら int を持ち、そうでなければ何も持たずに N と読める)
+template <int N>
+class Extent {
+public:
+    static constexpr bool fixed = true;
+
+    constexpr Extent() {}
+
+    // 固定サイズと違う値は入れられない (呼び出し側で固定サイズのゲームを選ぶ条件を間違えている)
+    Extent(int value) {
+        if (value != N) {
+            std::fprintf(stderr, "固定サイズ %d に %d は指定できません\n", N, value);
+            std::abort();
+        }
+    }
+
+    constexpr operator int() const { return N; }
+};
+
+template <>
+class Extent<DYNAMIC_SIZE> {
+public:
+    static constexpr bool fixed = false;
+
+    Extent(int value = 0) : size(value) {}
+
+    operator int() const { return size; }
+
+private:
+    int size;
+};
+
+// 要素数 Count の平らな配列 (Count が DYNAMIC_SIZE なら std::vector)
+// 固定サイズの assign は要素数を変えない (数は Extent の側で確かめてある)
+template <class T, int Count>
+class CellStorage {
+public:
+    void assign(size_t, T fill) { cells.fill(fill); }
+    void assign(const T* first, const T* last) { std::copy(first, last, cells.begin()); }
+
+    size_t size() const { return static_cast<size_t>(Count); }
+    T* data() { return cells.data(); }
+    const T* data() const { return cells.data(); }
+    T& operator[](size_t i) { return cells[i]; }
+    const T& operator[](size_t i) const { return cells[i]; }
+
+private:
+    std::array<T, static_cast<size_t>(Count)> cells{};
+};
+
+template <class T>
+class CellStorage<T, DYNAMIC_SIZE> {
+public:
+    void assign(size_t count, T fill) { cells.assign(count, fill); }
+    void assign(const T* first, const T* last) { cells.assign(first, last); }
+
+    size_t size() const { return cells.size(); }
+    T* data() { return cells.data(); }
+    const T* data() const { return cells.data(); }
+    T& operator[](size_t i) { return cells[i]; }
+    const T& operator[](size_t i) const { return cells[i]; }
+
+private:
+    std::vector<T> cells;
+};
+
+// CellStorage と同じ使い方で、実行時サイズのときはページ単位の copy-on-write 配列に置く
+// (ゲームを進めると書き換わり、スナップショットと共有する層用。固定サイズは小さいのでそのまま写す)
+// 書き込みは非 const の operator[] で行い、そのときに共有しているページだけを複製する
+template <class T, int Count>
+class PagedCellStorage : public CellStorage<T, Count> {};
+
+template <class T>
+class PagedCellStorage<T, DYNAMIC_SIZE> {
+public:
+    void assign(size_t count, T fill) { cells.assign(count, fill); }
+    void assign(const T* first, const T* last) { cells.assign(first, last); }
+
+    size_t size() const { return cells.size(); }
+    T& operator[](size_t i) { return cells.write(i); }
+    const T& operator[](size_t i) const { return cells[i]; }
+
+private:
+    PagedArray<T> cells;
+};
+
+// width x height のセル数と、1セル1ビットで詰めたときの 64 ビット語の数 (どちらかが実行時なら DYNAMIC_SIZE)
+constexpr int gridCellCount(int width, int height) {
+    return width == DYNAMIC_SIZE || height == DYNAMIC_SIZE ? DYNAMIC_SIZE : width * height;
+}
+
+constexpr int gridWordCount(int width, int height) {
+    return width == DYNAMIC_SIZE || height == DYNAMIC_SIZE ? DYNAMIC_SIZE : (width * height + 63) / 64;
+}
+
+// --------------------------------------------------
+// 迷路グリッド (MazeGrid)
+// 行優先 (row-major) で1つの連続領域に格納する2次元の文字グリッド
+// 地形 ('#', ' ', 'S', 'E', 'U', 'D') とその上に重ねる表示 ('P', 'M') を保持する
+// --------------------------------------------------
+template <int W, int H>
+class BasicMazeGrid {
+public:
+    BasicMazeGrid() {}
+
+    BasicMazeGrid(int width, int height, char fill) {
+        assign(width, height, fill);
+    }
+
+    // サイズを変更して全セルを fill で埋める
+    void assign(int width, int height, char fill) {
+        gridWidth = width;
+        gridHeight = height;
+        cells.assign(static_cast<size_t>(width) * height, fill);
+    }
+
+    // サイズを変更して width * height バイトの source を丸ごと写す (セーブファイルからの復元用)
+    void assignData(int width, int height, const char* source) {
+        gridWidth = width;
+        gridHeight = height;
+        cells.assign(source, source + static_cast<size_t>(width) * height);
+    }
+
+    int width() const { return gridWidth; }
+    int height() const { return gridHeight; }
+    size_t size() const { return cells.size(); }
+
+    // (x, y) の1次元インデックス
+    size_t index(int x, int y) const {
+        return static_cast<size_t>(y) * width() + x;
+    }
+
+    bool inBounds(int x, int y) const {
+        return x >= 0 && x < width() && y >= 0 && y < height();
+    }
+
+    char& operator()(int x, int y) { return cells[index(x, y)]; }
+    char operator()(int x, int y) const { return cells[index(x, y)]; }
+
+    // 行の先頭ポインタ (表示などで1行をまとめて扱うとき用)
+    char* row(int y) { return cells.data() + index(0, y); }
+    const char* row(int y) const { return cells.data() + index(0, y); }
+
+    char* data() { return cells.data(); }
+    const char* data() const { return cells.data(); }
+
+private:
+    Extent<W> gridWidth;
+    Extent<H> gridHeight;
+    CellStorage<char, gridCellCount(W, H)> cells;
+};
+
+using MazeGrid = BasicMazeGrid<DYNAMIC_SIZE, DYNAMIC_SIZE>;
+
+// --------------------------------------------------
+// セルビットマップ (CellBitmap)
+// 1セル1ビットのフラグ層。表示用の文字グリッドとは独立して持つ
+// 壁 (WallBitmap) やモンスターの占有判定に使う
+// Storage に PagedCellStorage を渡すと、複製が安い copy-on-write のビットマップになる
+// (その場合は words() を使えないので、word() で1語ずつ読む)
+// --------------------------------------------------
+template <int W, int H, template <class, int> class Storage = CellStorage>
+class BasicCellBitmap {
+public:
+    BasicCellBitmap() {}
+
+    // サイズを変更して全ビットを0にする
+    void reset(int width, int height) {
+        bitmapWidth = width;
+        bitmapHeight = height;
+        bits.assign((static_cast<size_t>(width) * height + 63) / 64, 0);
+    }
+
+    // グリッドのうち target と一致するセルを1にして作り直す
+    template <int GW, int GH>
+    void buildFrom(const BasicMazeGrid<GW, GH>& grid, char target) {
+        reset(grid.width(), grid.height());
+
+        const char* cell = grid.data();
+        for (size_t i = 0; i < grid.size(); ++i) {
+            if (cell[i] == target) {
+                bits[i >> 6] |= uint64_t(1) << (i & 63);
+            }
+        }
+    }
+
+    // サイズを変更して wordCount() 個の 64 ビット語を source から写す (セーブファイルからの復元用)
+    void assignWords(int width, int height, const uint64_t* source) {
+        bitmapWidth = width;
+        bitmapHeight = height;
+        bits.assign(source, source + (static_cast<size_t>(width) * height + 63) / 64);
+    }
+
+    int width() const { return bitmapWidth; }
+    int height() const { return bitmapHeight; }
+
+    bool test(int x, int y) const {
+        size_t i = static_cast<size_t>(y) * width() + x;
+        return (bits[i >> 6] >> (i & 63)) & 1;
+    }
+
+    void set(int x, int y) {
+        size_t i = static_cast<size_t>(y) * width() + x;
+        bits[i >> 6] |= uint64_t(1) << (i & 63);
+    }
+
+    void clear(int x, int y) {
+        size_t i = static_cast<size_t>(y) * width() + x;
+        bits[i >> 6] &= ~(uint64_t(1) << (i & 63));
+    }
+
+    // ビットを詰めた 64 ビット語の列 (セル i は words()[i / 64] の i % 64 ビット目)
+    const uint64_t* words() const { return bits.data(); }
+    uint64_t word(size_t i) const { return bits[i]; }
+    size_t wordCount() const { return bits.size(); }
+
+    // 使用メモリ (バイト)
+    size_t memoryBytes() const { return bits.size() * sizeof(uint64_t); }
+
+private:
+    Extent<W> bitmapWidth;
+    Extent<H> bitmapHeight;
+    Storage<uint64_t, gridWordCount(W, H)> bits;
+};
+
+using CellBitmap = BasicCellBitmap<DYNAMIC_SIZE, DYNAMIC_SIZE>;
+
+// copy-on-write のセルビットマップ (モンスターの占有や探索済みの記憶など、ゲームを進めると変わる層)
+template <int W, int H>
+using BasicPagedCellBitmap = BasicCellBitmap<W, H, PagedCellStorage>;
+using PagedCellBitmap = BasicPagedCellBitmap<DYNAMIC_SIZE, DYNAMIC_SIZE>;
+
+// 壁ビットマップ: 壁 ('#') のセルが1
+template <int W, int H>
+using BasicWallBitmap = BasicCellBitmap<W, H>;
+using WallBitmap = CellBitmap;
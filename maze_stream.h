@@ -0,0 +1,226 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "rng.h"
+
+// --------------------------------------------------
+// 行ごとに流す迷路生成 (Eller のアルゴリズム)
+// 1行ずつ上から作り、前の行から受け継ぐ集合の情報 (幅に比例する量) だけを持つ
+// 高さに上限がないので、メモリに入らない大きさの迷路もファイルへ流し出せる
+//
+// 迷路の形式はゲーム内と同じ: 幅と高さは奇数、奇数座標がセル、'#' が壁、' ' が通路
+// 各セル行では
+//   1. 上から通路が来ていないセルを新しい集合にする
+//   2. 隣り合う別の集合のセルを確率 1/2 でつなぐ (最後の行では必ずつなぐ)
+//   3. 各集合から確率 1/2 で下へ通路を伸ばす (どの集合も最低1本は伸ばす)
+// 同じ集合のセルは常につながっているので、閉路も孤立もない迷路 (全域木) になる
+// 行の中の集合は Union-Find で管理し、1行あたり O(幅) で済ませる
+// --------------------------------------------------
+class EllerMaze {
+public:
+    // width, height はグリッドの文字数 (奇数, 5 以上)
+    EllerMaze(int width, uint64_t height, RngStream rng)
+        : mazeWidth(width), mazeHeight(height), cellCount((width - 1) / 2), nextRow(0),
+          random(rng), bitCache(0), bitsLeft(0),
+          parent(cellCount), carried(cellCount, kFresh), first(cellCount), members(cellCount),
+          goesDown(cellCount), hasDown(cellCount), wallRow(width, '#') {}
+
+    int width() const { return mazeWidth; }
+    uint64_t height() const { return mazeHeight; }
+    bool done() const { return nextRow >= mazeHeight; }
+
+    // 最後に使った乱数ストリームの状態 (続けて階段などを決めるとき用)
+    RngStream rng() const { return random; }
+
+    // 次の1行 (width 文字) を row に書く。上の行から順に height 回呼ぶ
+    void next(char* row) {
+        uint64_t y = nextRow++;
+        if (y == 0 || y + 1 == mazeHeight) {
+            // 上下の外周 (一番下のセル行の下の壁行もここ)
+            std::memset(row, '#', mazeWidth);
+        }
+        else if (y % 2 == 1) {
+            buildCellRow(row, y + 2 == mazeHeight);
+        }
+        else {
+            std::memcpy(row, wallRow.data(), mazeWidth);
+        }
+    }
+
+private:
+    static constexpr uint32_t kFresh = UINT32_MAX;
+
+    int mazeWidth;
+    uint64_t mazeHeight;
+    int cellCount;
+    uint64_t nextRow;
+    RngStream random;
+    uint64_t bitCache;
+    int bitsLeft;
+    std::vector<uint32_t> parent;    // 行の中の Union-Find (セル番号 -> 親のセル番号)
+    std::vector<uint32_t> carried;   // 上の行から受け継いだ集合 (上の行の代表のセル番号。なければ kFresh)
+    std::vector<uint32_t> first;     // 受け継いだ集合ごとに、この行で最初に現れたセル
+    std::vector<uint32_t> members;   // 代表ごとの要素数
+    std::vector<uint8_t> goesDown;   // セルごと: 下へ通路を伸ばすか
+    std::vector<uint8_t> hasDown;    // 代表ごと: 集合の誰かが下へ伸ばしたか
+    std::vector<char> wallRow;       // 直前のセル行の下の壁行
+
+    // 確率 1/2 の乱数 (64ビットずつまとめて引く)
+    bool coin() {
+        if (bitsLeft == 0) {
+            bitCache = random.next();
+            bitsLeft = 64;
+        }
+        bool bit = bitCache & 1;
+        bitCache >>= 1;
+        --bitsLeft;
+        return bit;
+    }
+
+    uint32_t find(uint32_t cell) {
+        while (parent[cell] != cell) {
+            parent[cell] = parent[parent[cell]];
+            cell = parent[cell];
+        }
+        return cell;
+    }
+
+    // セル行を作って row に書き、その下の壁行を wallRow に用意する
+    void buildCellRow(char* row, bool last_row) {
+        const uint32_t n = static_cast<uint32_t>(cellCount);
+
+        // 1. 上から受け継いだ集合は同じ代表にまとめ、それ以外は1つずつの集合にする
+        for (uint32_t i = 0; i < n; ++i) {
+            first[i] = kFresh;
+        }
+        for (uint32_t i = 0; i < n; ++i) {
+            parent[i] = i;
+            uint32_t label = carried[i];
+            if (label != kFresh) {
+                if (first[label] == kFresh) {
+                    first[label] = i;
+                }
+                else {
+                    parent[i] = first[label];
+                }
+            }
+        }
+
+        // 2. 横につなぐ
+        std::memset(row, '#', mazeWidth);
+        row[1] = ' ';
+        for (uint32_t i = 0; i + 1 < n; ++i) {
+            row[2 * i + 3] = ' ';
+            uint32_t a = find(i);
+            uint32_t b = find(i + 1);
+            if (a != b && (last_row || coin())) {
+                parent[std::max(a, b)] = std::min(a, b);
+                row[2 * i + 2] = ' ';
+            }
+        }
+        if (last_row) {
+            return;
+        }
+
+        // 3. 下へ伸ばす。1本も伸ばさなかった集合は、ランダムな1つのセルから伸ばす
+        for (uint32_t i = 0; i < n; ++i) {
+            members[i] = 0;
+            hasDown[i] = 0;
+        }
+        for (uint32_t i = 0; i < n; ++i) {
+            uint32_t root = find(i);
+            ++members[root];
+            goesDown[i] = coin();
+            hasDown[root] |= goesDown[i];
+        }
+        for (uint32_t i = 0; i < n; ++i) {
+            uint32_t root = find(i);
+            if (!hasDown[root]) {
+                // 代表の位置で members を「あと何個目で伸ばすか」のカウントダウンに使う
+                members[root] = random.below(members[root]) + 1;
+                hasDown[root] = 2;
+            }
+            if (hasDown[root] == 2 && --members[root] == 0) {
+                goesDown[i] = 1;
+            }
+        }
+
+        std::memset(wallRow.data(), '#', mazeWidth);
+        for (uint32_t i = 0; i < n; ++i) {
+            if (goesDown[i]) {
+                wallRow[2 * i + 1] = ' ';
+                carried[i] = find(i);
+            }
+            else {
+                carried[i] = kFresh;
+            }
+        }
+    }
+};
+
+// --------------------------------------------------
+// 迷路の行の書き出し (MazeRowWriter)
+//   テキスト形式: 1行 width 文字 ('#' と ' ') + 改行。ゲームの表示と同じ文字
+//   ビット形式:   ヘッダー (32バイト) の後に、1行 (width + 7) / 8 バイトずつ
+//                 x 番目のセルが壁なら 1 (バイト内は下位ビットから)
+//                   char magic[8] = "MAZEBITS", uint32_t version = 1, uint32_t 予約 (0),
+//                   uint64_t width, uint64_t height   (リトルエンディアン)
+// --------------------------------------------------
+enum class MazeFileFormat {
+    Text,
+    Bits,
+};
+
+class MazeRowWriter {
+public:
+    MazeRowWriter(FILE* output, MazeFileFormat file_format, int width, uint64_t height)
+        : out(output), format(file_format), rowWidth(width), bytesWritten(0) {
+        std::setvbuf(out, nullptr, _IOFBF, 1 << 20);
+        if (format == MazeFileFormat::Bits) {
+            unsigned char header[32] = { 'M', 'A', 'Z', 'E', 'B', 'I', 'T', 'S', 1, 0, 0, 0, 0, 0, 0, 0 };
+            uint64_t w = static_cast<uint64_t>(width);
+            for (int i = 0; i < 8; ++i) {
+                header[16 + i] = static_cast<unsigned char>(w >> (8 * i));
+                header[24 + i] = static_cast<unsigned char>(height >> (8 * i));
+            }
+            write(header, sizeof(header));
+            packed.resize((width + 7) / 8);
+        }
+    }
+
+    void writeRow(const char* row) {
+        if (format == MazeFileFormat::Text) {
+            write(row, rowWidth);
+            write("\n", 1);
+            return;
+        }
+        std::fill(packed.begin(), packed.end(), 0);
+        for (int x = 0; x < rowWidth; ++x) {
+            packed[x >> 3] |= static_cast<unsigned char>((row[x] == '#') << (x & 7));
+        }
+        write(packed.data(), packed.size());
+    }
+
+    // 書き込みに失敗したら false
+    bool finish() {
+        return std::fflush(out) == 0 && !std::ferror(out);
+    }
+
+    uint64_t bytes() const { return bytesWritten; }
+
+private:
+    FILE* out;
+    MazeFileFormat format;
+    int rowWidth;
+    uint64_t bytesWritten;
+    std::vector<unsigned char> packed;
+
+    void write(const void* data, size_t size) {
+        bytesWritten += std::fwrite(data, 1, size, out);
+    }
+};
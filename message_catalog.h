@@ -0,0 +1,174 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+#include "name_table.h"
+
+// --------------------------------------------------
+// メッセージカタログ (MessageCatalog)
+// UTF-8 のメッセージの書式を起動時に1度だけ解析して「文字列の断片」と「引数の差し込み」の列にしておき、
+// 表示するときは断片を写して引数を書き込むだけにする (一時的な std::string を作らない)
+//
+// 書式の中の {n} が n 番目の引数になる。型は書式の側で決める:
+//   {n}        整数
+//   {n:name}   名前 (NameId。NameTable から引く)
+//   {n:tenths} 0.1 単位の整数を小数1桁で (例: 625 -> "62.5")
+// "{{" は "{" そのもの。渡した引数の型が書式と違う・数が足りないときは "?" を書く
+// --------------------------------------------------
+
+enum class MessageArgType : uint8_t {
+    Int,
+    Name,
+    Tenths,
+};
+
+struct MessageArg {
+    MessageArgType type;
+    int64_t value;
+};
+
+inline MessageArg intArg(int64_t value) { return { MessageArgType::Int, value }; }
+inline MessageArg nameArg(NameId name) { return { MessageArgType::Name, static_cast<int64_t>(name) }; }
+inline MessageArg tenthsArg(int64_t value) { return { MessageArgType::Tenths, value }; }
+
+// 整数を10進で out に足す
+inline void appendInteger(std::string& out, int64_t value) {
+    char digits[24];
+    char* end = digits + sizeof(digits);
+    char* p = end;
+    uint64_t magnitude = value < 0 ? 0 - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+    do {
+        *--p = static_cast<char>('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude != 0);
+    if (value < 0) {
+        *--p = '-';
+    }
+    out.append(p, end - p);
+}
+
+class MessageCatalog {
+public:
+    // templates[i] がメッセージ i の書式 (呼び出し側はメッセージの番号を列挙型で決めておく)
+    MessageCatalog(std::initializer_list<const char*> templates) {
+        for (const char* text : templates) {
+            firstPiece.push_back(static_cast<uint32_t>(pieces.size()));
+            compile(text);
+        }
+        firstPiece.push_back(static_cast<uint32_t>(pieces.size()));
+    }
+
+    size_t size() const { return firstPiece.size() - 1; }
+
+    // メッセージ message を args で組み立てて out に足す
+    void format(std::string& out, size_t message, std::initializer_list<MessageArg> args) const {
+        const MessageArg* values = args.begin();
+        const size_t count = args.size();
+        for (uint32_t i = firstPiece[message]; i < firstPiece[message + 1]; ++i) {
+            const Piece& piece = pieces[i];
+            if (piece.arg < 0) {
+                out.append(literals.data() + piece.offset, piece.length);
+                continue;
+            }
+            if (static_cast<size_t>(piece.arg) >= count || values[piece.arg].type != piece.type) {
+                out += '?';
+                continue;
+            }
+            int64_t value = values[piece.arg].value;
+            switch (piece.type) {
+            case MessageArgType::Int:
+                appendInteger(out, value);
+                break;
+            case MessageArgType::Name:
+                out += NameTable::text(static_cast<NameId>(value));
+                break;
+            case MessageArgType::Tenths:
+                if (value < 0) {
+                    out += '-';
+                    value = -value;
+                }
+                appendInteger(out, value / 10);
+                out += '.';
+                out += static_cast<char>('0' + value % 10);
+                break;
+            }
+        }
+    }
+
+private:
+    // 断片: arg < 0 なら literals の [offset, offset + length)、そうでなければ arg 番目の引数
+    struct Piece {
+        uint32_t offset;
+        uint32_t length;
+        int16_t arg;
+        MessageArgType type;
+    };
+
+    std::string literals;               // 全メッセージの文字列の断片をつないだもの
+    std::vector<Piece> pieces;
+    std::vector<uint32_t> firstPiece;   // メッセージごとの最初の断片 (最後に番兵)
+
+    void addLiteral(const char* text, size_t length) {
+        if (length == 0) {
+            return;
+        }
+        // 直前も文字列の断片ならつなげる ("{{" で分かれた場合など)
+        if (!pieces.empty() && pieces.back().arg < 0 && pieces.size() > firstPiece.back()
+            && pieces.back().offset + pieces.back().length == literals.size()) {
+            pieces.back().length += static_cast<uint32_t>(length);
+        }
+        else {
+            pieces.push_back({ static_cast<uint32_t>(literals.size()), static_cast<uint32_t>(length), -1,
+                               MessageArgType::Int });
+        }
+        literals.append(text, length);
+    }
+
+    void compile(const char* text) {
+        const char* literal = text;
+        const char* p = text;
+        while (*p) {
+            if (*p != '{') {
+                ++p;
+                continue;
+            }
+            addLiteral(literal, p - literal);
+            if (p[1] == '{') {
+                addLiteral("{", 1);
+                p += 2;
+                literal = p;
+                continue;
+            }
+
+            // {n} / {n:type}。形が違えばそのまま文字列として残す
+            const char* close = std::strchr(p, '}');
+            const char* q = p + 1;
+            int arg = 0;
+            while (q < close && *q >= '0' && *q <= '9') {
+                arg = arg * 10 + (*q++ - '0');
+            }
+            MessageArgType type = MessageArgType::Int;
+            bool valid = close != nullptr && q > p + 1 && arg < 1000;
+            if (valid && q < close) {
+                std::string name(q, close - q);
+                valid = name == ":name" || name == ":tenths" || name == ":int";
+                type = name == ":name" ? MessageArgType::Name
+                     : name == ":tenths" ? MessageArgType::Tenths : MessageArgType::Int;
+            }
+            if (!valid) {
+                addLiteral(p, 1);
+                literal = ++p;
+                continue;
+            }
+            pieces.push_back({ 0, 0, static_cast<int16_t>(arg), type });
+            p = close + 1;
+            literal = p;
+        }
+        addLiteral(literal, p - literal);
+    }
+};
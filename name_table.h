@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// --------------------------------------------------
+// 名前の表 (NameTable)
+// キャラクターや武器の名前をプロセス全体で1つの表に登録 (インターン) し、番号 (NameId) で持ち回る
+// 同じ文字列は同じ番号になり、文字列は表に登録したまま消えないので、番号のコピーだけで受け渡せる
+//
+// 登録はロックを取る (起動時や敵の種類を決めるときなど、まれにしか行わない)
+// 番号から文字列を引くのはロックなしで、どのスレッドからでもよい
+// --------------------------------------------------
+
+using NameId = uint32_t;
+
+// 名前なし (空文字列)
+const NameId NO_NAME = 0;
+
+class NameTable {
+public:
+    // text を登録して番号を返す (登録済みならその番号)
+    static NameId intern(const char* text) {
+        if (text == nullptr || *text == '\0') {
+            return NO_NAME;
+        }
+        State& table = state();
+        std::lock_guard<std::mutex> lock(table.mutex);
+        auto found = table.ids.find(text);
+        if (found != table.ids.end()) {
+            return found->second;
+        }
+
+        size_t id = table.count.load(std::memory_order_relaxed);
+        if (id >= CHUNK_SIZE * MAX_CHUNKS) {
+            std::fprintf(stderr, "名前の表が一杯です (%zu 個)\n", id);
+            std::abort();
+        }
+        std::atomic<const char*>*& chunk = table.chunks[id / CHUNK_SIZE];
+        if (!chunk) {
+            chunk = new std::atomic<const char*>[CHUNK_SIZE];
+        }
+        // unordered_map の要素は再ハッシュでも動かないので、キーの文字列をそのまま表から指す
+        auto inserted = table.ids.emplace(text, static_cast<NameId>(id)).first;
+        chunk[id % CHUNK_SIZE].store(inserted->first.c_str(), std::memory_order_relaxed);
+        table.count.store(id + 1, std::memory_order_release);
+        return static_cast<NameId>(id);
+    }
+
+    // 番号の文字列 (登録されていない番号なら空文字列)
+    static const char* text(NameId id) {
+        State& table = state();
+        if (id == NO_NAME || id >= table.count.load(std::memory_order_acquire)) {
+            return "";
+        }
+        return table.chunks[id / CHUNK_SIZE][id % CHUNK_SIZE].load(std::memory_order_relaxed);
+    }
+
+    // 登録されている名前の数 (NO_NAME を含む)
+    static size_t size() {
+        return state().count.load(std::memory_order_acquire);
+    }
+
+private:
+    // 番号 -> 文字列の表はチャンクに分けて伸ばす (伸ばしても既存の要素が動かず、ロックなしで読める)
+    static const size_t CHUNK_SIZE = 1024;
+    static const size_t MAX_CHUNKS = 256;
+
+    struct State {
+        std::mutex mutex;
+        std::unordered_map<std::string, NameId> ids;
+        std::atomic<const char*>* chunks[MAX_CHUNKS] = {};
+        std::atomic<size_t> count{ 1 };     // 0 番は NO_NAME
+    };
+
+    // 最初に使ったときに作る (静的変数の初期化の順序によらない)。プロセスの終わりまで解放しない
+    static State& state() {
+        static State* table = new State;
+        return *table;
+    }
+};
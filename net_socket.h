@@ -0,0 +1,169 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+// --------------------------------------------------
+// サーバーとクライアントのソケットの準備 (POSIX のみ)
+// アドレスは文字列で指定する:
+//   unix:PATH   Unix ドメインソケット
+//   tcp:PORT    ループバックの TCP (127.0.0.1 だけで待ち受ける。外には開かない)
+// --------------------------------------------------
+
+struct SocketAddress {
+    bool unix_domain;
+    std::string path;   // unix_domain のとき
+    int port;           // TCP のとき
+};
+
+inline bool parseSocketAddress(const char* text, SocketAddress& address, std::string& error) {
+    std::string value = text;
+    if (value.compare(0, 5, "unix:") == 0 && value.size() > 5) {
+        address.unix_domain = true;
+        address.path = value.substr(5);
+        address.port = 0;
+        return true;
+    }
+    if (value.compare(0, 4, "tcp:") == 0) {
+        char* end = nullptr;
+        long port = std::strtol(value.c_str() + 4, &end, 10);
+        if (end != value.c_str() + 4 && *end == '\0' && port > 0 && port < 65536) {
+            address.unix_domain = false;
+            address.path.clear();
+            address.port = static_cast<int>(port);
+            return true;
+        }
+    }
+    error = "アドレスの形式が不正です: " + value + " (unix:PATH または tcp:PORT)";
+    return false;
+}
+
+#ifndef _WIN32
+
+inline bool setNonBlocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+// 開けるファイル記述子の数をハードリミットまで上げる (多数の接続を持つため)。上げた後の値を返す
+inline rlim_t raiseFileLimit() {
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) != 0) {
+        return 0;
+    }
+    if (limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+        getrlimit(RLIMIT_NOFILE, &limit);
+    }
+    return limit.rlim_cur;
+}
+
+namespace net_detail {
+
+inline int openSocket(const SocketAddress& address, std::string& error) {
+    int fd = socket(address.unix_domain ? AF_UNIX : AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        error = std::string("ソケットを作れません: ") + std::strerror(errno);
+    }
+    return fd;
+}
+
+// sockaddr を組み立てて f(sockaddr*, socklen_t) を呼ぶ
+template <typename Function>
+int withSockaddr(const SocketAddress& address, std::string& error, Function f) {
+    if (address.unix_domain) {
+        sockaddr_un un = {};
+        un.sun_family = AF_UNIX;
+        if (address.path.size() >= sizeof(un.sun_path)) {
+            error = "ソケットのパスが長すぎます: " + address.path;
+            return -1;
+        }
+        std::memcpy(un.sun_path, address.path.c_str(), address.path.size() + 1);
+        return f(reinterpret_cast<sockaddr*>(&un), static_cast<socklen_t>(sizeof(un)));
+    }
+    sockaddr_in in = {};
+    in.sin_family = AF_INET;
+    in.sin_port = htons(static_cast<uint16_t>(address.port));
+    in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    return f(reinterpret_cast<sockaddr*>(&in), static_cast<socklen_t>(sizeof(in)));
+}
+
+inline std::string describe(const SocketAddress& address) {
+    return address.unix_domain ? "unix:" + address.path : "tcp:" + std::to_string(address.port);
+}
+
+} // namespace net_detail
+
+// 待ち受けソケットを作る (ノンブロッキング)。失敗したら -1
+// Unix ドメインソケットのパスに古いファイルが残っていれば消してから作る
+inline int listenSocket(const SocketAddress& address, std::string& error) {
+    int fd = net_detail::openSocket(address, error);
+    if (fd < 0) {
+        return -1;
+    }
+    if (address.unix_domain) {
+        unlink(address.path.c_str());
+    }
+    else {
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    }
+    int result = net_detail::withSockaddr(address, error, [fd](const sockaddr* addr, socklen_t length) {
+        return bind(fd, addr, length) == 0 && listen(fd, SOMAXCONN) == 0 ? 0 : -1;
+    });
+    if (result != 0 || !setNonBlocking(fd)) {
+        if (error.empty()) {
+            error = "待ち受けできません: " + net_detail::describe(address) + " (" + std::strerror(errno) + ")";
+        }
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// サーバーに接続する (接続までは待つ)。失敗したら -1
+inline int connectSocket(const SocketAddress& address, std::string& error) {
+    int fd = net_detail::openSocket(address, error);
+    if (fd < 0) {
+        return -1;
+    }
+    int result = net_detail::withSockaddr(address, error, [fd](const sockaddr* addr, socklen_t length) {
+        return connect(fd, addr, length);
+    });
+    if (result != 0) {
+        if (error.empty()) {
+            error = "接続できません: " + net_detail::describe(address) + " (" + std::strerror(errno) + ")";
+        }
+        close(fd);
+        return -1;
+    }
+    if (!address.unix_domain) {
+        // 1キーごとの小さな送受信を溜めずに送る
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+    return fd;
+}
+
+// accept した TCP の接続にも同じ設定をする (Unix ドメインソケットなら何もしない)
+inline void tuneAcceptedSocket(int fd, const SocketAddress& address) {
+    if (!address.unix_domain) {
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+}
+
+#endif
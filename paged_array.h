@@ -0,0 +1,98 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// --------------------------------------------------
+// ページ単位の copy-on-write 配列 (PagedArray)
+// 要素を kPageSize 個ずつのページに分け、ページを shared_ptr で持つ
+// 配列の複製はページのポインタを写すだけ (O(要素数 / kPageSize)) で、
+// 書き込むときに他の複製と共有しているページだけをその場で複製する
+// (スナップショットを取ったフロアを進めても、書き換えたページの分しか複製しない)
+//
+// 読むのは const の operator[]、書くのは write() と分けてあり、読むだけではページを複製しない
+// 共有しているページはどの複製も書き換えないので、別々のスレッドの複製から同時に読んでよい
+// --------------------------------------------------
+template <class T>
+class PagedArray {
+public:
+    static constexpr int kPageBits = 10;
+    static constexpr size_t kPageSize = size_t(1) << kPageBits;
+
+    PagedArray() : count(0) {}
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    const T& operator[](size_t i) const { return (*pages[i >> kPageBits])[i & kPageMask]; }
+
+    // i 番目への書き込み先 (ページを共有していれば先に複製する)
+    T& write(size_t i) { return ownPage(i >> kPageBits)[i & kPageMask]; }
+
+    const T& back() const { return (*this)[count - 1]; }
+
+    // 要素数を length にして全体を fill で埋める
+    // 自分だけが持つページはその場で埋め直し、それ以外は fill で埋めたページを1枚だけ作って共有する
+    // (共有したページは書き込んだときに別になる。複製した直後でも O(ページ数) で済む)
+    void assign(size_t length, T fill) {
+        pages.resize((length + kPageSize - 1) / kPageSize);
+        std::shared_ptr<Page> filled;
+        for (std::shared_ptr<Page>& slot : pages) {
+            if (slot && slot.use_count() == 1) {
+                slot->fill(fill);
+                continue;
+            }
+            if (!filled) {
+                filled = std::make_shared<Page>();
+                filled->fill(fill);
+            }
+            slot = filled;
+        }
+        count = length;
+    }
+
+    void assign(const T* first, const T* last) {
+        pages.clear();
+        count = 0;
+        for (; first != last; ++first) {
+            push_back(*first);
+        }
+    }
+
+    void clear() {
+        pages.clear();
+        count = 0;
+    }
+
+    void push_back(T value) {
+        if ((count >> kPageBits) == pages.size()) {
+            pages.push_back(std::make_shared<Page>());
+        }
+        write(count++) = value;
+    }
+
+    // 末尾を取り除く (ページは残しておき、次の push_back で使う)
+    void pop_back() { --count; }
+
+    // 使用メモリ (バイト。共有しているページも数える)
+    size_t memoryBytes() const {
+        return pages.capacity() * sizeof(std::shared_ptr<Page>) + pages.size() * sizeof(Page);
+    }
+
+private:
+    using Page = std::array<T, kPageSize>;
+    static constexpr size_t kPageMask = kPageSize - 1;
+
+    std::vector<std::shared_ptr<Page>> pages;
+    size_t count;
+
+    Page& ownPage(size_t page) {
+        std::shared_ptr<Page>& slot = pages[page];
+        if (slot.use_count() > 1) {
+            slot = std::make_shared<Page>(*slot);
+        }
+        return *slot;
+    }
+};
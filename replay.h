@@ -0,0 +1,176 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// --------------------------------------------------
+// リプレイ (迷路ゲームの入力記録)
+// ゲームの設定 (シードを含む) と、各キーを処理したティック番号の列を保存する
+// 同じ設定で同じティックに同じキーを与えれば、ゲームの状態は完全に再現される
+//
+// ファイルはテキスト形式:
+//   MAZEREPLAY 1
+//   seed <シード>
+//   size <幅> <高さ> <階数 (0 は無限)>
+//   monsters <1階あたりの数> <追跡半径>
+//   timing <ティックのミリ秒> <モンスターのティックのミリ秒>
+//   chunked                          (チャンク分割モードのときだけ)
+//   algo <生成方法>                  (dfs 以外のときだけ)
+//   autobattle <勝率 (0.1% 単位)>    (戦闘の自動決着を使うときだけ)
+//   world <階数>                     (ワールドティックのときだけ。現在の階から動かす階の範囲)
+//   key <ティック> <キーコード>      (キーの数だけ繰り返す)
+//   end <最後のティック> <状態ハッシュ (16進)>
+// --------------------------------------------------
+
+// 1つのキー入力 (tick はそのキーを処理したティック)
+struct ReplayInput {
+    uint64_t tick;
+    char key;
+};
+
+struct ReplayLog {
+    uint64_t seed = 0;
+    int width = 0, height = 0, floors = 0;
+    int monsters = 0, chase_radius = 0;
+    int tick_ms = 0, monster_tick_ms = 0;
+    bool chunked = false;
+    std::string algorithm = "dfs";
+    int auto_battle = -1;
+    int world_radius = 0;
+    std::vector<ReplayInput> inputs;
+    // 記録を終えた時点のティックと状態ハッシュ (再生結果の照合用。不明なら has_end == false)
+    bool has_end = false;
+    uint64_t end_tick = 0;
+    uint64_t end_hash = 0;
+
+    bool save(const char* path) const {
+        FILE* file = std::fopen(path, "w");
+        if (!file) {
+            return false;
+        }
+        std::fprintf(file, "MAZEREPLAY 1\n");
+        std::fprintf(file, "seed %llu\n", static_cast<unsigned long long>(seed));
+        std::fprintf(file, "size %d %d %d\n", width, height, floors);
+        std::fprintf(file, "monsters %d %d\n", monsters, chase_radius);
+        std::fprintf(file, "timing %d %d\n", tick_ms, monster_tick_ms);
+        if (chunked) {
+            std::fprintf(file, "chunked\n");
+        }
+        if (algorithm != "dfs") {
+            std::fprintf(file, "algo %s\n", algorithm.c_str());
+        }
+        if (auto_battle >= 0) {
+            std::fprintf(file, "autobattle %d\n", auto_battle);
+        }
+        if (world_radius > 0) {
+            std::fprintf(file, "world %d\n", world_radius);
+        }
+        for (const ReplayInput& input : inputs) {
+            std::fprintf(file, "key %llu %d\n", static_cast<unsigned long long>(input.tick),
+                         static_cast<int>(static_cast<unsigned char>(input.key)));
+        }
+        if (has_end) {
+            std::fprintf(file, "end %llu %016llx\n", static_cast<unsigned long long>(end_tick),
+                         static_cast<unsigned long long>(end_hash));
+        }
+        return std::fclose(file) == 0;
+    }
+
+    // 読み込みに失敗したら false (error に理由を入れる)
+    bool load(const char* path, std::string& error) {
+        FILE* file = std::fopen(path, "r");
+        if (!file) {
+            error = std::string("リプレイファイルを開けません: ") + path;
+            return false;
+        }
+
+        char line[256];
+        bool header = false;
+        inputs.clear();
+        has_end = false;
+        chunked = false;
+        algorithm = "dfs";
+        auto_battle = -1;
+        world_radius = 0;
+        while (std::fgets(line, sizeof(line), file)) {
+            char name[16] = {};
+            unsigned long long a = 0, b = 0;
+            if (std::sscanf(line, "%15s", name) != 1) {
+                continue;
+            }
+            std::string keyword = name;
+            if (!header) {
+                int version = 0;
+                header = keyword == "MAZEREPLAY" && std::sscanf(line, "%*s %d", &version) == 1 && version == 1;
+                if (!header) {
+                    break;
+                }
+            }
+            else if (keyword == "key" && std::sscanf(line, "%*s %llu %llu", &a, &b) == 2) {
+                inputs.push_back({ a, static_cast<char>(b) });
+            }
+            else if (keyword == "seed" && std::sscanf(line, "%*s %llu", &a) == 1) {
+                seed = a;
+            }
+            else if (keyword == "size") {
+                std::sscanf(line, "%*s %d %d %d", &width, &height, &floors);
+            }
+            else if (keyword == "monsters") {
+                std::sscanf(line, "%*s %d %d", &monsters, &chase_radius);
+            }
+            else if (keyword == "timing") {
+                std::sscanf(line, "%*s %d %d", &tick_ms, &monster_tick_ms);
+            }
+            else if (keyword == "chunked") {
+                chunked = true;
+            }
+            else if (keyword == "autobattle") {
+                std::sscanf(line, "%*s %d", &auto_battle);
+            }
+            else if (keyword == "world") {
+                std::sscanf(line, "%*s %d", &world_radius);
+            }
+            else if (keyword == "algo") {
+                char value[16] = {};
+                if (std::sscanf(line, "%*s %15s", value) == 1) {
+                    algorithm = value;
+                }
+            }
+            else if (keyword == "end" && std::sscanf(line, "%*s %llu %llx", &a, &b) == 2) {
+                has_end = true;
+                end_tick = a;
+                end_hash = b;
+            }
+        }
+        std::fclose(file);
+
+        if (!header) {
+            error = std::string("リプレイファイルではありません: ") + path;
+            return false;
+        }
+        if (width <= 0 || height <= 0 || floors < 0 || tick_ms <= 0) {
+            error = std::string("リプレイファイルの設定が不正です: ") + path;
+            return false;
+        }
+        return true;
+    }
+};
+
+// キースクリプト (1バイト1キー。改行・空白は無視する) を読み込む
+// tick は 0 にしておき、再生側で「待ちのないときに1つずつ」与える
+inline bool loadKeyScript(const char* path, std::vector<ReplayInput>& inputs) {
+    FILE* file = std::fopen(path, "rb");
+    if (!file) {
+        return false;
+    }
+    int ch;
+    while ((ch = std::fgetc(file)) != EOF) {
+        if (ch != '\n' && ch != '\r' && ch != ' ' && ch != '\t') {
+            inputs.push_back({ 0, static_cast<char>(ch) });
+        }
+    }
+    std::fclose(file);
+    return true;
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+
+// --------------------------------------------------
+// 乱数サブシステム
+// 1つのマスターシードから用途ごとに独立したストリームを導出する
+// 同じシードを与えれば、スレッド数や処理順に関係なく同じ結果が再現できる
+// --------------------------------------------------
+
+// SplitMix64 の混合関数 (64ビット値をよく撹拌する)
+inline uint64_t mixBits(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// 乱数ストリーム (RngStream)
+// キーとカウンターだけを持つカウンター型の生成器 (SplitMix64 と同じ出力)
+// 16バイトでコピーも安く、split() で親と独立した子ストリームを作れる
+// std::shuffle などに渡せるよう UniformRandomBitGenerator の要件を満たす
+class RngStream {
+public:
+    using result_type = uint64_t;
+
+    explicit RngStream(uint64_t stream_key = 0, uint64_t start = 0) : key(stream_key), counter(start) {}
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return UINT64_MAX; }
+
+    result_type operator()() { return next(); }
+
+    uint64_t next() {
+        return mixBits(key + (++counter) * 0x9E3779B97F4A7C15ull);
+    }
+
+    // [0, n) の一様乱数 (乗算による範囲縮小。n は 1 以上)
+    uint32_t below(uint32_t n) {
+        return static_cast<uint32_t>(((next() >> 32) * n) >> 32);
+    }
+
+    // [lo, hi] の一様乱数
+    int range(int lo, int hi) {
+        return lo + static_cast<int>(below(static_cast<uint32_t>(hi - lo + 1)));
+    }
+
+    // num / den の確率で true
+    bool chance(uint32_t num, uint32_t den) {
+        return below(den) < num;
+    }
+
+    // id ごとに独立した子ストリームを作る (親の状態は変えない)
+    RngStream split(uint64_t id) const {
+        return RngStream(mixBits(key ^ mixBits(id + 0x632BE59BD9B4E019ull)));
+    }
+
+    // セーブ/リプレイ用に状態をそのまま取り出す
+    uint64_t streamKey() const { return key; }
+    uint64_t position() const { return counter; }
+
+private:
+    uint64_t key;
+    uint64_t counter;
+};
+
+// ストリームの用途 (同じ番号でも用途が違えば別のストリームになる)
+enum class RngDomain : uint64_t {
+    FloorGeneration = 1,  // 迷路・階段・モンスター配置 (番号 = 階)
+    MonsterMove = 2,      // モンスターの移動 (番号 = 階)
+    Battle = 3,           // 戦闘と武器ドロップ (番号 = 戦闘の通し番号)
+    Combat = 4,           // rpg001 のキャラクター (番号 = キャラクター)
+    Simulation = 5,       // rpg001 の一括シミュレーション (番号 = 戦闘のまとまり)
+    ChunkGeneration = 6,  // チャンク分割したフロアの1チャンクの地形とモンスター (番号 = 階とチャンク座標)
+    MassBattle = 7,       // rpg001 の大人数戦闘 (0 = 能力値、1 = パーティの攻撃、2 = 大群の攻撃)
+};
+
+// 乱数サービス (RngService)
+// マスターシードを保持し、(用途, 番号) からストリームを配る
+class RngService {
+public:
+    explicit RngService(uint64_t master_seed = 0) : masterSeed(master_seed) {}
+
+    uint64_t seed() const { return masterSeed; }
+
+    RngStream stream(RngDomain domain, uint64_t id = 0) const {
+        return RngStream(mixBits(masterSeed ^ mixBits(static_cast<uint64_t>(domain)))).split(id);
+    }
+
+    // シードの決定: コマンドラインで指定されていなければ random_device を1回だけ使う
+    static uint64_t seedFromString(const char* text) {
+        return std::strtoull(text, nullptr, 10);
+    }
+
+    static uint64_t randomSeed() {
+        std::random_device rd;
+        return (static_cast<uint64_t>(rd()) << 32) ^ rd();
+    }
+
+private:
+    uint64_t masterSeed;
+};
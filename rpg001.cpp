@@ -1,69 +1,160 @@
 #include <iostream>
 #include <string>
 #include <cstdlib>
-#include <ctime>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <random>
+#include <vector>
+#include <chrono>
 #include <algorithm> // std::max用
 
+#include "battle_engine.h"
+#include "game_events.h"
+#include "message_catalog.h"
+#include "name_table.h"
+#include "rng.h"
+#include "thread_pool.h"
+
+// 魔法のコストと威力
+const int SPELL_MP_COST = 10;
+const int SPELL_DAMAGE = 40; // 魔法ダメージは固定 (防御力を無視する)
+
+// 大人数戦闘の戦闘員の名前 (NameTable に登録した番号)
+const NameId NAME_HERO = NameTable::intern("勇者");
+const NameId NAME_GOBLIN = NameTable::intern("ゴブリン");
+
+// --------------------------------------------------
+// 戦闘ルール (表示なし)
+// 対話モードの Character と一括シミュレーションで同じ計算を使う
+// --------------------------------------------------
+
+// 物理攻撃のダメージ計算
+// 10%の確率でクリティカルヒット (攻撃力1.5倍、端数切り捨て)
+// ダメージは (攻撃力 - ターゲットの防御力) で、最低1
+inline int roll_attack_damage(int attack_power, int target_defense, RngStream& rng, bool& is_critical) {
+    int damage = attack_power;
+    is_critical = rng.chance(1, 10);
+    if (is_critical) {
+        damage += damage / 2;
+    }
+    return std::max(1, damage - target_defense);
+}
+
+// 名前と能力値だけを渡して作った Character の能力値 (詰め直さないので、スロットは作ったときのまま)
+// 対話モードとベンチマークが1つのスレッドから使う
+inline CombatUnits& standaloneUnits() {
+    static CombatUnits units;
+    return units;
+}
+
 // --------------------------------------------------
 // キャラクター基底クラス (Character)
+// 能力値は CombatUnits (battle_engine.h) の1スロットにあり、Character はその窓口
+// 名前と能力値だけを渡して作ると、共有の standaloneUnits() に1人分を足す
+// 戦闘員は通し番号で覚えておくので、大人数戦闘の compact() で詰め直されても同じ戦闘員を指す
+// (倒れて取り除かれた後は HP 0 で、攻撃もダメージも受けない)
 // --------------------------------------------------
 class Character {
 protected:
-    std::string name;
-    int max_hp;
-    int current_hp;
-    int attack_power;
-    int defense; // 防御力 (追加)
+    static constexpr size_t kRemoved = SIZE_MAX;
+
+    CombatUnits* units;
+    uint32_t unitId;             // units の中の通し番号
+    mutable size_t slot;         // 今のスロット (取り除かれていたら kRemoved)
+    mutable uint64_t compactions; // slot を確かめたときの units->compactions() (変わったら unitId から引き直す)
+    NameId nameId;               // 取り除かれた後もイベントに名前を載せられるように持っておく
+    RngStream rng; // このキャラクター専用の乱数ストリーム
     
 public:
     // コンストラクタ
-    Character(std::string n, int hp, int atk, int def) 
-        : name(n), max_hp(hp), current_hp(hp), attack_power(atk), defense(def) {}
+    Character(const char* n, int hp, int atk, int def)
+        : Character(standaloneUnits(), standaloneUnits().add(NameTable::intern(n), hp, atk, def)) {}
+
+    // CombatUnits の既存のスロットの窓口
+    Character(CombatUnits& store, size_t unit_slot)
+        : units(&store), unitId(store.id(unit_slot)), slot(unit_slot), compactions(store.compactions()),
+          nameId(store.name(unit_slot)) {}
+
+    // 同じ戦闘員の窓口が2つにならないように、複製はせず移すだけにする
+    Character(const Character&) = delete;
+    Character& operator=(const Character&) = delete;
+    Character(Character&&) = default;
+    Character& operator=(Character&&) = default;
 
     // 攻撃メソッド
     // クリティカルヒット判定も行う
-    void attack(Character* target) {
-        int damage = attack_power;
-        bool is_critical = false;
-        
-        // 10%の確率でクリティカルヒット
-        if (std::rand() % 10 == 0) {
-            damage = static_cast<int>(damage * 1.5);
-            is_critical = true;
+    // 結果はイベントとして sink に送る (Sink に具体的な型を渡すと仮想呼び出しにならない)
+    template <class Sink>
+    void attack(Character* target, Sink& sink) {
+        if (!present() || !target->present()) {
+            return;
         }
+        bool is_critical = false;
 
-        std::cout << name << " の攻撃！";
+        // ダメージ計算（攻撃力 - ターゲットの防御力、最低1。クリティカルは1.5倍）
+        int effective_damage = roll_attack_damage(units->attack(slot), target->units->defense(target->slot), rng,
+                                                  is_critical);
+
+        sink.emit(makeEvent(GameEventType::Attack, 0, 0, 0, name_id()));
         if (is_critical) {
-            std::cout << " (クリティカルヒット！)";
+            sink.emit(makeEvent(GameEventType::Critical, 0, 0, 0, name_id()));
         }
-        std::cout << " -> ";
-        
-        // ダメージ計算（攻撃力 - ターゲットの防御力）
-        // ダメージは最低1
-        int effective_damage = std::max(1, damage - target->get_defense());
         
-        target->take_damage(effective_damage);
+        target->apply_damage(effective_damage, this, sink);
     }
 
     // ダメージを受けるメソッド
-    void take_damage(int damage) {
-        current_hp -= damage;
-        std::cout << name << " に " << damage << " のダメージ！ (残りHP: " << current_hp << ")" << std::endl;
-        if (current_hp < 0) {
-            current_hp = 0;
+    template <class Sink>
+    void take_damage(int damage, const Character* attacker, Sink& sink) {
+        if (present()) {
+            apply_damage(damage, attacker, sink);
         }
     }
 
+    // 乱数ストリームの設定
+    void set_rng(const RngStream& stream) { rng = stream; }
+
     // 生存確認
     bool is_alive() const {
-        return current_hp > 0;
+        return get_hp() > 0;
     }
 
     // ゲッターメソッド
-    std::string get_name() const { return name; }
-    int get_hp() const { return current_hp; }
-    int get_defense() const { return defense; }
+    const char* get_name() const { return NameTable::text(nameId); }
+    int get_hp() const { return present() ? units->hp(slot) : 0; }
+    int get_defense() const { return present() ? units->defense(slot) : 0; }
+
+protected:
+    // イベントに載せる名前
+    NameId name_id() const { return nameId; }
+
+    // present() を確かめた後でダメージを当てる
+    template <class Sink>
+    void apply_damage(int damage, const Character* attacker, Sink& sink) {
+        int current_hp = units->hp(slot) - damage;
+        sink.emit(makeEvent(GameEventType::Damage, 0, damage, current_hp,
+                            attacker->name_id(), name_id()));
+        if (current_hp < 0) {
+            current_hp = 0;
+        }
+        units->setHp(slot, current_hp);
+        if (current_hp == 0) {
+            sink.emit(makeEvent(GameEventType::Kill, 0, 0, 0, attacker->name_id(), name_id()));
+        }
+    }
+
+    // 戦闘員がまだ units にいるか (いれば slot を今のスロットに合わせる)
+    bool present() const {
+        if (compactions != units->compactions()) {
+            compactions = units->compactions();
+            if (slot != kRemoved) {
+                slot = units->find(unitId);
+                slot = slot < units->size() ? slot : kRemoved;
+            }
+        }
+        return slot != kRemoved;
+    }
 };
 
 // --------------------------------------------------
@@ -75,24 +166,27 @@ private:
 
 public:
     // コンストラクタ
-    Player(std::string n, int hp, int atk, int def, int mp) 
+    Player(const char* n, int hp, int atk, int def, int mp) 
         : Character(n, hp, atk, def), current_mp(mp) {}
 
+    Player(CombatUnits& store, size_t unit_slot, int mp) : Character(store, unit_slot), current_mp(mp) {}
+
     // 魔法攻撃メソッド (追加)
-    bool cast_spell(Character* target) {
-        int mp_cost = 10;
-        int spell_damage = 40; // 魔法ダメージは固定
+    template <class Sink>
+    bool cast_spell(Character* target, Sink& sink) {
+        int mp_cost = SPELL_MP_COST;
+        int spell_damage = SPELL_DAMAGE;
 
         if (current_mp < mp_cost) {
-            std::cout << "MPが足りない！" << std::endl;
+            sink.emit(makeEvent(GameEventType::SpellFailed, 0, 0, 0, name_id()));
             return false;
         }
 
         current_mp -= mp_cost;
-        std::cout << name << " は魔法を唱えた！ -> ";
+        sink.emit(makeEvent(GameEventType::Spell, 0, 0, 0, name_id()));
         
         // 魔法は防御力を無視する（今回は）
-        target->take_damage(spell_damage);
+        target->take_damage(spell_damage, this, sink);
         
         return true;
     }
@@ -105,22 +199,303 @@ public:
 // --------------------------------------------------
 class Monster : public Character {
 public:
-    Monster(std::string n, int hp, int atk, int def) : Character(n, hp, atk, def) {}
+    Monster(const char* n, int hp, int atk, int def) : Character(n, hp, atk, def) {}
+    Monster(CombatUnits& store, size_t unit_slot) : Character(store, unit_slot) {}
 };
 
 // --------------------------------------------------
-// メインの戦闘ロジック
+// 一括シミュレーション (--simulate)
+// 能力値の範囲とプレイヤーの行動方針を指定して大量の戦闘を並列に解決し、
+// 勝率・ターン数の分布・残りHPの分布を集計する (戦闘中は一切出力しない)
 // --------------------------------------------------
-int main() {
-    // 乱数シードの設定
-    std::srand(static_cast<unsigned int>(std::time(nullptr)));
+
+// 能力値の範囲 (両端を含む)
+struct StatRange {
+    int min;
+    int max;
+
+    int roll(RngStream& rng) const { return min == max ? min : rng.range(min, max); }
+};
+
+// プレイヤーの行動方針
+enum class BattlePolicy {
+    AttackOnly,      // 常に物理攻撃
+    SpellWhileMp,    // MPがある間は魔法、尽きたら物理攻撃
+};
+
+struct SimulationConfig {
+    uint64_t fights = 10000000;
+    unsigned threads = 0;
+    uint64_t seed = 0;
+    BattlePolicy policy = BattlePolicy::AttackOnly;
+    StatRange player_hp{ 100, 100 }, player_atk{ 20, 20 }, player_def{ 10, 10 }, player_mp{ 30, 30 };
+    StatRange monster_hp{ 70, 70 }, monster_atk{ 18, 18 }, monster_def{ 5, 5 };
+};
+
+// 集計結果 (まとまりごとに作って最後に足し合わせる)
+const int TURN_BUCKETS = 64; // 1..63 ターン + それ以上
+const int HP_BUCKETS = 11;   // 残りHP 0% (敗北), 1-10%, ..., 91-100%
+
+struct SimulationTotals {
+    uint64_t fights = 0;
+    uint64_t wins = 0;
+    uint64_t total_turns = 0;
+    uint64_t turn_histogram[TURN_BUCKETS] = {};
+    uint64_t hp_histogram[HP_BUCKETS] = {};
+
+    void merge(const SimulationTotals& other) {
+        fights += other.fights;
+        wins += other.wins;
+        total_turns += other.total_turns;
+        for (int i = 0; i < TURN_BUCKETS; ++i) turn_histogram[i] += other.turn_histogram[i];
+        for (int i = 0; i < HP_BUCKETS; ++i) hp_histogram[i] += other.hp_histogram[i];
+    }
+};
+
+// 1回の戦闘を解決する (プレイヤーが先攻。対話モードと同じ順序とルール)
+// 戻り値は勝敗。turns に決着までのターン数、player_hp に残りHPが入る
+inline bool simulate_fight(int& player_hp, int player_atk, int player_def, int player_mp,
+                           int monster_hp, int monster_atk, int monster_def,
+                           BattlePolicy policy, RngStream& rng, int& turns) {
+    bool critical;
+    turns = 0;
+    while (true) {
+        ++turns;
+        if (policy == BattlePolicy::SpellWhileMp && player_mp >= SPELL_MP_COST) {
+            player_mp -= SPELL_MP_COST;
+            monster_hp -= SPELL_DAMAGE;
+        }
+        else {
+            monster_hp -= roll_attack_damage(player_atk, monster_def, rng, critical);
+        }
+        if (monster_hp <= 0) {
+            return true;
+        }
+
+        player_hp -= roll_attack_damage(monster_atk, player_def, rng, critical);
+        if (player_hp <= 0) {
+            player_hp = 0;
+            return false;
+        }
+    }
+}
+
+// 能力値を範囲から選んで1回戦い、totals に加える
+inline void simulate_and_record(const SimulationConfig& config, RngStream& rng, SimulationTotals& totals) {
+    int max_hp = std::max(1, config.player_hp.roll(rng));
+    int player_hp = max_hp;
+    int player_atk = config.player_atk.roll(rng);
+    int player_def = config.player_def.roll(rng);
+    int player_mp = config.player_mp.roll(rng);
+    int monster_hp = config.monster_hp.roll(rng);
+    int monster_atk = config.monster_atk.roll(rng);
+    int monster_def = config.monster_def.roll(rng);
+
+    int turns;
+    bool won = simulate_fight(player_hp, player_atk, player_def, player_mp,
+                              monster_hp, monster_atk, monster_def, config.policy, rng, turns);
+
+    ++totals.fights;
+    totals.wins += won;
+    totals.total_turns += turns;
+    ++totals.turn_histogram[std::min(turns, TURN_BUCKETS - 1)];
+    // 残りHPの割合を10%刻みで切り上げる (敗北は0)
+    ++totals.hp_histogram[(player_hp * 10 + max_hp - 1) / max_hp];
+}
+
+// 全戦闘を一定数ずつのまとまりに分けて並列に解決する
+// まとまりごとに独立した乱数ストリームを使うので、結果はスレッド数に依存しない
+SimulationTotals run_simulation(const SimulationConfig& config) {
+    const uint64_t chunk_size = 1 << 16;
+    const size_t chunk_count = static_cast<size_t>((config.fights + chunk_size - 1) / chunk_size);
+    std::vector<SimulationTotals> chunk_totals(chunk_count);
+
+    RngService rngs(config.seed);
+    ThreadPool pool(config.threads);
+    pool.parallelFor(chunk_count, [&](size_t chunk) {
+        RngStream rng = rngs.stream(RngDomain::Simulation, chunk);
+        uint64_t begin = chunk * chunk_size;
+        uint64_t end = std::min(config.fights, begin + chunk_size);
+        SimulationTotals local;
+        for (uint64_t i = begin; i < end; ++i) {
+            simulate_and_record(config, rng, local);
+        }
+        chunk_totals[chunk] = local;
+    });
+
+    SimulationTotals totals;
+    for (const SimulationTotals& chunk : chunk_totals) {
+        totals.merge(chunk);
+    }
+    return totals;
+}
+
+// 集計結果の表示
+void print_simulation_report(const SimulationConfig& config, const SimulationTotals& totals, double seconds) {
+    std::printf("--- シミュレーション結果 (シード: %llu) ---\n", static_cast<unsigned long long>(config.seed));
+    std::printf("戦闘数: %llu  時間: %.3f 秒  (%.1f 百万戦闘/秒)\n",
+                static_cast<unsigned long long>(totals.fights), seconds,
+                seconds > 0 ? totals.fights / seconds / 1e6 : 0.0);
+    if (totals.fights == 0) {
+        return;
+    }
+    std::printf("勝率: %.4f%%  平均ターン数: %.3f\n",
+                100.0 * totals.wins / totals.fights, static_cast<double>(totals.total_turns) / totals.fights);
+
+    std::printf("\nターン数の分布:\n");
+    for (int i = 1; i < TURN_BUCKETS; ++i) {
+        if (totals.turn_histogram[i] > 0) {
+            std::printf("  %2d%s : %8.4f%%\n", i, i == TURN_BUCKETS - 1 ? "+" : " ",
+                        100.0 * totals.turn_histogram[i] / totals.fights);
+        }
+    }
+
+    std::printf("\n残りHPの分布 (最大HPに対する割合):\n");
+    for (int i = 0; i < HP_BUCKETS; ++i) {
+        if (i == 0) {
+            std::printf("  敗北      : %8.4f%%\n", 100.0 * totals.hp_histogram[i] / totals.fights);
+        }
+        else {
+            std::printf("  %3d-%3d%% : %8.4f%%\n", (i - 1) * 10 + 1, i * 10,
+                        100.0 * totals.hp_histogram[i] / totals.fights);
+        }
+    }
+}
+
+// --------------------------------------------------
+// 大人数戦闘 (--mass-battle)
+// パーティ (能力値は --player-*) と大群 (能力値は --monster-*) を --party / --horde 人ずつ作り、
+// MassBattle (battle_engine.h) で決着まで戦わせる (MP と魔法は使わない)
+// --------------------------------------------------
+struct MassBattleResult {
+    bool party_won = false;
+    MassBattleStats stats;
+    size_t party_left = 0, horde_left = 0;
+    int64_t party_hp = 0, horde_hp = 0;
+    CombatKernel kernel = CombatKernel::Auto;
+    double seconds = 0;
+};
+
+MassBattleResult run_mass_battle(const SimulationConfig& config, size_t party_size, size_t horde_size,
+                                 CombatKernel kernel) {
+    RngService rngs(config.seed);
+    RngStream stats = rngs.stream(RngDomain::MassBattle, 0);
+    CombatUnits party, horde;
+    party.reserve(party_size);
+    horde.reserve(horde_size);
+    for (size_t i = 0; i < party_size; ++i) {
+        party.add(NAME_HERO, std::max(1, config.player_hp.roll(stats)), config.player_atk.roll(stats),
+                  config.player_def.roll(stats));
+    }
+    for (size_t i = 0; i < horde_size; ++i) {
+        horde.add(NAME_GOBLIN, std::max(1, config.monster_hp.roll(stats)), config.monster_atk.roll(stats),
+                  config.monster_def.roll(stats));
+    }
+
+    MassBattle battle(party, horde, rngs.stream(RngDomain::MassBattle, 1), rngs.stream(RngDomain::MassBattle, 2),
+                      kernel);
+    auto start = std::chrono::steady_clock::now();
+    battle.run();
+
+    MassBattleResult result;
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.party_won = battle.partyWon();
+    result.stats = battle.stats();
+    result.party_left = party.size();
+    result.horde_left = horde.size();
+    result.party_hp = party.totalHp();
+    result.horde_hp = horde.totalHp();
+    result.kernel = battle.kernel();
+    return result;
+}
+
+void print_mass_battle_report(uint64_t seed, size_t party_size, size_t horde_size, const MassBattleResult& result) {
+    std::printf("--- 大人数戦闘 (シード: %llu, 計算: %s) ---\n", static_cast<unsigned long long>(seed),
+                combatKernelName(result.kernel));
+    std::printf("パーティ %zu 人 対 大群 %zu 体\n", party_size, horde_size);
+    std::printf("結果: %s  ラウンド: %llu\n", result.party_won ? "パーティの勝利" : "パーティの全滅",
+                static_cast<unsigned long long>(result.stats.rounds));
+    std::printf("生き残り: パーティ %zu 人 (HP 合計 %lld)  大群 %zu 体 (HP 合計 %lld)\n", result.party_left,
+                static_cast<long long>(result.party_hp), result.horde_left, static_cast<long long>(result.horde_hp));
+    std::printf("攻撃: %llu 回 (クリティカル %llu 回)  時間: %.3f 秒  (%.1f 百万攻撃/秒)\n",
+                static_cast<unsigned long long>(result.stats.attacks),
+                static_cast<unsigned long long>(result.stats.criticals), result.seconds,
+                result.seconds > 0 ? result.stats.attacks / result.seconds / 1e6 : 0.0);
+}
+
+// "a" または "a:b" を範囲として読む
+StatRange parse_range(const char* text) {
+    StatRange range;
+    range.min = std::atoi(text);
+    const char* colon = std::strchr(text, ':');
+    range.max = colon ? std::atoi(colon + 1) : range.min;
+    if (range.max < range.min) {
+        std::swap(range.min, range.max);
+    }
+    return range;
+}
+
+// --------------------------------------------------
+// 戦闘メッセージの書式 (TextEventSink 用)
+// --------------------------------------------------
+
+// メッセージの番号 (BATTLE_MESSAGES の並びと同じ順)
+enum BattleMessage : uint8_t {
+    MSG_ATTACK,
+    MSG_CRITICAL,
+    MSG_SPELL,
+    MSG_SPELL_FAILED,
+    MSG_DAMAGE,
+};
+
+const MessageCatalog BATTLE_MESSAGES = {
+    "{0:name} の攻撃！",
+    " (クリティカルヒット！)",
+    "{0:name} は魔法を唱えた！",
+    "MPが足りない！\n",
+    " -> {0:name} に {1} のダメージ！ (残りHP: {2})\n",
+};
+
+void format_battle_event(std::string& out, const GameEvent& event) {
+    switch (event.type) {
+    case GameEventType::Attack:
+        BATTLE_MESSAGES.format(out, MSG_ATTACK, { nameArg(event.actor) });
+        break;
+    case GameEventType::Critical:
+        BATTLE_MESSAGES.format(out, MSG_CRITICAL, {});
+        break;
+    case GameEventType::Spell:
+        BATTLE_MESSAGES.format(out, MSG_SPELL, { nameArg(event.actor) });
+        break;
+    case GameEventType::SpellFailed:
+        BATTLE_MESSAGES.format(out, MSG_SPELL_FAILED, {});
+        break;
+    case GameEventType::Damage:
+        BATTLE_MESSAGES.format(out, MSG_DAMAGE, { nameArg(event.target), intArg(event.value), intArg(event.extra) });
+        break;
+    default:
+        // 撃破などは戦闘ループ側で見出しとして表示する
+        break;
+    }
+}
+
+// --------------------------------------------------
+// メインの戦闘ロジック (対話モード)
+// --------------------------------------------------
+int run_interactive_battle(uint64_t seed) {
+    RngService rngs(seed);
+    TextEventSink messages(format_battle_event);
 
     // プレイヤーとモンスターの作成 (HP, 攻撃力, 防御力, MP)
     Player player("勇者", 100, 20, 10, 30);
     // (HP, 攻撃力, 防御力)
     Monster monster("ゴブリン", 70, 18, 5);
 
-    std::cout << "--- 戦闘開始！ ---" << std::endl;
+    // キャラクターごとに独立した乱数ストリームを割り当てる
+    player.set_rng(rngs.stream(RngDomain::Combat, 0));
+    monster.set_rng(rngs.stream(RngDomain::Combat, 1));
+
+    std::cout << "--- 戦闘開始！ --- (シード: " << seed << ")" << std::endl;
 
     // 戦闘ループ
     while (player.is_alive() && monster.is_alive()) {
@@ -132,14 +507,15 @@ int main() {
 
         if (choice == 1) {
             // 物理攻撃
-            player.attack(&monster);
+            player.attack(&monster, messages);
         } else if (choice == 2) {
             // 魔法攻撃
-            player.cast_spell(&monster);
+            player.cast_spell(&monster, messages);
         } else {
             std::cout << "無効な入力です。攻撃します。" << std::endl;
-            player.attack(&monster);
+            player.attack(&monster, messages);
         }
+        messages.flush();
 
         // モンスターが倒れたかチェック
         if (!monster.is_alive()) {
@@ -149,7 +525,8 @@ int main() {
 
         std::cout << "\n--- " << monster.get_name() << "のターン ---" << std::endl;
         // モンスターの攻撃
-        monster.attack(&player);
+        monster.attack(&player, messages);
+        messages.flush();
 
         // プレイヤーが倒れたかチェック
         if (!player.is_alive()) {
@@ -160,4 +537,81 @@ int main() {
 
     std::cout << "\n--- 戦闘終了 ---" << std::endl;
     return 0;
-}
\ No newline at end of file
+}
+
+// bench.cpp はこのファイルを取り込んで使うので、main を除外できるようにする
+#ifndef RPG001_NO_MAIN
+int main(int argc, char* argv[]) {
+    // 乱数シードの設定 (--seed N で固定すると同じ戦闘を再現できる)
+    // --simulate を付けると対話なしの一括シミュレーションを行う
+    // --mass-battle を付けると --party N 人と --horde N 体の大人数戦闘を行う (--kernel auto|scalar|avx2)
+    uint64_t seed = RngService::randomSeed();
+    bool simulate = false;
+    bool mass_battle = false;
+    size_t party_size = 1000;
+    size_t horde_size = 5000;
+    CombatKernel kernel = CombatKernel::Auto;
+    SimulationConfig config;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--seed" && has_value) {
+            seed = RngService::seedFromString(argv[++i]);
+        }
+        else if (arg == "--simulate") {
+            simulate = true;
+        }
+        else if (arg == "--mass-battle") {
+            mass_battle = true;
+        }
+        else if (arg == "--party" && has_value) {
+            party_size = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--horde" && has_value) {
+            horde_size = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--kernel" && has_value) {
+            std::string name = argv[++i];
+            kernel = name == "scalar" ? CombatKernel::Scalar : name == "avx2" ? CombatKernel::Avx2 : CombatKernel::Auto;
+        }
+        else if (arg == "--fights" && has_value) {
+            config.fights = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--threads" && has_value) {
+            config.threads = static_cast<unsigned>(std::max(0, std::atoi(argv[++i])));
+        }
+        else if (arg == "--policy" && has_value) {
+            std::string policy = argv[++i];
+            config.policy = (policy == "spell") ? BattlePolicy::SpellWhileMp : BattlePolicy::AttackOnly;
+        }
+        else if (arg == "--player-hp" && has_value) config.player_hp = parse_range(argv[++i]);
+        else if (arg == "--player-atk" && has_value) config.player_atk = parse_range(argv[++i]);
+        else if (arg == "--player-def" && has_value) config.player_def = parse_range(argv[++i]);
+        else if (arg == "--player-mp" && has_value) config.player_mp = parse_range(argv[++i]);
+        else if (arg == "--monster-hp" && has_value) config.monster_hp = parse_range(argv[++i]);
+        else if (arg == "--monster-atk" && has_value) config.monster_atk = parse_range(argv[++i]);
+        else if (arg == "--monster-def" && has_value) config.monster_def = parse_range(argv[++i]);
+    }
+
+    config.seed = seed;
+    if (mass_battle) {
+        if (kernel == CombatKernel::Avx2 && !combatAvx2Available()) {
+            std::cerr << "この環境では AVX2 を使えないので、スカラーで計算します" << std::endl;
+        }
+        MassBattleResult result = run_mass_battle(config, party_size, horde_size, kernel);
+        print_mass_battle_report(seed, party_size, horde_size, result);
+        return 0;
+    }
+
+    if (!simulate) {
+        return run_interactive_battle(seed);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    SimulationTotals totals = run_simulation(config);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    print_simulation_report(config, totals, seconds);
+    return 0;
+}
+#endif
@@ -0,0 +1,296 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <cstdlib>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// --------------------------------------------------
+// セーブファイル (迷路ゲームの状態のスナップショット)
+// ファイルをそのまま mmap して読めるよう、全て固定長・8バイト境界の
+// リトルエンディアンの構造体で並べる (読み込み時に1セルずつ解析しない)
+//
+//   [SaveHeader]                    先頭 (header_size バイト)
+//   [SavedFloor x floor_count]      フロアの索引 (floor_table_offset から)
+//   [各フロアの本体]                 モンスター・グリッド・壁ビットマップ (8バイト境界)
+//
+// フロアは2種類:
+//   SAVED_FLOOR_FULL      グリッドと壁ビットマップを持つ (必要になったときにコピーするだけで使える)
+//   SAVED_FLOOR_SEED_ONLY 地形は階ごとのシードから作り直し、モンスターの差分だけを持つ
+// 一度も入っていないフロアは書かない (シードだけで完全に決まる)
+//
+// 破損の検出: ヘッダーと索引は読み込み時に、各フロアの本体はそのフロアを
+// 使うときにチェックサムを確かめる (巨大なファイルでも再開がすぐ終わるように)
+// --------------------------------------------------
+
+const char SAVE_MAGIC[8] = { 'M', 'A', 'Z', 'E', 'S', 'A', 'V', '\0' };
+const uint32_t SAVE_VERSION = 2;   // 2: 迷路の生成方法 (maze_algorithm) を追加
+const uint32_t SAVE_ENDIAN_MARK = 0x01020304;
+
+const uint32_t SAVED_FLOOR_FULL = 1;
+const uint32_t SAVED_FLOOR_SEED_ONLY = 2;
+
+struct SaveHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t endian_mark;
+    uint32_t header_size;
+    uint32_t floor_count;           // 索引のフロア数
+    uint64_t file_size;
+    uint64_t checksum;              // ヘッダー (この欄を0にしたもの) と索引のチェックサム
+    uint64_t floor_table_offset;
+
+    // ゲームの設定
+    uint64_t seed;
+    int32_t width, height;
+    int32_t floors;                 // 階数 (0 は無限)
+    int32_t monsters_per_floor;
+    int32_t chase_radius;
+    int32_t maze_algorithm;         // MazeAlgorithm の値 (SEED_ONLY のフロアを同じ方法で作り直すため)
+
+    // プレイヤー
+    int32_t current_floor;
+    int32_t player_x, player_y;
+    int32_t player_hp;
+    int32_t player_base_attack;
+    int32_t weapon_index;           // 武器表の添字 (-1 は素手)
+    int32_t weapon_bonus;
+    int32_t reserved;
+
+    // 乱数と進行
+    uint64_t battle_count;
+    uint64_t tick_count;
+    uint64_t step_count;
+};
+
+struct SavedFloor {
+    int32_t floor_num;
+    uint32_t kind;                  // SAVED_FLOOR_FULL / SAVED_FLOOR_SEED_ONLY
+    int32_t up_stair_x, up_stair_y;
+    int32_t down_stair_x, down_stair_y;
+    uint64_t monster_rng_position;
+    uint64_t monsters_offset;
+    uint32_t monster_count;
+    uint32_t reserved;
+    uint64_t grid_offset;           // width * height バイト (FULL のみ)
+    uint64_t walls_offset;          // (width * height + 63) / 64 個の uint64_t (FULL のみ)
+    uint64_t payload_end;           // 本体の終わり (monsters_offset からここまでがチェックサムの範囲)
+    uint64_t checksum;
+};
+
+struct SavedMonster {
+    int32_t x, y;
+    int32_t hp;
+    int16_t attack;
+    uint8_t state;
+    uint8_t reserved;
+};
+
+static_assert(sizeof(SaveHeader) % 8 == 0, "SaveHeader は8バイト境界に揃える");
+static_assert(sizeof(SavedFloor) == 80, "SavedFloor の大きさはファイル形式の一部");
+static_assert(sizeof(SavedMonster) == 16, "SavedMonster の大きさはファイル形式の一部");
+
+// 8バイトずつ混ぜる軽いチェックサム (破損の検出用。暗号学的な強さはない)
+inline uint64_t saveChecksum(const void* data, size_t size, uint64_t hash = 0x243F6A8885A308D3ull) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, bytes + i, 8);
+        hash = ((hash << 29 | hash >> 35) ^ word) * 0x9E3779B97F4A7C15ull;
+    }
+    uint64_t tail = 0;
+    std::memcpy(&tail, bytes + i, size - i);
+    hash = ((hash << 29 | hash >> 35) ^ tail ^ size) * 0x9E3779B97F4A7C15ull;
+    return hash ^ (hash >> 32);
+}
+
+// セーブファイルを組み立てるバッファ (本体は8バイト境界に揃えて追記する)
+class SaveWriter {
+public:
+    // 追記して先頭のオフセットを返す
+    uint64_t append(const void* data, size_t size) {
+        uint64_t offset = bytes.size();
+        bytes.insert(bytes.end(), static_cast<const unsigned char*>(data),
+                     static_cast<const unsigned char*>(data) + size);
+        bytes.resize((bytes.size() + 7) & ~size_t(7), 0);
+        return offset;
+    }
+
+    // size バイトの0埋め領域を確保してオフセットを返す (後から at() で書く)
+    uint64_t reserve(size_t size) {
+        uint64_t offset = bytes.size();
+        bytes.resize((bytes.size() + size + 7) & ~size_t(7), 0);
+        return offset;
+    }
+
+    unsigned char* at(uint64_t offset) { return bytes.data() + offset; }
+    size_t size() const { return bytes.size(); }
+
+    // 一時ファイルに書いてから置き換える (読み込み中の mmap を壊さないため)
+    bool writeTo(const std::string& path) const {
+        std::string temporary = path + ".tmp";
+        FILE* file = std::fopen(temporary.c_str(), "wb");
+        if (!file) {
+            return false;
+        }
+        bool ok = std::fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+        ok = std::fclose(file) == 0 && ok;
+        if (ok) {
+#ifdef _WIN32
+            std::remove(path.c_str());
+#endif
+            ok = std::rename(temporary.c_str(), path.c_str()) == 0;
+        }
+        if (!ok) {
+            std::remove(temporary.c_str());
+        }
+        return ok;
+    }
+
+private:
+    std::vector<unsigned char> bytes;
+};
+
+// 読み取り専用のファイルマッピング
+// POSIX では mmap し、ページは実際に触ったときに読み込まれる
+// Windows では全体を読み込む
+class MappedFile {
+public:
+    MappedFile() : base(nullptr), length(0) {}
+    ~MappedFile() { close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const char* path) {
+        close();
+#ifdef _WIN32
+        FILE* file = std::fopen(path, "rb");
+        if (!file) {
+            return false;
+        }
+        std::fseek(file, 0, SEEK_END);
+        long size = std::ftell(file);
+        std::fseek(file, 0, SEEK_SET);
+        if (size <= 0) {
+            std::fclose(file);
+            return false;
+        }
+        buffer.resize(static_cast<size_t>(size));
+        bool ok = std::fread(buffer.data(), 1, buffer.size(), file) == buffer.size();
+        std::fclose(file);
+        if (!ok) {
+            buffer.clear();
+            return false;
+        }
+        base = buffer.data();
+        length = buffer.size();
+        return true;
+#else
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+            ::close(fd);
+            return false;
+        }
+        void* mapped = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED) {
+            return false;
+        }
+        base = static_cast<const unsigned char*>(mapped);
+        length = static_cast<size_t>(info.st_size);
+        return true;
+#endif
+    }
+
+    void close() {
+#ifdef _WIN32
+        buffer.clear();
+#else
+        if (base) {
+            munmap(const_cast<unsigned char*>(base), length);
+        }
+#endif
+        base = nullptr;
+        length = 0;
+    }
+
+    const unsigned char* data() const { return base; }
+    size_t size() const { return length; }
+
+    // [offset, offset + size) がファイルの中に収まっているか
+    bool contains(uint64_t offset, uint64_t size) const {
+        return offset <= length && size <= length - offset;
+    }
+
+private:
+    const unsigned char* base;
+    size_t length;
+#ifdef _WIN32
+    std::vector<unsigned char> buffer;
+#endif
+};
+
+// セーブファイルを開いてヘッダーと索引を確かめる
+// 成功すればヘッダーを返す (file を閉じるまで有効)。失敗すれば nullptr (error に理由を入れる)
+// mmap の先頭はページ境界、Windows の読み込みバッファも new の境界なので、直接構造体として読める
+inline const SaveHeader* openSaveFile(MappedFile& file, const char* path, std::string& error) {
+    if (!file.open(path)) {
+        error = std::string("セーブファイルを開けません: ") + path;
+        return nullptr;
+    }
+    if (!file.contains(0, sizeof(SaveHeader))
+        || std::memcmp(file.data(), SAVE_MAGIC, sizeof(SAVE_MAGIC)) != 0) {
+        error = std::string("セーブファイルではありません: ") + path;
+        return nullptr;
+    }
+    const SaveHeader* header = reinterpret_cast<const SaveHeader*>(file.data());
+    if (header->version != SAVE_VERSION || header->endian_mark != SAVE_ENDIAN_MARK
+        || header->header_size != sizeof(SaveHeader)) {
+        error = std::string("対応していない形式のセーブファイルです: ") + path;
+        return nullptr;
+    }
+    if (header->file_size != file.size() || header->floor_table_offset % 8 != 0
+        || !file.contains(header->floor_table_offset, uint64_t(header->floor_count) * sizeof(SavedFloor))) {
+        error = std::string("セーブファイルが途中で切れています: ") + path;
+        return nullptr;
+    }
+
+    SaveHeader copy = *header;
+    copy.checksum = 0;
+    uint64_t checksum = saveChecksum(&copy, sizeof(copy));
+    checksum = saveChecksum(file.data() + header->floor_table_offset,
+                            header->floor_count * sizeof(SavedFloor), checksum);
+    if (checksum != header->checksum) {
+        error = std::string("セーブファイルが壊れています (チェックサム不一致): ") + path;
+        return nullptr;
+    }
+    return header;
+}
+
+// フロアの索引の先頭 (openSaveFile で確かめたファイルに対してだけ使う)
+inline const SavedFloor* savedFloorTable(const MappedFile& file, const SaveHeader& header) {
+    return reinterpret_cast<const SavedFloor*>(file.data() + header.floor_table_offset);
+}
+
+// フロアの本体 (モンスター・グリッド・壁ビットマップ) のチェックサム
+inline uint64_t savedFloorChecksum(const unsigned char* base, const SavedFloor& floor) {
+    return saveChecksum(base + floor.monsters_offset, floor.payload_end - floor.monsters_offset,
+                        static_cast<uint64_t>(floor.floor_num));
+}
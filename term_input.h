@@ -0,0 +1,210 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <conio.h>
+#include <windows.h>
+// Windows: 矢印キーのスキャンコード
+#define KEY_UP 72
+#define KEY_DOWN 80
+#define KEY_LEFT 75
+#define KEY_RIGHT 77
+#else
+#include <cerrno>
+#include <csignal>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+// POSIX: 矢印キーのエスケープシーケンスの末尾
+#define ARROW_UP 'A'
+#define ARROW_DOWN 'B'
+#define ARROW_LEFT 'D'
+#define ARROW_RIGHT 'C'
+// KeyReader が返す矢印キーのコード (WASD の大文字と衝突しない制御コード)
+#define KEY_UP 0x10
+#define KEY_DOWN 0x11
+#define KEY_LEFT 0x12
+#define KEY_RIGHT 0x13
+#endif
+
+// --------------------------------------------------
+// 端末の raw モード (RawTerminal)
+// 生成時に1回だけ端末をカノニカルモード・エコーなしに切り替え、破棄時に元へ戻す
+// SIGINT などで終了する場合もシグナルハンドラーで設定とカーソル表示を戻してから
+// 既定の動作 (プロセス終了) に任せる
+// 標準入力が端末でなければ (パイプやファイル) 何もしない
+// --------------------------------------------------
+class RawTerminal {
+public:
+    RawTerminal() : active(false) {
+#ifndef _WIN32
+        if (!isatty(STDIN_FILENO) || tcgetattr(STDIN_FILENO, &savedState()) != 0) {
+            return;
+        }
+        struct termios raw = savedState();
+        raw.c_lflag &= ~(ICANON | ECHO);
+        raw.c_cc[VMIN] = 1;
+        raw.c_cc[VTIME] = 0;
+        tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+        active = true;
+
+        struct sigaction action = {};
+        action.sa_handler = onSignal;
+        sigemptyset(&action.sa_mask);
+        for (int sig : { SIGINT, SIGTERM, SIGHUP, SIGQUIT }) {
+            sigaction(sig, &action, nullptr);
+        }
+#endif
+    }
+
+    ~RawTerminal() {
+#ifndef _WIN32
+        if (active) {
+            tcsetattr(STDIN_FILENO, TCSANOW, &savedState());
+            struct sigaction action = {};
+            action.sa_handler = SIG_DFL;
+            sigemptyset(&action.sa_mask);
+            for (int sig : { SIGINT, SIGTERM, SIGHUP, SIGQUIT }) {
+                sigaction(sig, &action, nullptr);
+            }
+        }
+#endif
+    }
+
+    RawTerminal(const RawTerminal&) = delete;
+    RawTerminal& operator=(const RawTerminal&) = delete;
+
+private:
+    bool active;
+
+#ifndef _WIN32
+    static struct termios& savedState() {
+        static struct termios state;
+        return state;
+    }
+
+    // シグナルハンドラー内では非同期シグナル安全な関数 (tcsetattr, write, raise) だけを使う
+    static void onSignal(int sig) {
+        tcsetattr(STDIN_FILENO, TCSANOW, &savedState());
+        static const char show_cursor[] = "\x1b[0m\x1b[?25h\n";
+        ssize_t ignored = write(STDOUT_FILENO, show_cursor, sizeof(show_cursor) - 1);
+        (void)ignored;
+        signal(sig, SIG_DFL);
+        raise(sig);
+    }
+#endif
+};
+
+// --------------------------------------------------
+// キー入力 (KeyReader)
+// poll() で入力を待ち、届いているバイトを1回の read() でまとめて取り出して
+// キーコードの列に変換する。矢印キーのエスケープシーケンスは KEY_* に揃える
+// 押しっぱなしなどで溜まったキーも1回の呼び出しで全部受け取れる
+// --------------------------------------------------
+class KeyReader {
+public:
+    KeyReader() : endOfInput(false) {}
+
+    // 入力の終わり (パイプやファイルを読み切った) に達したか
+    bool eof() const { return endOfInput; }
+
+    // 最大 timeout_ms ミリ秒 (負なら無期限) 入力を待ち、届いたキーを keys の末尾に追加する
+    // 追加したキーの数を返す
+    size_t poll(int timeout_ms, std::vector<char>& keys) {
+        size_t before = keys.size();
+#ifdef _WIN32
+        DWORD start = GetTickCount();
+        while (true) {
+            while (_kbhit()) {
+                int key = _getch();
+                if (key == 0 || key == 224) {
+                    key = _getch();
+                }
+                keys.push_back(static_cast<char>(key));
+            }
+            if (keys.size() > before || timeout_ms == 0
+                || (timeout_ms > 0 && GetTickCount() - start >= static_cast<DWORD>(timeout_ms))) {
+                break;
+            }
+            Sleep(1);
+        }
+#else
+        if (endOfInput) {
+            return 0;
+        }
+        struct pollfd fd = { STDIN_FILENO, POLLIN, 0 };
+        int ready = ::poll(&fd, 1, timeout_ms);
+        if (ready < 0 && errno != EINTR) {
+            endOfInput = true;
+        }
+        if (ready <= 0) {
+            // 続きが来ないまま待ち時間が過ぎたら、単独の ESC などの途中のシーケンスは捨てる
+            pending.clear();
+            return 0;
+        }
+
+        char buffer[256];
+        ssize_t n = read(STDIN_FILENO, buffer, sizeof(buffer));
+        if (n <= 0) {
+            if (n == 0 || errno != EINTR) {
+                endOfInput = true;
+            }
+            return 0;
+        }
+        pending.append(buffer, static_cast<size_t>(n));
+        decode(keys);
+#endif
+        return keys.size() - before;
+    }
+
+private:
+    bool endOfInput;
+#ifndef _WIN32
+    // まだ完結していないエスケープシーケンス
+    std::string pending;
+
+    // pending のバイト列をキーコードに変換する (途中で終わったシーケンスは残す)
+    void decode(std::vector<char>& keys) {
+        size_t i = 0;
+        while (i < pending.size()) {
+            char ch = pending[i];
+            if (ch != 27) {
+                keys.push_back(ch);
+                ++i;
+                continue;
+            }
+
+            // ESC [ (引数) 終端文字 または ESC O 終端文字
+            size_t end = i + 1;
+            if (end >= pending.size()) {
+                break;
+            }
+            if (pending[end] != '[' && pending[end] != 'O') {
+                // 単独の ESC に続く普通のキー
+                i = end;
+                continue;
+            }
+            ++end;
+            while (end < pending.size() && pending[end] >= 0x30 && pending[end] <= 0x3f) {
+                ++end;
+            }
+            if (end >= pending.size()) {
+                break;
+            }
+
+            // ('A' などをそのまま返すと WASD の大文字と区別できない)
+            switch (pending[end]) {
+            case ARROW_UP: keys.push_back(KEY_UP); break;
+            case ARROW_DOWN: keys.push_back(KEY_DOWN); break;
+            case ARROW_LEFT: keys.push_back(KEY_LEFT); break;
+            case ARROW_RIGHT: keys.push_back(KEY_RIGHT); break;
+            default: break;
+            }
+            i = end + 1;
+        }
+        pending.erase(0, i);
+    }
+#endif
+};
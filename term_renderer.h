@@ -0,0 +1,325 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <csignal>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
+
+// --------------------------------------------------
+// 端末レンダラー (TerminalRenderer)
+// 前面 (画面に出ている内容) と背面 (次に出す内容) の2枚のフレームを持ち、
+// 変わったセルと行だけをカーソル移動付きで書き出す。1フレームの出力は
+// 1回の write() にまとめる
+//
+// フレームは上から「マップ領域」と「テキスト行」で構成する
+//   マップ領域: cellColumns x cellRows 個の1バイト文字 (1セル = 文字 + 空白の2桁)
+//   テキスト行: UTF-8 の任意の文字列 (行単位で比較し、変わった行だけ書き直す)
+// マップ領域のセルの文字は ASCII で、最上位ビット (CELL_DIM) が立っていれば薄く表示する
+// --------------------------------------------------
+
+// セルを薄く表示する印 (霧の中の覚えているだけのセルなど)
+const unsigned char CELL_DIM = 0x80;
+class TerminalRenderer {
+public:
+    TerminalRenderer()
+        : cellColumns(0), cellRows(0), textColumns(0), fixedColumns(0), fixedRows(0),
+          fullRedraw(true), started(false), outputEnabled(true) {}
+
+    ~TerminalRenderer() { finish(); }
+
+    TerminalRenderer(const TerminalRenderer&) = delete;
+    TerminalRenderer& operator=(const TerminalRenderer&) = delete;
+
+    // 端末の大きさ (桁数, 行数)。取得できなければ 80x24
+    static void terminalSize(int& columns, int& rows) {
+        columns = 80;
+        rows = 24;
+#ifdef _WIN32
+        CONSOLE_SCREEN_BUFFER_INFO info;
+        if (GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &info)) {
+            columns = info.srWindow.Right - info.srWindow.Left + 1;
+            rows = info.srWindow.Bottom - info.srWindow.Top + 1;
+        }
+#else
+        struct winsize size;
+        if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_col > 0 && size.ws_row > 0) {
+            columns = size.ws_col;
+            rows = size.ws_row;
+        }
+#endif
+    }
+
+    // 画面の大きさを固定する (0 なら端末に問い合わせる。ベンチマークなど端末のない場合用)
+    void setScreenSize(int columns, int rows) {
+        fixedColumns = columns;
+        fixedRows = rows;
+    }
+
+    // 描画に使う画面の大きさ
+    void screenSize(int& columns, int& rows) const {
+        if (fixedColumns > 0 && fixedRows > 0) {
+            columns = fixedColumns;
+            rows = fixedRows;
+            return;
+        }
+        terminalSize(columns, rows);
+    }
+
+    // false にすると差分の組み立てまでは行い、書き出さない (ベンチマーク用)
+    void setOutputEnabled(bool enabled) { outputEnabled = enabled; }
+
+    // 前回の present() 以降に端末の大きさが変わったか
+    static bool consumeResize() {
+#ifdef _WIN32
+        return false;
+#else
+        bool resized = resizeFlag() != 0;
+        resizeFlag() = 0;
+        return resized;
+#endif
+    }
+
+    // 新しいフレームを始める。大きさが変わったら次の present() で全体を描き直す
+    void beginFrame(int columns, int rows, int text_lines) {
+        if (columns != cellColumns || rows != cellRows || static_cast<int>(backLines.size()) != text_lines) {
+            cellColumns = columns;
+            cellRows = rows;
+            back.assign(static_cast<size_t>(columns) * rows, ' ');
+            backLines.assign(text_lines, std::string());
+            fullRedraw = true;
+        }
+        if (consumeResize()) {
+            fullRedraw = true;
+        }
+    }
+
+    int columns() const { return cellColumns; }
+    int rows() const { return cellRows; }
+    int textLines() const { return static_cast<int>(backLines.size()); }
+
+    // マップ領域の1行 (cellColumns バイト) への書き込み先
+    char* row(int y) { return back.data() + static_cast<size_t>(y) * cellColumns; }
+
+    void setCell(int x, int y, char ch) { back[static_cast<size_t>(y) * cellColumns + x] = ch; }
+
+    void setText(int line, const std::string& text) { backLines[line] = text; }
+
+    // テキスト行を端末の幅で切り詰める (0 なら切り詰めない)
+    // 折り返すと下の行がずれて差分描画が壊れるため
+    void setTextWidth(int columns) { textColumns = columns; }
+
+    // UTF-8 文字列を表示幅 columns 桁までに切り詰める
+    // エスケープシーケンスは幅0、東アジアの全角文字は幅2として数える
+    static std::string fitToWidth(const std::string& text, int columns) {
+        std::string result;
+        int width = 0;
+        size_t i = 0;
+        while (i < text.size()) {
+            unsigned char c = static_cast<unsigned char>(text[i]);
+            if (c == 0x1b) {
+                // CSI シーケンス (ESC [ ... 終端文字) はそのまま通す
+                size_t end = i + 1;
+                if (end < text.size() && text[end] == '[') {
+                    ++end;
+                    while (end < text.size() && (text[end] < 0x40 || text[end] > 0x7e)) {
+                        ++end;
+                    }
+                }
+                end = std::min(end + 1, text.size());
+                result.append(text, i, end - i);
+                i = end;
+                continue;
+            }
+
+            size_t length = c < 0x80 ? 1 : c < 0xe0 ? 2 : c < 0xf0 ? 3 : 4;
+            uint32_t code = c;
+            if (length > 1) {
+                code = c & (0xff >> (length + 1));
+                for (size_t k = 1; k < length && i + k < text.size(); ++k) {
+                    code = (code << 6) | (static_cast<unsigned char>(text[i + k]) & 0x3f);
+                }
+            }
+            int char_width = isWide(code) ? 2 : 1;
+            if (width + char_width > columns) {
+                break;
+            }
+            width += char_width;
+            result.append(text, i, length);
+            i += length;
+        }
+        return result;
+    }
+
+    // 次の present() で画面全体を描き直す
+    void invalidate() { fullRedraw = true; }
+
+    // 背面フレームと前面フレームの差分を書き出す
+    void present() {
+        out.clear();
+        if (outputEnabled) {
+            prepareTerminal();
+        }
+        if (!started) {
+            // カーソルを隠す
+            out += "\x1b[?25l";
+            started = true;
+        }
+        if (fullRedraw || front.size() != back.size() || frontLines.size() != backLines.size()) {
+            out += "\x1b[2J";
+            front.assign(back.size(), '\0');
+            frontLines.assign(backLines.size(), std::string(1, '\0'));
+            fullRedraw = false;
+        }
+
+        // マップ領域: 行ごとに変わったセルの連続区間だけを書く
+        for (int y = 0; y < cellRows; ++y) {
+            const char* old_row = front.data() + static_cast<size_t>(y) * cellColumns;
+            const char* new_row = back.data() + static_cast<size_t>(y) * cellColumns;
+            int x = 0;
+            while (x < cellColumns) {
+                if (old_row[x] == new_row[x]) {
+                    ++x;
+                    continue;
+                }
+                int start = x;
+                while (x < cellColumns && old_row[x] != new_row[x]) {
+                    ++x;
+                }
+                moveCursor(y, start * 2);
+                bool dim = false;
+                for (int i = start; i < x; ++i) {
+                    unsigned char cell = static_cast<unsigned char>(new_row[i]);
+                    if (((cell & CELL_DIM) != 0) != dim) {
+                        dim = !dim;
+                        out += dim ? "\x1b[2m" : "\x1b[22m";
+                    }
+                    out += static_cast<char>(cell & ~CELL_DIM);
+                    out += ' ';
+                }
+                if (dim) {
+                    out += "\x1b[22m";
+                }
+            }
+        }
+
+        // テキスト行: 変わった行を書き直して行末を消す
+        for (size_t i = 0; i < backLines.size(); ++i) {
+            if (frontLines[i] != backLines[i]) {
+                moveCursor(cellRows + static_cast<int>(i), 0);
+                out += textColumns > 0 ? fitToWidth(backLines[i], textColumns) : backLines[i];
+                out += "\x1b[0m\x1b[K";
+            }
+        }
+
+        front = back;
+        frontLines = backLines;
+        writeAll(out);
+    }
+
+    // フレームの下にカーソルを移してカーソルを表示する (以降は普通に出力できる)
+    void finish() {
+        if (!started) {
+            return;
+        }
+        out.clear();
+        moveCursor(cellRows + static_cast<int>(frontLines.size()), 0);
+        out += "\x1b[?25h";
+        writeAll(out);
+        started = false;
+        fullRedraw = true;
+    }
+
+    // 直前の present() で書き出したバイト数 (ベンチマーク用)
+    size_t lastFrameBytes() const { return out.size(); }
+
+private:
+    int cellColumns, cellRows;
+    int textColumns;
+    int fixedColumns, fixedRows;
+    std::vector<char> front, back;
+    std::vector<std::string> frontLines, backLines;
+    std::string out;
+    bool fullRedraw;
+    bool started;
+    bool outputEnabled;
+
+    // 全角 (表示幅2) の文字か (主な東アジアの文字の範囲だけを見る簡易判定)
+    static bool isWide(uint32_t code) {
+        return (code >= 0x1100 && code <= 0x115f) || (code >= 0x2e80 && code <= 0xa4cf)
+            || (code >= 0xac00 && code <= 0xd7a3) || (code >= 0xf900 && code <= 0xfaff)
+            || (code >= 0xfe30 && code <= 0xfe4f) || (code >= 0xff00 && code <= 0xff60)
+            || (code >= 0xffe0 && code <= 0xffe6) || (code >= 0x20000 && code <= 0x3fffd);
+    }
+
+    // 0 始まりの (行, 桁) にカーソルを移す
+    void moveCursor(int row, int column) {
+        out += "\x1b[";
+        out += std::to_string(row + 1);
+        out += ';';
+        out += std::to_string(column + 1);
+        out += 'H';
+    }
+
+    void writeAll(const std::string& data) const {
+        if (!outputEnabled) {
+            return;
+        }
+#ifdef _WIN32
+        std::fwrite(data.data(), 1, data.size(), stdout);
+        std::fflush(stdout);
+#else
+        size_t written = 0;
+        while (written < data.size()) {
+            ssize_t n = write(STDOUT_FILENO, data.data() + written, data.size() - written);
+            if (n <= 0) {
+                break;
+            }
+            written += static_cast<size_t>(n);
+        }
+#endif
+    }
+
+    // 端末に実際に書き出す最初のフレームの前に、プロセスで1度だけ端末側の準備をする
+    // (サーバーのセッションやベンチマークなど、書き出さないゲームはシグナルの設定に触れない)
+    static void prepareTerminal() {
+        static const bool prepared = [] {
+#ifdef _WIN32
+            // ANSI エスケープシーケンスを有効にする
+            HANDLE handle = GetStdHandle(STD_OUTPUT_HANDLE);
+            DWORD mode = 0;
+            if (GetConsoleMode(handle, &mode)) {
+                SetConsoleMode(handle, mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING);
+            }
+#else
+            installResizeHandler();
+#endif
+            return true;
+        }();
+        (void)prepared;
+    }
+
+#ifndef _WIN32
+    static volatile sig_atomic_t& resizeFlag() {
+        static volatile sig_atomic_t flag = 0;
+        return flag;
+    }
+
+    static void onResize(int) { resizeFlag() = 1; }
+
+    static void installResizeHandler() {
+        struct sigaction action = {};
+        action.sa_handler = onResize;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGWINCH, &action, nullptr);
+    }
+#endif
+};
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// --------------------------------------------------
+// スレッドプール (ThreadPool)
+// 固定数のワーカースレッドでタスクを実行する
+// --------------------------------------------------
+class ThreadPool {
+public:
+    // threads == 0 のときはハードウェアスレッド数を使う
+    explicit ThreadPool(unsigned threads = 0) {
+        if (threads == 0) {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        for (unsigned i = 0; i < threads; ++i) {
+            workers.emplace_back([this] { workerLoop(); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wakeup.notify_all();
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const { return workers.size(); }
+
+    // タスクを投入する (完了は待たない)
+    void enqueue(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push(std::move(task));
+        }
+        wakeup.notify_one();
+    }
+
+    // [0, count) の各 i について fn(i) を並列に実行し、全て終わるまで待つ
+    // 呼び出し元のスレッドも処理に参加する
+    template <class Fn>
+    void parallelFor(size_t count, Fn fn) {
+        if (count == 0) {
+            return;
+        }
+
+        struct Shared {
+            std::atomic<size_t> next{ 0 };
+            size_t exited = 0;
+            std::mutex mutex;
+            std::condition_variable finished;
+        };
+        Shared shared;
+
+        // 各参加者は添字を1つずつ取り合い、終わったら exited を数える
+        // (shared は呼び出し元のスタックにあるので、全参加者の終了まで待つ必要がある)
+        auto work = [&shared, &fn, count] {
+            for (size_t i = shared.next++; i < count; i = shared.next++) {
+                fn(i);
+            }
+            std::lock_guard<std::mutex> lock(shared.mutex);
+            ++shared.exited;
+            shared.finished.notify_all();
+        };
+
+        size_t helpers = std::min(workers.size(), count - 1);
+        for (size_t i = 0; i < helpers; ++i) {
+            enqueue(work);
+        }
+        work();
+
+        std::unique_lock<std::mutex> lock(shared.mutex);
+        shared.finished.wait(lock, [&shared, helpers] { return shared.exited == helpers + 1; });
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    bool stopping = false;
+
+    void workerLoop() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wakeup.wait(lock, [this] { return stopping || !tasks.empty(); });
+                if (stopping && tasks.empty()) {
+                    return;
+                }
+                task = std::move(tasks.front());
+                tasks.pop();
+            }
+            task();
+        }
+    }
+};
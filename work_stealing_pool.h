@@ -0,0 +1,153 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// --------------------------------------------------
+// ワークスティーリングのスレッドプール (WorkStealingPool)
+// ワーカーごとにタスクの両端キューを持ち、自分のキューは後ろから (直前に積んだものから) 取り、
+// 空になったら他のワーカーのキューの前から (古いものから) 盗む
+// 大量の小さなタスク (サーバーのセッションの1回分の処理など) を、1つのキューの取り合いにせず配る
+//
+// タスクは関数ポインタと引数の組で、投入のたびにメモリを確保しない
+// 引数の寿命は呼び出し側が管理する (タスクが終わるまで有効にしておく)
+// キューの操作はワーカーごとのロックだけで行い、全体のロックは眠るワーカーを起こすときにしか使わない
+// --------------------------------------------------
+class WorkStealingPool {
+public:
+    struct Task {
+        void (*run)(void*);
+        void* arg;
+    };
+
+    // threads == 0 のときはハードウェアスレッド数を使う
+    explicit WorkStealingPool(unsigned threads = 0) : pending(0), sleeping(0), stopping(false), nextQueue(0) {
+        if (threads == 0) {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        for (unsigned i = 0; i < threads; ++i) {
+            queues.emplace_back(new Queue);
+        }
+        for (unsigned i = 0; i < threads; ++i) {
+            workers.emplace_back([this, i] { workerLoop(i); });
+        }
+    }
+
+    ~WorkStealingPool() {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wakeup.notify_all();
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+    }
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    size_t size() const { return workers.size(); }
+
+    // タスクを投入する (完了は待たない)
+    // ワーカーの中から呼べばそのワーカーのキューに、外からなら順番に各ワーカーのキューに積む
+    void submit(void (*run)(void*), void* arg) {
+        const WorkerSlot& slot = currentSlot();
+        size_t index = slot.pool == this ? slot.index
+                                         : nextQueue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+        {
+            std::lock_guard<std::mutex> lock(queues[index]->mutex);
+            queues[index]->tasks.push_back({ run, arg });
+        }
+        // pending を増やしてから sleeping を読む (ワーカーは逆の順で読み書きするので、
+        // どちらかが必ず相手の更新を見る。ここは seq_cst の順序が必要)
+        pending.fetch_add(1);
+        if (sleeping.load() > 0) {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            wakeup.notify_one();
+        }
+    }
+
+    // 盗んだタスクの数 (負荷の偏りの目安)
+    uint64_t steals() const { return stealCount.load(std::memory_order_relaxed); }
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<size_t> pending;     // どこかのキューにあるタスクの数
+    std::atomic<unsigned> sleeping;
+    std::atomic<uint64_t> stealCount{ 0 };
+    std::mutex sleepMutex;
+    std::condition_variable wakeup;
+    bool stopping;
+    std::atomic<size_t> nextQueue;
+
+    // 今のスレッドがどのプールの何番目のワーカーか (ワーカーでなければ pool == nullptr)
+    struct WorkerSlot {
+        WorkStealingPool* pool;
+        size_t index;
+    };
+    static WorkerSlot& currentSlot() {
+        static thread_local WorkerSlot slot = { nullptr, 0 };
+        return slot;
+    }
+
+    bool popOwn(size_t index, Task& task) {
+        Queue& queue = *queues[index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty()) {
+            return false;
+        }
+        task = queue.tasks.back();
+        queue.tasks.pop_back();
+        return true;
+    }
+
+    bool steal(size_t thief, Task& task) {
+        for (size_t offset = 1; offset < queues.size(); ++offset) {
+            Queue& queue = *queues[(thief + offset) % queues.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (!queue.tasks.empty()) {
+                task = queue.tasks.front();
+                queue.tasks.pop_front();
+                stealCount.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void workerLoop(size_t index) {
+        currentSlot() = { this, index };
+        while (true) {
+            Task task;
+            if (popOwn(index, task) || steal(index, task)) {
+                pending.fetch_sub(1);
+                task.run(task.arg);
+                continue;
+            }
+
+            // どのキューも空なら、タスクが積まれるまで眠る
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            sleeping.fetch_add(1);
+            wakeup.wait(lock, [this] { return stopping || pending.load() > 0; });
+            sleeping.fetch_sub(1);
+            if (stopping && pending.load() == 0) {
+                return;
+            }
+        }
+    }
+};